@@ -582,10 +582,10 @@ const uint8_t COLED::oled72_initbuf[26] = {
 
 int COLED::I2CWrite (CI2C **pI2C, uint8_t iAddr, uint8_t *pData, int iLen) {
   if ((*pI2C) != NULL) {
+    // Whole block in one transaction
+    CI2C::TI2CTrans t = { iAddr, 0, { 0 }, 0, pData, (uint16_t)iLen };
     (*pI2C)->lock_sem();
-    (*pI2C)->begin (iAddr);
-    for (int i = 0; i < iLen; i++) (*pI2C)->write (pData[i]);
-    (*pI2C)->end();
+    (*pI2C)->run (&t);
     (*pI2C)->unlock_sem();
 
     return iLen;
@@ -607,16 +607,8 @@ uint8_t COLED::I2CTest (CI2C **pI2C, uint8_t addr) {
 
 int COLED::I2CReadRegister (CI2C **pI2C, uint8_t iAddr, uint8_t u8Register, uint8_t *pData, int iLen) {
   int r = 0;
-  if ((*pI2C) != NULL) {
-    (*pI2C)->lock_sem();
-    if ((*pI2C)->begin (iAddr)) {
-      (*pI2C)->write (u8Register);
-      if ((*pI2C)->begin (iAddr, true)) {
-        r = (*pI2C)->read (pData, iLen) ? 1 : 0;
-      }
-    }
-    (*pI2C)->end();
-    (*pI2C)->unlock_sem();
+  if (((*pI2C) != NULL) && (iLen > 0)) {
+    r = ((*pI2C)->read_reg (iAddr, u8Register, pData, iLen) == CI2C::IIC_OK) ? 1 : 0;
   }
   return r;
 }
@@ -696,6 +688,7 @@ int COLED::begin (SSOLED *pOLED, CI2C *dev, int iType, int iAddr, int bFlip, int
   pOLED->oled_type = iType;
   pOLED->oled_flip = bFlip;
   pOLED->oled_wrap = 0; // default - disable text wrap
+  memset (pOLED->dirty, 0, sizeof (pOLED->dirty));
 
   // find the device address if requested
   if (iAddr == -1 || iAddr == 0 || iAddr == 0xff) { // find it
@@ -820,35 +813,41 @@ int COLED::ScrollBuffer (SSOLED *pOLED, int iStartCol, int iEndCol, int iStartRo
       }
     }
   }
+  SetDirty (pOLED, iStartCol, iStartRow * 8, iEndCol, iEndRow * 8 + 7);
   return 0;
 }
 
-// Send commands to position the "cursor" (aka memory write address)
-// to the given row and column
-void COLED::oledSetPosition (SSOLED *pOLED, int x, int y, int bRender) {
-  uint8_t buf[4];
-
-  pOLED->iScreenOffset = (y * 128) + x;
-  if (!bRender)
-    return; // don't send the commands to the OLED if we're not rendering the graphics now
+// Apply the offset of the visible area to the column and page
+void COLED::oledMapPosition (SSOLED *pOLED, int *x, int *y) {
   if (pOLED->oled_type == OLED_64x32) { // visible display starts at column 32, row 4
-    x += 32; // display is centered in VRAM, so this is always true
+    *x += 32; // display is centered in VRAM, so this is always true
     if (pOLED->oled_flip == 0) // non-flipped display starts from line 4
-      y += 4;
+      *y += 4;
   } else if (pOLED->oled_type == OLED_132x64) { // SH1106 has 128 pixels centered in 132
-    x += 2;
+    *x += 2;
   } else if (pOLED->oled_type == OLED_96x16) { // visible display starts at line 2
     // mapping is a bit strange on the 96x16 OLED
     if (pOLED->oled_flip)
-      x += 32;
+      *x += 32;
     else
-      y += 2;
+      *y += 2;
   } else if (pOLED->oled_type == OLED_72x40) { // starts at x=28,y=3
-    x += 28;
+    *x += 28;
     if (!pOLED->oled_flip) {
-      y += 3;
+      *y += 3;
     }
   }
+}
+
+// Send commands to position the "cursor" (aka memory write address)
+// to the given row and column
+void COLED::oledSetPosition (SSOLED *pOLED, int x, int y, int bRender) {
+  uint8_t buf[4];
+
+  pOLED->iScreenOffset = (y * 128) + x;
+  if (!bRender)
+    return; // don't send the commands to the OLED if we're not rendering the graphics now
+  oledMapPosition (pOLED, &x, &y);
   buf[0] = 0x00; // command introducer
   buf[1] = 0xb0 | y; // set page to Y
   buf[2] = x & 0xf; // lower column address
@@ -856,6 +855,41 @@ void COLED::oledSetPosition (SSOLED *pOLED, int x, int y, int bRender) {
   _I2CWrite (pOLED, buf, 4);
 }
 
+// Position and pixel data of a page in one I2C transaction
+// The commands are sent with the continuation bit (0x80), so the data (0x40) can follow
+// without STOP, and the data is sent from the buffer without copying.
+void COLED::oledWritePage (SSOLED *pOLED, const uint8_t *pData, int x, int y, int iLen) {
+  uint8_t buf[7];
+
+  if (pOLED->bbi2c == NULL || iLen <= 0)
+    return;
+  oledMapPosition (pOLED, &x, &y);
+  buf[0] = 0x80; // one command
+  buf[1] = 0xb0 | y; // set page to Y
+  buf[2] = 0x80;
+  buf[3] = x & 0xf; // lower column address
+  buf[4] = 0x80;
+  buf[5] = 0x10 | (x >> 4); // upper column addr
+  buf[6] = 0x40; // data follows
+  CI2C::TI2CTrans h = { pOLED->oled_addr, CI2C::fNOSTOP, { 0 }, 0, buf, sizeof (buf) };
+  CI2C::TI2CTrans d = { 0, CI2C::fNOSTART, { 0 }, 0, pData, (uint16_t)iLen };
+  pOLED->bbi2c->lock_sem();
+  pOLED->bbi2c->submit (&h);
+  pOLED->bbi2c->run (&d);
+  pOLED->bbi2c->unlock_sem();
+}
+
+// Mark columns of the back buffer as changed (continues to the next page)
+void COLED::oledMarkDirty (SSOLED *pOLED, int x, int y, int iLen) {
+  while (iLen > 0 && y < 16) {
+    int n = (iLen > 128 - x) ? 128 - x : iLen;
+    pOLED->dirty[y] |= (uint16_t) ((2UL << ((x + n - 1) >> 3)) - (1UL << (x >> 3)));
+    iLen -= n;
+    x = 0;
+    y++;
+  }
+}
+
 // Write a block of pixel data to the OLED
 // Length can be anything from 1 to 1024 (whole display)
 void COLED::oledWriteDataBlock (SSOLED *pOLED, const uint8_t *ucBuf, int iLen, int bRender) {
@@ -870,6 +904,8 @@ void COLED::oledWriteDataBlock (SSOLED *pOLED, const uint8_t *ucBuf, int iLen, i
   }
   // Keep a copy in local buffer
   if (pOLED->ucScreen) {
+    if (!bRender)
+      oledMarkDirty (pOLED, pOLED->iScreenOffset & 127, pOLED->iScreenOffset >> 7, iLen);
     __aeabi_memcpy (&pOLED->ucScreen[pOLED->iScreenOffset], ucBuf, iLen);
     pOLED->iScreenOffset += iLen;
     pOLED->iScreenOffset &= 1023; // we use a fixed stride of 128 no matter what the display size
@@ -1044,6 +1080,7 @@ void COLED::DrawSprite (SSOLED *pOLED, uint8_t *pSprite, int cx, int cy, int iPi
   }
   if (x + cx > pOLED->oled_x)
     cx = pOLED->oled_x - x;
+  SetDirty (pOLED, dx, dy, dx + cx - 1, dy + cy - 1);
   for (ty = 0; ty < cy; ty++) {
     s = &pSprite[iStartX >> 3];
     d = &pOLED->ucScreen[ (dy >> 3) * pOLED->oled_x + dx];
@@ -1587,37 +1624,75 @@ int COLED::DrawGFX (SSOLED *pOLED, uint8_t *pBuffer, int iSrcCol, int iSrcRow, i
 
 // Dump a screen's worth of data directly to the display
 // Try to speed it up by comparing the new bytes with the existing buffer
+// Pass NULL to send the whole back buffer
 void COLED::DumpBuffer (SSOLED *pOLED, uint8_t *pBuffer) {
-  int x, y;
-  int iLines, iCols;
-  uint8_t bNeedPos;
-  uint8_t *pSrc = pOLED->ucScreen;
+  int x1, x2, y;
+  int iLines = pOLED->oled_y >> 3;
+
+  if (pBuffer == NULL || pBuffer == pOLED->ucScreen) { // send the whole back buffer
+    if (pOLED->ucScreen == NULL)
+      return; // no backbuffer and no provided buffer
+    SetDirty (pOLED, 0, 0, pOLED->oled_x - 1, pOLED->oled_y - 1);
+  } else if (pOLED->ucScreen == NULL) { // nothing to compare with, send everything
+    for (y = 0; y < iLines; y++)
+      oledWritePage (pOLED, &pBuffer[y * 128], 0, y, pOLED->oled_x);
+    return;
+  } else {
+    for (y = 0; y < iLines; y++) { // copy the changed span of each line to the back buffer
+      uint8_t *s = &pBuffer[y * 128], *d = &pOLED->ucScreen[y * 128];
+      for (x1 = 0; x1 < pOLED->oled_x && s[x1] == d[x1]; x1++);
+      if (x1 == pOLED->oled_x)
+        continue; // no change
+      for (x2 = pOLED->oled_x - 1; s[x2] == d[x2]; x2--);
+      __aeabi_memcpy (&d[x1], &s[x1], x2 - x1 + 1);
+      oledMarkDirty (pOLED, x1, y, x2 - x1 + 1);
+    }
+  }
+  Flush (pOLED);
+}
 
-  if (pBuffer == NULL) // dump the internal buffer if none is given
-    pBuffer = pOLED->ucScreen;
-  if (pBuffer == NULL)
-    return; // no backbuffer and no provided buffer
+// Send the parts of the back buffer changed since the last flush
+// Each page is sent in one I2C transaction from the first to the last changed block
+// Returns the number of pages sent
+int COLED::Flush (SSOLED *pOLED) {
+  int y, x1, x2, n = 0;
+  int iLines = pOLED->oled_y >> 3;
 
-  iLines = pOLED->oled_y >> 3;
-  iCols = pOLED->oled_x >> 4;
+  if (pOLED->ucScreen == NULL)
+    return 0;
   for (y = 0; y < iLines; y++) {
-    bNeedPos = 1; // start of a new line means we need to set the position too
-    for (x = 0; x < iCols; x++) { // wiring library has a 32-byte buffer, so send 16 bytes so that the data prefix (0x40) can fit
-      if (pOLED->ucScreen == NULL || pBuffer == pSrc || memcmp (pSrc, pBuffer, 16) != 0) { // doesn't match, need to send it
-        if (bNeedPos) { // need to reposition output cursor?
-          bNeedPos = 0;
-          oledSetPosition (pOLED, x * 16, y, 1);
-        }
-        oledWriteDataBlock (pOLED, pBuffer, 16, 1);
-      } else {
-        bNeedPos = 1; // we're skipping a block, so next time will need to set the new position
-      }
-      pSrc += 16;
-      pBuffer += 16;
-    }
-    pSrc += (128 - pOLED->oled_x); // for narrow displays, skip to the next line
-    pBuffer += (128 - pOLED->oled_x);
+    uint16_t d = pOLED->dirty[y];
+    if (d == 0)
+      continue;
+    pOLED->dirty[y] = 0;
+    // Unchanged blocks in between are cheaper to send than another transaction
+    for (x1 = 0; ! (d & (1 << x1)); x1++);
+    for (x2 = 15; ! (d & (1 << x2)); x2--);
+    x1 <<= 3;
+    x2 = (x2 << 3) + 8;
+    if (x2 > pOLED->oled_x)
+      x2 = pOLED->oled_x;
+    if (x1 >= x2)
+      continue;
+    oledWritePage (pOLED, &pOLED->ucScreen[(y * 128) + x1], x1, y, x2 - x1);
+    n++;
   }
+  return n;
+}
+
+// Mark a rectangle of the back buffer as changed
+// Needed only when the buffer is modified without the drawing functions
+void COLED::SetDirty (SSOLED *pOLED, int x1, int y1, int x2, int y2) {
+  int y;
+
+  if (x1 < 0) x1 = 0;
+  if (y1 < 0) y1 = 0;
+  if (x2 >= pOLED->oled_x) x2 = pOLED->oled_x - 1;
+  if (y2 >= pOLED->oled_y) y2 = pOLED->oled_y - 1;
+  if (x1 > x2 || y1 > y2)
+    return;
+  for (y = y1 >> 3; y <= (y2 >> 3); y++)
+    oledMarkDirty (pOLED, x1, y, x2 - x1 + 1);
 }
 
 // Fill the frame buffer with a byte pattern
@@ -1774,15 +1849,18 @@ void COLED::DrawLine (SSOLED *pOLED, int x1, int y1, int x2, int y2, int bRender
 // the scale is a 16-bit integer with and 8-bit fraction and 8-bit mantissa
 // To draw at 1x scale, set the scale factor to 256. To draw at 2x, use 512
 // The output must be drawn into a memory buffer, not directly to the display
+// Each character cell is clipped once and drawn column by column; a column is
+// built as page bytes (reused while it comes from the same source column or row)
+// and written with masks only at the top and bottom pages
 int COLED::ScaledString (SSOLED *pOLED, int x, int y, char *szMsg, int iSize, int bInvert, int iXScale, int iYScale, int iRotation) {
-  uint32_t row, col, dx, dy;
+  uint32_t dx, dy;
   uint32_t sx, sy;
-  uint8_t c, uc, color, *d;
+  uint8_t c, *d;
   const uint8_t *s;
-  uint8_t ucTemp[16];
-  int tx, ty, bit, iFontOff;
-  int iPitch;
-  int iFontWidth;
+  uint8_t ucTemp[16], ucCol[16];
+  int iFontOff, iFontWidth;
+  int u, u0, u1, v, r, r0, r1, p, iCols, iRows, iSrc, iLast;
+  int bDown, bRight, bRotated;
 
   if (iXScale == 0 || iYScale == 0 || szMsg == NULL || pOLED == NULL || pOLED->ucScreen == NULL || x < 0 || y < 0 || x >= pOLED->oled_x - 1 || y >= pOLED->oled_y - 1)
     return -1; // invalid display structure
@@ -1790,11 +1868,16 @@ int COLED::ScaledString (SSOLED *pOLED, int x, int y, char *szMsg, int iSize, in
     return -1; // only on the small fonts (for now)
   iFontWidth = (iSize == FONT_6x8) ? 6 : 8;
   s = (iSize == FONT_6x8) ? ucSmallFont : ucFont;
-  iPitch = pOLED->oled_x;
   dx = (iFontWidth * iXScale) >> 8; // width of each character
   dy = (8 * iYScale) >> 8; // height of each character
   sx = 65536 / iXScale; // turn the scale into an accumulator value
   sy = 65536 / iYScale;
+  // screen columns run along the character width at 0/180 degrees, along its height at 90/270
+  bRotated = (iRotation == ROT_90 || iRotation == ROT_270);
+  bRight = (iRotation == ROT_0 || iRotation == ROT_270); // columns go right
+  bDown = (iRotation == ROT_0 || iRotation == ROT_90); // rows go down
+  iCols = bRotated ? dy : dx;
+  iRows = bRotated ? dx : dy;
   while (*szMsg) {
     c = *szMsg++; // debug - start with normal font
     iFontOff = (int) (c - 32) * (iFontWidth - 1);
@@ -1802,43 +1885,50 @@ int COLED::ScaledString (SSOLED *pOLED, int x, int y, char *szMsg, int iSize, in
     ucTemp[0] = 0; // first column is blank
     __aeabi_memcpy (&ucTemp[1], &s[iFontOff], iFontWidth - 1);
     if (bInvert) InvertBytes (ucTemp, iFontWidth);
-    col = 0;
-    for (tx = 0; tx < (int)dx; tx++) {
-      row = 0;
-      uc = ucTemp[col >> 8];
-      for (ty = 0; ty < (int)dy; ty++) {
-        int nx, ny;
-        bit = row >> 8;
-        color = (uc & (1 << bit)); // set or clear the pixel
-        switch (iRotation) {
-          case ROT_0:
-            nx = x + tx;
-            ny = y + ty;
-            break;
-          case ROT_90:
-            nx = x - ty;
-            ny = y + tx;
-            break;
-          case ROT_180:
-            nx = x - tx;
-            ny = y - ty;
-            break;
-          case ROT_270:
-            nx = x + ty;
-            ny = y - tx;
-            break;
+
+    // clip the cell once
+    if (bRight) {
+      u0 = (x < 0) ? -x : 0;
+      u1 = pOLED->oled_x - 1 - x;
+    } else {
+      u0 = (x >= pOLED->oled_x) ? x - pOLED->oled_x + 1 : 0;
+      u1 = x;
+    }
+    if (u1 > iCols - 1) u1 = iCols - 1;
+    r0 = bDown ? y : y - iRows + 1;
+    r1 = bDown ? y + iRows - 1 : y;
+    if (r0 < 0) r0 = 0;
+    if (r1 >= pOLED->oled_y) r1 = pOLED->oled_y - 1;
+
+    if (u0 <= u1 && r0 <= r1) {
+      uint8_t ucMask1 = 0xff << (r0 & 7), ucMask2 = 0xff >> (7 - (r1 & 7));
+      if ((r0 >> 3) == (r1 >> 3)) ucMask1 &= ucMask2;
+      SetDirty (pOLED, bRight ? x + u0 : x - u1, r0, bRight ? x + u1 : x - u0, r1);
+      iLast = -1;
+      for (u = u0; u <= u1; u++) {
+        iSrc = (u * (bRotated ? sy : sx)) >> 8; // source column (or bit row when rotated)
+        if (iSrc != iLast) { // build the page bytes of this column
+          iLast = iSrc;
+          for (p = r0 >> 3; p <= (r1 >> 3); p++)
+            ucCol[p] = 0;
+          for (r = r0; r <= r1; r++) {
+            v = bDown ? r - y : y - r;
+            if (bRotated ? (ucTemp[(v * sx) >> 8] & (1 << iSrc)) : (ucTemp[iSrc] & (1 << ((v * sy) >> 8))))
+              ucCol[r >> 3] |= 1 << (r & 7);
+          }
         }
-        // plot the pixel if it's within the image boundaries
-        if (nx >= 0 && ny >= 0 && nx < pOLED->oled_x && ny < pOLED->oled_y) {
-          d = &pOLED->ucScreen[ (ny >> 3) * iPitch + nx];
-          if (color)
-            d[0] |= (1 << (ny & 7));
-          else
-            d[0] &= ~ (1 << (ny & 7));
+        d = &pOLED->ucScreen[ (r0 >> 3) * 128 + (bRight ? x + u : x - u)];
+        p = r0 >> 3;
+        *d = (*d & ~ucMask1) | (ucCol[p] & ucMask1);
+        for (p++; p < (r1 >> 3); p++) {
+          d += 128;
+          *d = ucCol[p];
+        }
+        if (p == (r1 >> 3)) {
+          d += 128;
+          *d = (*d & ~ucMask2) | (ucCol[p] & ucMask2);
         }
-        row += sy; // add fractional increment to source row of character
       }
-      col += sx; // add fractional increment to source column
     }
     // update the 'cursor' position
     switch (iRotation) {
@@ -1859,102 +1949,103 @@ int COLED::ScaledString (SSOLED *pOLED, int x, int y, char *szMsg, int iSize, in
   return 0;
 }
 
-// For drawing ellipses, a circle is drawn and the x and y pixels are scaled by a 16-bit integer fraction
-// This function draws a single pixel and scales its position based on the x/y fraction of the ellipse
-void COLED::DrawScaledPixel (SSOLED *pOLED, int iCX, int iCY, int x, int y, int32_t iXFrac, int32_t iYFrac, uint8_t ucColor) {
-  uint8_t *d, ucMask;
+// Set or clear a vertical run of pixels in one column
+// Whole bytes are written per page, only the end pages are masked
+// The column must be on the screen, the rows are clipped
+void COLED::oledVSpan (SSOLED *pOLED, int x, int y1, int y2, uint8_t ucColor) {
+  uint8_t *d, ucMask, ucMask2;
+  int p, p2;
 
-  if (iXFrac != 0x10000) x = ((x * iXFrac) >> 16);
-  if (iYFrac != 0x10000) y = ((y * iYFrac) >> 16);
-  x += iCX;
-  y += iCY;
-  if (x < 0 || x >= pOLED->oled_x || y < 0 || y >= pOLED->oled_y)
-    return; // off the screen
-  d = &pOLED->ucScreen[ ((y >> 3) * 128) + x];
-  ucMask = 1 << (y & 7);
-  if (ucColor)
+  if (y1 < 0) y1 = 0;
+  if (y2 >= pOLED->oled_y) y2 = pOLED->oled_y - 1;
+  if (y1 > y2)
+    return;
+  p = y1 >> 3;
+  p2 = y2 >> 3;
+  d = &pOLED->ucScreen[ (p * 128) + x];
+  ucMask = 0xff << (y1 & 7);
+  ucMask2 = 0xff >> (7 - (y2 & 7));
+  if (p == p2)
+    ucMask &= ucMask2;
+  if (ucColor) {
     *d |= ucMask;
-  else
+    for (p++; p < p2; p++) {
+      d += 128;
+      *d = 0xff;
+    }
+    if (p == p2) {
+      d += 128;
+      *d |= ucMask2;
+    }
+  } else {
     *d &= ~ucMask;
-}
-
-// For drawing filled ellipses
-void COLED::DrawScaledLine (SSOLED *pOLED, int iCX, int iCY, int x, int y, int32_t iXFrac, int32_t iYFrac, uint8_t ucColor) {
-  int iLen, x2;
-  uint8_t *d, ucMask;
-  if (iXFrac != 0x10000) x = ((x * iXFrac) >> 16);
-  if (iYFrac != 0x10000) y = ((y * iYFrac) >> 16);
-  iLen = x * 2;
-  x = iCX - x;
-  y += iCY;
-  x2 = x + iLen;
-  if (y < 0 || y >= pOLED->oled_y)
-    return; // completely off the screen
-  if (x < 0) x = 0;
-  if (x2 >= pOLED->oled_x) x2 = pOLED->oled_x - 1;
-  iLen = x2 - x + 1; // new length
-  d = &pOLED->ucScreen[ ((y >> 3) * 128) + x];
-  ucMask = 1 << (y & 7);
-  if (ucColor) { // white
-    for (; iLen > 0; iLen--)
-      *d++ |= ucMask;
-  } else { // black
-    for (; iLen > 0; iLen--)
-      *d++ &= ~ucMask;
-  }
-}
-
-// Draw the 8 pixels around the Bresenham circle
-// (scaled to make an ellipse)
-void COLED::BresenhamCircle (SSOLED *pOLED, int iCX, int iCY, int x, int y, int32_t iXFrac, int32_t iYFrac, uint8_t ucColor, uint8_t bFill) {
-  if (bFill) { // draw a filled ellipse
-    // for a filled ellipse, draw 4 lines instead of 8 pixels
-    DrawScaledLine (pOLED, iCX, iCY, x, y, iXFrac, iYFrac, ucColor);
-    DrawScaledLine (pOLED, iCX, iCY, x, -y, iXFrac, iYFrac, ucColor);
-    DrawScaledLine (pOLED, iCX, iCY, y, x, iXFrac, iYFrac, ucColor);
-    DrawScaledLine (pOLED, iCX, iCY, y, -x, iXFrac, iYFrac, ucColor);
-  } else { // draw 8 pixels around the edges
-    DrawScaledPixel (pOLED, iCX, iCY, x, y, iXFrac, iYFrac, ucColor);
-    DrawScaledPixel (pOLED, iCX, iCY, -x, y, iXFrac, iYFrac, ucColor);
-    DrawScaledPixel (pOLED, iCX, iCY, x, -y, iXFrac, iYFrac, ucColor);
-    DrawScaledPixel (pOLED, iCX, iCY, -x, -y, iXFrac, iYFrac, ucColor);
-    DrawScaledPixel (pOLED, iCX, iCY, y, x, iXFrac, iYFrac, ucColor);
-    DrawScaledPixel (pOLED, iCX, iCY, -y, x, iXFrac, iYFrac, ucColor);
-    DrawScaledPixel (pOLED, iCX, iCY, y, -x, iXFrac, iYFrac, ucColor);
-    DrawScaledPixel (pOLED, iCX, iCY, -y, -x, iXFrac, iYFrac, ucColor);
+    for (p++; p < p2; p++) {
+      d += 128;
+      *d = 0x00;
+    }
+    if (p == p2) {
+      d += 128;
+      *d &= ~ucMask2;
+    }
   }
 }
 
 // Draw an outline or filled ellipse
+// The half height of each column is found incrementally from (x/rx')^2 + (y/ry')^2 <= 1
+// (rx' = rx + 1/2, ry' = ry + 1/2, in doubled coordinates to stay in integers),
+// and the columns are drawn as vertical runs: the whole height when filled, or from
+// this height to the next column's for the outline, so it stays connected
 void COLED::Ellipse (SSOLED *pOLED, int iCenterX, int iCenterY, int32_t iRadiusX, int32_t iRadiusY, uint8_t ucColor, uint8_t bFilled) {
-  int32_t iXFrac, iYFrac;
-  int iRadius, iDelta, x, y;
+  int64_t A, B, e, iIncA, iIncB;
+  int x, x1, x2, h, hCur, hNext, lo;
 
   if (pOLED == NULL || pOLED->ucScreen == NULL)
     return; // must have back buffer defined
   if (iRadiusX <= 0 || iRadiusY <= 0) return; // invalid radii
 
-  if (iRadiusX > iRadiusY) { // use X as the primary radius
-    iRadius = iRadiusX;
-    iXFrac = 65536;
-    iYFrac = (iRadiusY * 65536) / iRadiusX;
-  } else {
-    iRadius = iRadiusY;
-    iXFrac = (iRadiusX * 65536) / iRadiusY;
-    iYFrac = 65536;
-  }
-  iDelta = 3 - (2 * iRadius);
-  x = 0;
-  y = iRadius;
-  while (x <= y) {
-    BresenhamCircle (pOLED, iCenterX, iCenterY, x, y, iXFrac, iYFrac, ucColor, bFilled);
-    x++;
-    if (iDelta < 0) {
-      iDelta += (4 * x) + 6;
-    } else {
-      iDelta += 4 * (x - y) + 10;
-      y--;
+  // clip once
+  x1 = (iCenterX - iRadiusX < 0) ? 0 : iCenterX - iRadiusX;
+  x2 = (iCenterX + iRadiusX >= pOLED->oled_x) ? pOLED->oled_x - 1 : iCenterX + iRadiusX;
+  if (x1 > x2 || iCenterY + iRadiusY < 0 || iCenterY - iRadiusY >= pOLED->oled_y)
+    return; // off the screen
+  SetDirty (pOLED, x1, iCenterY - iRadiusY, x2, iCenterY + iRadiusY);
+
+  A = (int64_t) (2 * iRadiusX + 1) * (2 * iRadiusX + 1);
+  B = (int64_t) (2 * iRadiusY + 1) * (2 * iRadiusY + 1);
+  e = -(4 * (int64_t)iRadiusY + 1) * A; // (2x)^2 * B + (2h)^2 * A - A * B
+  iIncA = (int64_t) (8 * iRadiusY - 4) * A; // decrease of e when h decrements
+  iIncB = 4 * B; // increase of e when x increments
+  h = hCur = iRadiusY;
+  for (x = 0; x <= iRadiusX; x++) {
+    // half height of the next column
+    e += iIncB;
+    iIncB += 8 * B;
+    while (e > 0 && h > 0) {
+      e -= iIncA;
+      iIncA -= 8 * A;
+      h--;
+    }
+    hNext = (x < iRadiusX) ? h : -1;
+
+    if (iCenterX + x >= x1 && iCenterX + x <= x2) {
+      if (bFilled) {
+        oledVSpan (pOLED, iCenterX + x, iCenterY - hCur, iCenterY + hCur, ucColor);
+      } else {
+        lo = (hNext + 1 < hCur) ? hNext + 1 : hCur;
+        oledVSpan (pOLED, iCenterX + x, iCenterY - hCur, iCenterY - lo, ucColor);
+        oledVSpan (pOLED, iCenterX + x, iCenterY + lo, iCenterY + hCur, ucColor);
+      }
+    }
+    if (x > 0 && iCenterX - x >= x1 && iCenterX - x <= x2) {
+      if (bFilled) {
+        oledVSpan (pOLED, iCenterX - x, iCenterY - hCur, iCenterY + hCur, ucColor);
+      } else {
+        lo = (hNext + 1 < hCur) ? hNext + 1 : hCur;
+        oledVSpan (pOLED, iCenterX - x, iCenterY - hCur, iCenterY - lo, ucColor);
+        oledVSpan (pOLED, iCenterX - x, iCenterY + lo, iCenterY + hCur, ucColor);
+      }
     }
+    hCur = hNext;
   }
 }
 
@@ -1978,6 +2069,7 @@ void COLED::Rectangle (SSOLED *pOLED, int x1, int y1, int x2, int y2, uint8_t uc
     y1 = y2;
     y2 = tmp;
   }
+  SetDirty (pOLED, x1, y1, x2, y2);
   if (bFilled) {
     int x, y, iMiddle;
     iMiddle = (y2 >> 3) - (y1 >> 3);
@@ -2260,3 +2352,125 @@ int COLED::printf (SSOLED *pOLED, const char *fmt, ...) {
 
   return len;
 }
+
+/*!
+ @brief Background refresh of COLED.
+ @note
+   The application draws into the back buffer of SSOLED with bRender = 0 and calls present().
+   present() copies the changed blocks into the front buffer owned by this class, and the
+   refresh task sends them at the frame rate, so the drawing task never waits for I2C.
+   A frame presented while the previous one is being sent is not accepted; the changes stay
+   marked in the back buffer and go with the next frame.
+ @attention
+   FreeRTOS scheduler must be running to use this class.
+ */
+// Send the presented frames
+void COLEDRefresh::refresh_task (void) {
+  portTickType t = xTaskGetTickCount();
+
+  while (!kill_refresh_task) {
+    vTaskDelayUntil (&t, period);
+    uint32_t primask = __get_PRIMASK();
+    __disable_irq();
+    bool go = ready && !copying;
+    if (go) {
+      sending = true;
+      ready = false;
+    }
+    __set_PRIMASK (primask);
+    if (!go) continue;
+
+    if (pDisp->Flush (&front) > 0) frames++;
+    sending = false;
+  }
+  refresh_task_handle = NULL;
+  vTaskDelete (NULL);
+}
+
+//! disp, oled:display to be refreshed (begin() must have been done)
+COLEDRefresh::COLEDRefresh (COLED *disp, COLED::SSOLED *oled) {
+  pDisp = disp;
+  pOLED = oled;
+  front = *oled;
+  front.ucScreen = (uint8_t *)malloc (1024);
+  copying = sending = ready = false;
+  frames = skipped = 0;
+  period = 33;
+  refresh_task_handle = NULL;
+  kill_refresh_task = false;
+}
+
+COLEDRefresh::~COLEDRefresh() {
+  end();
+  free (front.ucScreen);
+}
+
+//! Start refresh task.
+//  The whole back buffer is sent as the first frame.
+bool COLEDRefresh::begin (uint8_t fps, UBaseType_t prio) {
+  if (front.ucScreen == NULL || pOLED->ucScreen == NULL) return false;
+  if (refresh_task_handle == NULL) {
+    uint8_t *buf = front.ucScreen;
+    front = *pOLED;
+    front.ucScreen = buf;
+    __aeabi_memcpy (front.ucScreen, pOLED->ucScreen, 1024);
+    memset (pOLED->dirty, 0, sizeof (pOLED->dirty));
+    pDisp->SetDirty (&front, 0, 0, front.oled_x - 1, front.oled_y - 1);
+    period = (fps > 0) ? MAX (1000 / fps, 1) : 1000;
+    copying = sending = false;
+    ready = true;
+    kill_refresh_task = false;
+    xTaskCreate ([] (void *arg) { static_cast<COLEDRefresh *> (arg)->refresh_task(); }, "OLED", 120, this, prio, &refresh_task_handle);
+  }
+  return refresh_task_handle != NULL;
+}
+
+//! Stop refresh task.
+//  Waits for the frame being sent.
+void COLEDRefresh::end (void) {
+  if (refresh_task_handle != NULL) {
+    kill_refresh_task = true;
+    while (refresh_task_handle != NULL) vTaskDelay (1);
+  }
+}
+
+//! Hand the changes in the back buffer to the refresh task
+bool COLEDRefresh::present (void) {
+  uint32_t primask = __get_PRIMASK();
+  __disable_irq();
+  if (sending) {
+    __set_PRIMASK (primask);
+    skipped++;
+    return false;
+  }
+  copying = true;
+  __set_PRIMASK (primask);
+
+  // Copy the span of changed blocks of each page, the dirty blocks move to the front
+  for (int y = 0; y < (pOLED->oled_y >> 3); y++) {
+    uint16_t d = pOLED->dirty[y];
+    int x1, x2;
+    if (d == 0) continue;
+    for (x1 = 0; ! (d & (1 << x1)); x1++);
+    for (x2 = 15; ! (d & (1 << x2)); x2--);
+    x1 <<= 3;
+    x2 = (x2 << 3) + 8;
+    __aeabi_memcpy (&front.ucScreen[(y * 128) + x1], &pOLED->ucScreen[(y * 128) + x1], x2 - x1);
+    front.dirty[y] |= d;
+    pOLED->dirty[y] = 0;
+    ready = true;
+  }
+
+  copying = false;
+  return true;
+}
+
+//! Number of frames sent
+uint32_t COLEDRefresh::get_frames (void) {
+  return frames;
+}
+
+//! Number of present() not accepted
+uint32_t COLEDRefresh::get_skipped (void) {
+  return skipped;
+}
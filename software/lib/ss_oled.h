@@ -37,6 +37,7 @@ class COLED {
     int iScreenOffset;
     int rc;
     CI2C *bbi2c;
+    uint16_t dirty[16]; // changed 8-column blocks of each page, not yet sent
   } SSOLED;
 
   //! 4 possible font sizes: 8x8, 16x32, 6x8, 16x16 (stretched from 8x8)
@@ -90,7 +91,7 @@ class COLED {
     FONT_STRETCHED  =FONT_16x16
   };
 
- private:
+ protected:
 
   static const uint8_t ucFont[];
 #ifndef __MEMORY_SAVEING_SYSTEM__
@@ -149,6 +150,12 @@ class COLED {
   // Send commands to position the "cursor" (aka memory write address)
   // to the given row and column
   void oledSetPosition (SSOLED *pOLED, int x, int y, int bRender);
+  // Apply the offset of the visible area to the column and page
+  void oledMapPosition (SSOLED *pOLED, int *x, int *y);
+  // Position and pixel data of a page in one I2C transaction
+  void oledWritePage (SSOLED *pOLED, const uint8_t *pData, int x, int y, int iLen);
+  // Mark columns of the back buffer as changed (continues to the next page)
+  void oledMarkDirty (SSOLED *pOLED, int x, int y, int iLen);
   // Write a block of pixel data to the OLED
   // Length can be anything from 1 to 1024 (whole display)
   void oledWriteDataBlock (SSOLED *pOLED, const uint8_t *ucBuf, int iLen, int bRender);
@@ -231,8 +238,18 @@ class COLED {
 
   //! Dump a screen's worth of data directly to the display
   // Try to speed it up by comparing the new bytes with the existing buffer
+  // Pass NULL to send the whole back buffer
   void DumpBuffer (SSOLED *pOLED, uint8_t *pBuffer);
 
+  //! Send the parts of the back buffer changed since the last flush
+  // Each page is sent in one I2C transaction from the first to the last changed block
+  // Returns the number of pages sent
+  int Flush (SSOLED *pOLED);
+
+  //! Mark a rectangle of the back buffer as changed
+  // Needed only when the buffer is modified without the drawing functions
+  void SetDirty (SSOLED *pOLED, int x1, int y1, int x2, int y2);
+
   //! Fill the frame buffer with a byte pattern
   // e.g. all off (0x00) or all on (0xff)
   void Fill (SSOLED *pOLED, uint8_t ucData, int bRender);
@@ -254,14 +271,10 @@ class COLED {
   int ScaledString (SSOLED *pOLED, int x, int y, char *szMsg, int iSize, int bInvert, int iXScale, int iYScale, int iRotation);
 
  private:
-  //! For drawing ellipses, a circle is drawn and the x and y pixels are scaled by a 16-bit integer fraction
-  // This function draws a single pixel and scales its position based on the x/y fraction of the ellipse
-  void DrawScaledPixel (SSOLED *pOLED, int iCX, int iCY, int x, int y, int32_t iXFrac, int32_t iYFrac, uint8_t ucColor);
-  //! For drawing filled ellipses
-  void DrawScaledLine (SSOLED *pOLED, int iCX, int iCY, int x, int y, int32_t iXFrac, int32_t iYFrac, uint8_t ucColor);
-  //! Draw the 8 pixels around the Bresenham circle
-  // (scaled to make an ellipse)
-  void BresenhamCircle (SSOLED *pOLED, int iCX, int iCY, int x, int y, int32_t iXFrac, int32_t iYFrac, uint8_t ucColor, uint8_t bFill);
+  //! Set or clear a vertical run of pixels in one column
+  // Whole bytes are written per page, only the end pages are masked
+  // The column must be on the screen, the rows are clipped
+  void oledVSpan (SSOLED *pOLED, int x, int y1, int y2, uint8_t ucColor);
 
  public:
   //! Draw an outline or filled ellipse
@@ -284,3 +297,51 @@ public:
   void puts (SSOLED *pOLED, char *s);
   int printf (SSOLED *pOLED, const char *fmt, ...);
 };
+
+/*!
+ @brief Background refresh of COLED.
+ @note
+   The application draws into the back buffer of SSOLED with bRender = 0 and calls present().
+   present() copies the changed blocks into the front buffer owned by this class, and the
+   refresh task sends them at the frame rate, so the drawing task never waits for I2C.
+   A frame presented while the previous one is being sent is not accepted; the changes stay
+   marked in the back buffer and go with the next frame.
+ @attention
+   FreeRTOS scheduler must be running to use this class.
+ */
+class COLEDRefresh {
+  COLED *pDisp;
+  COLED::SSOLED *pOLED;
+  COLED::SSOLED front;      // copy of SSOLED with the front buffer and its dirty blocks
+
+  volatile bool copying;    // present() is updating the front buffer
+  volatile bool sending;    // the task is sending the front buffer
+  volatile bool ready;      // a frame waits to be sent
+  uint32_t frames;
+  uint32_t skipped;
+  uint16_t period;          // frame period [ms]
+
+  xTaskHandle refresh_task_handle;
+  bool kill_refresh_task;
+
+  void refresh_task (void);
+
+ public:
+
+  //! disp, oled:display to be refreshed (begin() must have been done)
+  COLEDRefresh (COLED *disp, COLED::SSOLED *oled);
+  ~COLEDRefresh();
+
+  //! Start refresh task (fps:maximum frame rate, prio:task priority)
+  bool begin (uint8_t fps = 30, UBaseType_t prio = 1);
+  //! Stop refresh task.
+  void end (void);
+
+  //! Hand the changes in the back buffer to the refresh task (false:busy, try again later)
+  bool present (void);
+
+  //! Number of frames sent
+  uint32_t get_frames (void);
+  //! Number of present() not accepted
+  uint32_t get_skipped (void);
+};
@@ -43,6 +43,11 @@
 
 #include  <vector>
 
+// Flash record log of CParamStore
+#include  "ud5_paramlog.h"
+#include  "ud5_i2cregmap.h"
+#include  "ud5_mahony.h"
+
 //=======================================================================
 // Macro definitions and other functions
 //=======================================================================
@@ -84,6 +89,12 @@ inline void sys_reset (void) {
 //! Excite dispatch
 void _my_csw (void);
 
+//! Counts per microsecond of the free running MRT channel 3 (32 MHz)
+const uint32_t _USTICK = (32000000UL / 1000000UL);
+
+//! GPIO terminal 0...9 to PIO0 number (same order as CGPIO)
+const uint8_t _term_pio[10] = { 14, 23, 22, 21, 20, 19, 18, 17, 13, 4 };
+
 //=======================================================================
 // WAIT
 //=======================================================================
@@ -96,7 +107,6 @@ void _my_csw (void);
    Can be used with or without FreeRTOS.
  */
 class CWait {
-  const uint32_t _USTICK = (32000000UL / 1000000UL);
   const uint32_t _MSTICK = (32000000UL / 1000UL);
 
   void (*csw) (void);
@@ -144,6 +154,72 @@ inline void UD5_LOWPOWERMODE (void) {
   __WFI();
 }
 
+//=======================================================================
+// DMA
+//=======================================================================
+/*!
+ @brief DMA channel and descriptor allocator.
+ @note
+   Drivers claim the channels they use and take linked descriptors from a shared pool,
+   so conflicts are detected at initialization instead of corrupting transfers.
+   DMA_IRQHandler dispatches INTA/INTB/error of each channel to the handler of its owner.
+ */
+class CDMA {
+ public:
+  //! Number of linked descriptors in the pool
+  static const uint8_t _DESC_POOL = 16;
+
+  //! Interrupt flags given to the handler
+  enum {
+    fINTA   = 1,  //!< interrupt A
+    fINTB   = 2,  //!< interrupt B
+    fERROR  = 4,  //!< transfer error
+  };
+
+  //! DMA channel handler
+  //  ch:channel, flags:fINTA/fINTB/fERROR, arg:argument given at registration
+  typedef void (*TDMAHandler) (uint8_t ch, uint8_t flags, void *arg);
+
+ private:
+  static const void *ch_owner[MAX_DMA_CHANNEL];
+  static TDMAHandler ch_handler[MAX_DMA_CHANNEL];
+  static void *ch_arg[MAX_DMA_CHANNEL];
+  static uint32_t conflict;
+
+  static DMA_CHDESC_T desc_pool[_DESC_POOL];
+  static const void *desc_owner[_DESC_POOL];
+
+ public:
+  //! Enable DMA controller (only once)
+  static void init (void);
+
+  //! Claim channel for owner (false:owned by another)
+  static bool claim (uint8_t ch, const void *owner);
+  //! Release channel of owner
+  static void release (uint8_t ch, const void *owner);
+  //! Owner of channel (NULL:free)
+  static const void *get_owner (uint8_t ch);
+  //! Channels whose claim has failed
+  static uint32_t get_conflict (void);
+
+  //! Set interrupt handler of owned channel (NULL:none)
+  static bool set_handler (uint8_t ch, const void *owner, TDMAHandler h, void *arg = NULL);
+
+  //! Allocate n consecutive linked descriptors (16-byte aligned, NULL:not enough)
+  static DMA_CHDESC_T *alloc_desc (uint8_t n, const void *owner);
+  //! Free all descriptors of owner
+  static void free_desc (const void *owner);
+
+  //! Append a segment of 8-bit transfers to descriptor chain d (split by 1024 transfers)
+  //  max:size of chain, n:number of descriptors used, cfg:xfercfg without XFERCOUNT, src/dst:start address
+  static bool chain_add (DMA_CHDESC_T *d, uint8_t max, uint8_t *n, uint32_t cfg, uint32_t src, uint32_t dst, uint32_t len);
+  //! Link n descriptors of chain d and add lastcfg (e.g. DMA_XFERCFG_SETINTA) to the last one
+  static void chain_link (DMA_CHDESC_T *d, uint8_t n, uint32_t lastcfg);
+
+  //! Dispatch pending interrupts (called from DMA_IRQHandler, or polled while interrupts are disabled)
+  static void dispatch (void);
+};
+
 //=======================================================================
 // UART
 //=======================================================================
@@ -277,6 +353,94 @@ class CDXIF {
   void no_csw (void);
 };
 
+/*!
+ @brief Generic UART class for USART2/3/4 with DMA ring buffers.
+ @note
+   TX/RX are assigned to GPIO terminals by the switch matrix (do not use them in CGPIO).
+   Reception runs on a circular DMA descriptor, so there is no interrupt per byte.
+   The end of a frame is detected by the idle time of the receive line.
+ */
+class CUART {
+ public:
+
+  //! Frame format (CFG register of USART)
+  enum {
+    fmt8N1    = UART_CFG_DATALEN_8 | UART_CFG_PARITY_NONE | UART_CFG_STOPLEN_1,
+    fmt8E1    = UART_CFG_DATALEN_8 | UART_CFG_PARITY_EVEN | UART_CFG_STOPLEN_1,
+    fmt8E2    = UART_CFG_DATALEN_8 | UART_CFG_PARITY_EVEN | UART_CFG_STOPLEN_2,
+    fmtRXINV  = UART_CFG_RXPOL,   //!< inverted RX (e.g. SBUS)
+    fmtTXINV  = UART_CFG_TXPOL,   //!< inverted TX
+  };
+
+ private:
+
+  LPC_USART_T *_usart;
+  uint8_t _dma_tx, _dma_rx;
+  bool init = false;
+
+  // Receive ring written by DMA
+  uint8_t *prxbuff;
+  uint16_t _rx_size;                // power of 2
+  DMA_CHDESC_T *_rx_desc;           // links to itself
+  volatile uint32_t _rx_laps;       // number of wraps (INTA once per lap)
+  uint32_t _rx_tail;                // total bytes read
+  uint32_t _rx_seen;                // total bytes written at the last poll
+  uint32_t _rx_tick;                // time of the last reception (32 MHz count-up)
+  uint32_t _rx_overrun;             // bytes lost by overrun
+
+  // Transmit ring read by DMA
+  uint8_t *ptxbuff;
+  uint16_t _tx_size;                // power of 2
+  volatile uint32_t _tx_head;       // total bytes written
+  volatile uint32_t _tx_tail;       // total bytes sent
+  volatile uint16_t _tx_busy;       // bytes in DMA transfer
+
+  // Total bytes written by DMA
+  uint32_t rx_total (void);
+
+  // Start DMA of the contiguous part of transmit ring
+  void tx_start (void);
+
+  // DMA completion (CDMA handler)
+  static void dma_done (uint8_t ch, uint8_t flags, void *arg);
+
+ public:
+
+  //! n:USART 2...4, tx/rx:GPIO terminal (0...9, -1:not used), fmt:fmt8N1 etc.
+  //  txb/rxb:buffer size (rounded up to a power of 2, up to 1024)
+  CUART (uint8_t n, int8_t tx, int8_t rx, uint32_t baud, uint32_t fmt = fmt8N1, uint16_t txb = 64, uint16_t rxb = 256);
+  ~CUART();
+
+  //! Number of unsent data bytes
+  uint16_t txbuff (void);
+  //! Number of data bytes received
+  uint16_t rxbuff (void);
+  //! Clear transmit buffer.
+  void clear_txbuff (void);
+  //! Clear Received data.
+  void clear_rxbuff (void);
+  //! Send 1 byte of characters.
+  void putc (char c);
+  //! Send string.
+  void puts (const char *s);
+  //! Send specified number of bytes of data.
+  int putsb (const uint8_t *s, int n);
+  //! Retrieve one character from the receive data buffer (-1:none).
+  int getc (void);
+  //! Receive up to n bytes of data.
+  uint16_t getsb (uint8_t *s, uint16_t n);
+  //! Send format conversion strings
+  int printf (const char *format, ...);
+
+  //! Time since the last byte was received [us]
+  uint32_t idle_time (void);
+  //! Wait until data has been received and the line has been idle for gap_us (0:timeout)
+  //  Returns the number of bytes of the frame.
+  uint16_t wait_idle (uint32_t gap_us, uint32_t timeout_ms);
+  //! Number of bytes lost because the receive buffer was full
+  uint32_t get_overrun (void);
+};
+
 //=======================================================================
 // GPIO
 //=======================================================================
@@ -335,19 +499,64 @@ class CGPIO {
   uint32_t pwd[8], pwdup[8];
   uint32_t pulse_update_cnt;
 
+  // Pulse width plausibility window, glitch filter and signal loss detection
+  uint32_t pwd_min[8], pwd_max[8], pwd_timeout[8];  // [tick] (pwd_min >= pwd_max:window disabled, pwd_timeout=0:no timeout)
+  uint32_t pwd_hist[8][3];                          // last 3 accepted widths for median
+  uint8_t pwd_hist_ind[8];
+  uint32_t pwd_tick[8];                             // timestamp of the last accepted pulse
+  volatile bool pwd_alive[8];
+  uint32_t pwd_glitch[8];                           // number of rejected pulses
+
   // GPIO No. for pulse width measurement
   uint8_t previous_mpw_gpiono[8];
 
-  uint8_t enc_phase_pin[2][2]; // [ch][phase]
-  int32_t enc_counter[2];
+  // 2-phase encoder decoding state (updated only by PININT)
+  typedef struct {
+    uint8_t           phase_pin[2]; // GPIO No. of phase A/B (bit position in the port)
+    uint8_t           state;        // previous phase (bit 3..2) and current phase (bit 1..0)
+    int8_t            table[16];    // direction table with polarity folded in
+    volatile int32_t  counter;      // raw counter (wraps)
+    volatile uint32_t error;        // illegal transitions (both phases changed at once)
+  } TEncoder;
+  TEncoder enc[2];
+
   int32_t enc_offset[2];
   bool enc_polrev[2];
-  int8_t enc_ind[2];
-  const int8_t enc_dirtable[16] = { 0, 1, -1, 0, -1, 0, 0, 1, 1, 0, 0, -1, 0, -1, 1, 0 };
+  // Wrap tracking for 64-bit position
+  int32_t enc_last[2];
+  int64_t enc_position[2], enc_position_offset[2];
 
-  uint8_t pinint_interruptor[8];
+  static const int8_t enc_dirtable[16];
 
-  inline uint8_t enc_phase (uint8_t ch);
+  // Rebuild decoding table and current phase of encoder ch
+  void enc_setup (uint8_t ch);
+  // Extend raw counter to 64 bits
+  int64_t enc_extend (uint8_t ch);
+
+ public:
+
+  //! PININT edge handler
+  //  ch  :PININT channel (0...7)
+  //  tick:Edge timestamp (32 MHz count-up, wraps at 31 bits)
+  //  arg :Argument given at registration
+  typedef void (*TPinIntHandler) (uint8_t ch, uint32_t tick, void *arg);
+
+ private:
+
+  // PININT dispatch table (shared by all instances because it is referenced directly from the IRQ handlers)
+  typedef struct {
+    TPinIntHandler  handler;
+    void            *arg;
+  } TPinIntEntry;
+  static TPinIntEntry pinint_table[8];
+
+  // Built-in edge handlers
+  static void pinint_nop (uint8_t ch, uint32_t tick, void *arg);
+  static void pinint_mpw (uint8_t ch, uint32_t tick, void *arg);
+  static void pinint_enc (uint8_t ch, uint32_t tick, void *arg);
+
+  // Assign a GPIO to PININTn for both edges and install the handler
+  void pinint_setup (uint8_t n, uint8_t gpio_no, TPinIntHandler h, void *arg);
 
  public:
 
@@ -403,6 +612,14 @@ class CGPIO {
     tPinINT5_ENC1B, ///< PININT5 input (2 Phase Encoder 1 B)
     tPinINT6_ENC1B, ///< PININT6 input (2 Phase Encoder 1 B)
     tPinINT7_ENC1B, ///< PININT7 input (2 Phase Encoder 1 B)
+    tPinINT0_EDGE,  ///< PININT0 input (User edge handler)
+    tPinINT1_EDGE,  ///< PININT1 input (User edge handler)
+    tPinINT2_EDGE,  ///< PININT2 input (User edge handler)
+    tPinINT3_EDGE,  ///< PININT3 input (User edge handler)
+    tPinINT4_EDGE,  ///< PININT4 input (User edge handler)
+    tPinINT5_EDGE,  ///< PININT5 input (User edge handler)
+    tPinINT6_EDGE,  ///< PININT6 input (User edge handler)
+    tPinINT7_EDGE,  ///< PININT7 input (User edge handler)
 
     tPinSPISEL, tPinSPISCK, tPinSPIMISO, tPinSPIMOSI,
     tPinSPFUNC
@@ -415,8 +632,16 @@ class CGPIO {
 
   ~CGPIO();
 
-  //! PININT interrupt callback
-  void PIN_INT_cb (uint8_t ch);
+  //! PININT interrupt dispatch (called from PIN_INTn_IRQHandler)
+  static inline void PIN_INT_dispatch (uint8_t ch) {
+    uint32_t t = 0x7fffffffUL - LPC_MRT_CH3->TIMER; // Latch the edge time first (assuming MRT has already started)
+    Chip_PININT_ClearIntStatus (LPC_PININT, 1 << ch);
+    pinint_table[ch].handler (ch, t, pinint_table[ch].arg);
+  }
+
+  //! Attach your own edge handler to PININTn (ch: 0...7, NULL to detach)
+  //  Used together with tPinINTn_EDGE. It can also replace the built-in pulse width/encoder processing.
+  void set_pinint_handler (uint8_t ch, TPinIntHandler h, void *arg = NULL);
 
   //! GPIO function setting
   void set_config (uint8_t adch, TPinMode pm);
@@ -434,10 +659,35 @@ class CGPIO {
 
   uint32_t get_pulse_update_cnt (void);
 
+  //! Set plausibility window and signal loss timeout of pulse width measurement (ch: 0...7)
+  //  Pulses outside min_us...max_us are discarded and the rest pass a 3-sample median filter.
+  //  When no valid pulse arrives for timeout_us, get_pwd returns 0 and get_pwd_alive returns false.
+  //  min_us = max_us = 0 disables the window and filter, timeout_us = 0 disables the timeout.
+  void set_pwd_filter (uint8_t ch, uint32_t min_us, uint32_t max_us, uint32_t timeout_us);
+
+  //! Check if the pulse is being received (ch: 0...7)
+  bool get_pwd_alive (uint8_t ch);
+
+  //! Get elapsed time since the last accepted pulse in microseconds (ch: 0...7)
+  uint32_t get_pwd_age (uint8_t ch);
+
+  //! Get number of pulses rejected by the plausibility window (ch: 0...7)
+  uint32_t get_pwd_glitch (uint8_t ch);
+
   int32_t get_ENC_rawcounter (uint8_t ch);
 
   int32_t get_encoder_count (uint8_t ch);
 
+  //! Get encoder position since reset_encoder_count without 32-bit wrap-around
+  //! @note Call at least once every 2^31 counts.
+  int64_t get_encoder_position (uint8_t ch);
+
+  //! Get number of illegal phase transitions (missed edges)
+  uint32_t get_encoder_error (uint8_t ch);
+
+  //! Reverse the counting direction of the encoder
+  void set_encoder_reverse (uint8_t ch, bool rev);
+
   void reset_encoder_count (uint8_t ch);
 };
 
@@ -464,25 +714,98 @@ class CEXIO {
   };
 
   const uint8_t _PCAL9722_addr = (0x40 >> 1);
-  uint8_t _txb[20], _rxb[20];
-  uint32_t _txbuflast;
+
+ public:
+
+  typedef enum {
+    tPinDIN,      ///< Input (Hi-Z)
+    tPinDIN_PU,   ///< Input (Pull Up)
+    tPinDIN_PD,   ///< Input (Pull Down)
+    tPinDOUT      ///< Output (Push Pull)
+  } TPinMode;
+
+ private:
+
+  uint32_t _txbuflast;       // last byte with control for TXDATCTL
+  const uint8_t _tx_fill = 0xff;  // transmitted when txd is NULL
+  uint8_t _rx_discard;       // received when rxd is NULL
 
   uint8_t _LED_stat;
 
+  // Shadow of PCAL9722 registers for port 0 and 1
+  uint16_t _r_cfg;  // configuration (0x0c)
+  uint16_t _r_pe;   // pull-up/pull-down enable (0x4c)
+  uint16_t _r_pud;  // pull-up/pull-down selection (0x50)
+  uint16_t _r_out;  // output port (0x04)
+
+  // Deferred output
+  bool _deferred;                     // LED and output writes only update shadow
+  volatile uint8_t _dirty;            // bit0:output port, bit1:LED
+  volatile uint32_t _pending_upd;     // updates not sent yet
+  uint32_t _coalesced;                // updates merged into other transfers
+  uint32_t _flush_period;             // [ms] (0:commit only)
+  xTaskHandle _flush_task_handle;
+  bool _kill_flush_task;
+
+  // Periodic flush of deferred outputs
+  void flush_task (void);
+
   const TSPIConf _spi1_conf = { LPC_SPI1, SPIMode0, SPIBitMSBF, 5000000, 8, SPICSLow };
   SemaphoreHandle_t _mutex;
 
-  // Two DMA descriptors for SPI1 transmission are required here.
-  // Therefore, forcing the use of channels provided for other peripherals.
-  const int _DMAREQ_TX0 = DMA_CH14;
-  const int _DMAREQ_TX1 = DMA_CH15;
+  // Chained DMA descriptors for SPI1 (taken from CDMA)
+  // A descriptor moves up to 1024 bytes, and the last byte is sent to TXDATCTL to have SSEL deasserted.
+  //  TX:command, data x _SG_CHUNKS, last byte
+  //  RX:command (discarded), data x _SG_CHUNKS
+  static const uint8_t _SG_CHUNKS = 2;
+  DMA_CHDESC_T *_tx_sg, *_rx_sg;
+  bool _dma_ready;  // both SPI1 channels and the descriptors are owned
 
   void init_SPI1 (void);
 
-  // SPI1 send/receive with DMA
+ public:
+
+  //! Maximum number of data bytes of a SPI1 transaction
+  static const uint16_t SPI_MAX_LEN = _SG_CHUNKS * 1024;
+
+  //! SPI1 transaction
+  //  Queued and finished by the DMA completion interrupt.
+  //  cmd is sent first, then txd and rxd are transferred directly by DMA (no copy).
+  //  txd and rxd must stay valid until done.
+  typedef struct TSPITrans {
+    const uint8_t *txd;                           //!< transmit data (NULL:0xff)
+    uint8_t *rxd;                                 //!< receive data after cmd (NULL:discard)
+    uint16_t len;                                 //!< number of data bytes (0...SPI_MAX_LEN)
+    void (*cb) (struct TSPITrans *t, void *arg);  //!< called from ISR on completion (NULL:notify task)
+    void *arg;                                    //!< argument of cb
+    TaskHandle_t task;                            //!< task notified on completion
+    volatile bool done;                           //!< completed
+    struct TSPITrans *next;
+    uint8_t cmd[4];                               //!< command bytes sent before data (e.g. device and register address)
+    uint8_t cmdlen;                               //!< number of command bytes
+  } TSPITrans;
+
+ private:
+
+  TSPITrans *volatile _q_head;
+  TSPITrans *_q_tail;
+
+  // Start DMA of the transaction
+  void start_SPI1 (TSPITrans *t);
+
+  // Receive DMA completion (CDMA handler)
+  static void dma_done (uint8_t ch, uint8_t flags, void *arg);
+
+  // Finish the transaction at the head of queue
+  void spi1_done (void);
+
+  // Run the transaction and wait for it (blocks the caller only)
+  bool run_SPI1 (TSPITrans *t);
+
+  // SPI1 send/receive with DMA (blocks the caller only)
   // 8 bits wide regardless of spiconf.dataw
   //-----------------------------
-  bool readwrite_SPI1 (const TSPIConf *SPIConf, const uint8_t *txd, uint8_t *rxd, uint16_t datalen);
+  bool readwrite_SPI1 (const uint8_t *txd, uint8_t *rxd, uint16_t datalen);
   // PCAL9722 register write
   uint16_t PCAL_reg_write (uint8_t adr, const uint8_t *dat, uint16_t size);
 
@@ -492,16 +815,47 @@ class CEXIO {
   // For LED GPIOs only
   bool PCAL_LED_Write (uint8_t mode, uint8_t b);
 
+  // Read registers into shadow
+  void PCAL_shadow_load (void);
+
+  // Write only the configuration registers that differ from shadow
+  void PCAL_config_write (uint16_t r_c, uint16_t r_pe, uint16_t r_pud);
+
+  // Apply pin mode to configuration register values
+  void PCAL_config_make (uint8_t ch, TPinMode pm, uint16_t *r_c, uint16_t *r_pe, uint16_t *r_pud);
+
  public:
 
-  static CEXIO *anchor;
+  //! Input change event
+  typedef struct {
+    uint32_t tick;    //!< time of INT edge (32 MHz count-up, wraps at 31 bits)
+    uint16_t status;  //!< pins that changed (interrupt status)
+    uint16_t input;   //!< input port
+  } TChangeEvent;
 
-  typedef enum {
-    tPinDIN,      ///< Input (Hi-Z)
-    tPinDIN_PU,   ///< Input (Pull Up)
-    tPinDIN_PD,   ///< Input (Pull Down)
-    tPinDOUT      ///< Output (Push Pull)
-  } TPinMode;
+ private:
+
+  // Input change detection
+  CGPIO *_int_gpio;                 // CGPIO wired to INT (NULL:not used)
+  uint8_t _int_adch;                // its terminal
+  uint8_t _int_ch;                  // its PININT channel
+  QueueHandle_t _int_queue;         // events
+  volatile bool _int_busy, _int_pending;
+  volatile uint32_t _int_tick;      // edge being read
+  uint8_t _int_rxb[2][2];
+  TSPITrans _int_t[2];              // reading of interrupt status and input port
+  volatile uint16_t _in_last;       // input port read at the last INT
+
+  // INT edge (PININT handler)
+  static void int_edge (uint8_t ch, uint32_t tick, void *arg);
+  // Interrupt status and input port have been read
+  static void int_done (TSPITrans *t, void *arg);
+  // Queue reading of interrupt status and input port
+  void int_read (void);
+
+ public:
+
+  static CEXIO *anchor;
 
   CEXIO();
 
@@ -511,6 +865,12 @@ class CEXIO {
   ~CEXIO();
   void no_csw (void);
 
+  //! Queue SPI1 transaction (returns immediately)
+  bool submit (TSPITrans *t);
+
+  //! Wait for completion of the transaction submitted with task set
+  void wait (TSPITrans *t);
+
   //! Flicker for all LEDs.
   void set_LED (uint8_t b);
 
@@ -525,11 +885,158 @@ class CEXIO {
 
   //! GPIO function setting.
   bool set_config (uint8_t ch, TPinMode pm);
+
+  //! GPIO function setting for all terminals at once (only changed registers are written)
+  bool set_config (const TPinMode cfg[16]);
+
   //! Digital input.
+  //  While input change detection is enabled, returns the input port read at the last INT without SPI access.
   uint16_t get_gpio (void);
 
   //! Digital output.
   bool set_gpio (uint16_t out);
+
+  //! Deferred output mode
+  //  LED and output writes only update the shadow, and the merged state is sent in one transfer.
+  //  ms:flush period by internal task (0:only by commit)
+  void set_deferred (bool on, uint32_t ms = 1);
+
+  //! Send deferred LED and output state now
+  bool commit (void);
+
+  //! Number of LED and output updates merged into other transfers
+  uint32_t get_coalesced (void);
+
+  //! Detect input changes by the INT output of PCAL9722 instead of polling
+  //  msk :pins to watch (latched and unmasked, 0:disable)
+  //  g   :CGPIO with the terminal wired to INT (GP21 of Pmod I/F pin 11)
+  //  adch:its terminal (0...9), ch:PININT channel used for it (0...7), depth:number of events kept
+  bool set_change_detect (uint16_t msk, CGPIO *g = NULL, uint8_t adch = 0, uint8_t ch = 0, uint8_t depth = 8);
+
+  //! Get input change event (ms:maximum waiting time)
+  bool get_change_event (TChangeEvent *ev, uint32_t ms = 0);
+};
+
+//=======================================================================
+// SPI
+//=======================================================================
+/*!
+ @brief SPI0 master class for devices on the GPIO terminals.
+ @note
+   Assign SCK, MOSI, MISO (and SSEL) to terminals with CGPIO::set_config beforehand.
+   Transfers are queued, moved by DMA in full duplex and finished by the receive completion interrupt.
+ */
+class CSPI {
+  // Chained DMA descriptors (taken from CDMA)
+  //  TX:data x _SG_CHUNKS, last byte to TXDATCTL
+  //  RX:data x _SG_CHUNKS
+  static const uint8_t _SG_CHUNKS = 2;
+
+ public:
+  //! Maximum number of bytes of a transfer
+  static const uint16_t MAX_LEN = _SG_CHUNKS * 1024;
+
+  //! Device on the bus
+  typedef struct {
+    TSPIMode mode;      //!< clock polarity and phase
+    TSPIBit bitorder;   //!< bit order
+    uint32_t clock;     //!< clock frequency [Hz]
+    TSPICS cs;          //!< active level of chip select
+    int8_t cs_pio;      //!< PIO0 number of chip select driven by software (-1:SSEL0 assigned with tPinSPISEL)
+  } TDevice;
+
+  //! Transfer
+  //  Data is 8 bits wide. txd and rxd must stay valid until done.
+  typedef struct TXfer {
+    const TDevice *dev;                         //!< device
+    const uint8_t *txd;                         //!< transmit data (NULL:0xff)
+    uint8_t *rxd;                               //!< receive data (NULL:discard)
+    uint16_t len;                               //!< number of bytes (1...MAX_LEN)
+    bool keep_cs;                               //!< leave chip select asserted for the next transfer
+    void (*cb) (struct TXfer *t, void *arg);    //!< called from ISR on completion (NULL:notify task)
+    void *arg;                                  //!< argument of cb
+    TaskHandle_t task;                          //!< task notified on completion
+    volatile bool done;                         //!< completed
+    struct TXfer *next;
+  } TXfer;
+
+ private:
+  DMA_CHDESC_T *_tx_sg, *_rx_sg;
+  bool _dma_ready;                  // both SPI0 channels and the descriptors are owned
+  uint32_t _txbuflast;              // last byte with control for TXDATCTL
+  const uint8_t _tx_fill = 0xff;    // transmitted when txd is NULL
+  uint8_t _rx_discard;              // received when rxd is NULL
+
+  // Register values of a device, made outside the ISR so that starting a transfer only writes them
+  typedef struct {
+    const TDevice *dev;
+    uint32_t cfg;                   // CFG
+    uint32_t div;                   // DIV
+    uint32_t ssel;                  // TXSSEL of TXCTRL and TXDATCTL (all deasserted for cs_pio)
+  } TDevReg;
+  static const uint8_t _MAX_DEV = 4;
+  TDevReg _devreg[_MAX_DEV];
+  volatile uint8_t _num_dev;
+  const TDevReg *_cur_dev;          // device SPI0 is configured for
+
+  TXfer *volatile _q_head;
+  TXfer *_q_tail;
+
+  // Bus lock (nested by the owner task)
+  SemaphoreHandle_t _mutex;
+  TaskHandle_t _lock_owner;
+  uint8_t _lock_nest;
+
+  // Find or make the register values of the device, and set up software chip select (NULL:too many devices)
+  const TDevReg *find_dev (const TDevice *dev);
+
+  // Configure SPI0 for the device
+  void apply (const TDevReg *r);
+
+  // Drive chip select by software
+  void cs_write (const TDevice *dev, bool on);
+
+  // Start DMA of the transfer
+  void start (TXfer *t);
+
+  // Receive DMA completion (CDMA handler)
+  static void dma_done (uint8_t ch, uint8_t flags, void *arg);
+
+  // Finish the transfer at the head of queue
+  void xfer_done (void);
+
+ public:
+
+  static CSPI *anchor;
+
+  CSPI();
+
+  ~CSPI();
+
+  //! Register the device and prepare its chip select (deasserted, false:too many devices)
+  //  Devices not attached are registered by their first submit, which also prepares the chip select.
+  //  Attach in advance to keep the chip select deasserted before the first transfer.
+  bool attach (const TDevice *dev);
+
+  //! Take the bus (nestable, to keep other tasks out of a sequence of transfers)
+  void lock_sem (void);
+  //! Give the bus.
+  void unlock_sem (void);
+
+  //! Queue transfer (returns immediately)
+  bool submit (TXfer *t);
+
+  //! Wait for completion of the transfer submitted with task set
+  void wait (TXfer *t);
+
+  //! Full duplex transfer (blocks the caller only)
+  bool transfer (const TDevice *dev, const uint8_t *txd, uint8_t *rxd, uint16_t len, bool keep_cs = false);
+
+  //! Transmission only
+  bool write (const TDevice *dev, const uint8_t *txd, uint16_t len, bool keep_cs = false);
+
+  //! Reception only (0xff is sent)
+  bool read (const TDevice *dev, uint8_t *rxd, uint16_t len, bool keep_cs = false);
 };
 
 //=======================================================================
@@ -620,6 +1127,10 @@ class CMotor {
  @brief Arduino-like I2C class.
  @note
    It was created to flow the numerous resources for Arduino.
+   Transfers are queued as transactions and run by the I2C interrupt.
+   begin/write/read/end are thin transactions that hold the bus between calls.
+   Each byte is guarded by the hardware timeout sized to the bus speed, and a bus
+   held low by a device is freed by toggling SCL.
  */
 class CI2C {
   const uint8_t _SCL = 10;
@@ -630,33 +1141,90 @@ class CI2C {
     { _SDA, PIO_TYPE_FIXED, SWM_FIXED_I2C0_SDA, PIO_MODE_DEFAULT },
   };
 
-  const uint32_t FLAG_TIMEOUT = 100;
-  const uint32_t LONG_TIMEOUT = 1000;
+  // Interrupts used by the master
+  const uint32_t _MSTINT = I2C_INTENSET_MSTPENDING | I2C_INTENSET_MSTRARBLOSS | I2C_INTENSET_MSTSTSTPERR | I2C_INTENSET_EVENTTIMEOUT | I2C_INTENSET_SCLTIMEOUT;
 
+  // Bus lock (nested by the owner task)
   SemaphoreHandle_t _mutex;
+  TaskHandle_t _lock_owner;
+  uint8_t _lock_nest;
 
-  void (*csw) (void);
+ public:
 
-  inline uint8_t i2c_get_stat (void);
+  typedef enum {
+    IIC_Sm,   //!< Standard-mode 100k
+    IIC_Fm,   //!< Fast-mode 400k
+    IIC_Fmp,  //!< Fast-mode Plus 1M
+  } TIICMode;
 
-  bool i2c_wait_SI (LPC_I2C_T *I2Cx);
+  //! Result of transaction
+  typedef enum {
+    IIC_OK,         //!< completed
+    IIC_NACK_ADDR,  //!< address not acknowledged
+    IIC_NACK_DATA,  //!< data not acknowledged
+    IIC_ARBLOSS,    //!< arbitration lost
+    IIC_BUSERR,     //!< start/stop error
+    IIC_TIMEOUT,    //!< not completed in time
+    IIC_PARAM,      //!< invalid transaction
+    IIC_STUCK,      //!< bus held low and not recovered
+  } TIICResult;
+
+  //! Transaction flags
+  enum {
+    fREAD     = 1,  //!< address for reading even if there is nothing to read
+    fNOSTART  = 2,  //!< continue on the bus held by the previous transaction
+    fNOSTOP   = 4,  //!< hold the bus after the last byte
+  };
 
-  bool i2c_wait_stat (LPC_I2C_T *I2Cx);
+  //! Transaction
+  //  cmd and txd are written, then rxd is read after repeated start.
+  //  The buffers must stay valid until done.
+  typedef struct TI2CTrans {
+    uint8_t addr;                                 //!< 7-bit address
+    uint8_t flags;                                //!< fREAD/fNOSTART/fNOSTOP
+    uint8_t cmd[4];                               //!< written first (e.g. register address)
+    uint8_t cmdlen;                               //!< number of cmd bytes
+    const uint8_t *txd;                           //!< write data
+    uint16_t txlen;                               //!< number of write bytes
+    uint8_t *rxd;                                 //!< read data
+    uint16_t rxlen;                               //!< number of read bytes
+    void (*cb) (struct TI2CTrans *t, void *arg);  //!< called from ISR on completion (NULL:notify task)
+    void *arg;                                    //!< argument of cb
+    TaskHandle_t task;                            //!< task notified on completion
+    volatile uint8_t result;                      //!< TIICResult
+    volatile uint16_t count;                      //!< bytes acknowledged or received
+    volatile bool done;                           //!< completed
+    struct TI2CTrans *next;
+  } TI2CTrans;
 
-  bool i2c_read (LPC_I2C_T *I2Cx, void *dat, bool fin);
+ private:
 
+  TI2CTrans *volatile _q_head;
+  TI2CTrans *_q_tail;
+  volatile bool _stopping;  // STOP issued, waiting for idle
+  uint16_t _pos;            // bytes written or read in the transaction
+  uint8_t _err;             // result to be reported after STOP
+  uint8_t _last;            // result of the last run
+  volatile bool _recovering;
 
-  int i2c_write (LPC_I2C_T *I2Cx, int value, uint8_t addr);
+  uint32_t _freq;           // bus speed [Hz]
+  uint32_t _byte_us;        // byte timeout [us]
+
+  // Start the transaction at the head of queue
+  void start (void);
 
-  inline void i2c_genestart (LPC_I2C_T *I2Cx);
+  // STOP unless the bus is held
+  void stop_or_hold (TI2CTrans *t);
+
+  // Finish the transaction at the head of queue
+  void finish (uint8_t result);
+
+  // Remove transaction from queue
+  bool cancel (TI2CTrans *t);
 
  public:
 
-  typedef enum {
-    IIC_Sm,   //!< Standard-mode 100k
-    IIC_Fm,   //!< Fast-mode 400k
-    IIC_Fmp,  //!< Fast-mode Plus 1M
-  } TIICMode;
+  static CI2C *anchor;
 
   CI2C (TIICMode m);
 
@@ -667,9 +1235,42 @@ class CI2C {
   //! Give semaphore.
   void unlock_sem (void);
 
-  //! Set clock frequency
+  //! Set clock frequency (the byte timeout is set to 4 byte times)
   bool set_freq (TIICMode m);
 
+  //! Set byte timeout [us] (longer for devices that stretch the clock)
+  //  The bus must not stay without events, or SCL low, for longer than this.
+  void set_timeout (uint32_t byte_us);
+
+  //! Timeout of the transaction [us]
+  uint32_t timeout_us (const TI2CTrans *t);
+
+  //! Free the bus held low by a device (SCL toggled up to 9 times followed by STOP)
+  bool recover (void);
+
+  //! Queue transaction (returns immediately)
+  bool submit (TI2CTrans *t);
+
+  //! Wait for completion of the transaction submitted with task set (false:timeout)
+  //  The time is counted from the start of the transaction on the bus.
+  bool wait (TI2CTrans *t, uint32_t us);
+
+  //! Run transaction and wait for it (blocks the caller only)
+  //  The bus is recovered after a timeout or bus error.
+  uint8_t run (TI2CTrans *t);
+
+  //! TIICResult of the last run (including begin/write/read/end/ping)
+  uint8_t get_result (void) { return _last; }
+
+  //! State machine (called from I2C0_IRQHandler, or polled while interrupts are disabled)
+  void isr (void);
+
+  //! Write register address, then read len bytes after repeated start (TIICResult)
+  uint8_t read_reg (uint8_t addr, uint8_t reg, void *buf, uint16_t len);
+
+  //! Write register address followed by len bytes (TIICResult)
+  uint8_t write_reg (uint8_t addr, uint8_t reg, const void *data, uint16_t len);
+
   //! Join the I2C bus.
   bool begin (uint8_t addr, bool read = false);
 
@@ -687,6 +1288,344 @@ class CI2C {
   bool ping (uint8_t addr);
 };
 
+/*!
+ @brief Periodic I2C register polling class.
+ @note
+   Reads the registers listed in a table at their own periods from one task.
+   The reads due in the same tick are queued together, so CI2C runs them back to back.
+   Each result is published with a timestamp, and skipped periods and bus utilisation are counted.
+ @attention
+   FreeRTOS scheduler must be running to use this class.
+ */
+class CI2CPoll {
+ public:
+  //! Polling entry
+  typedef struct {
+    uint8_t addr;       //!< 7-bit address
+    uint8_t reg;        //!< first register
+    uint16_t len;       //!< number of bytes to read
+    uint16_t period;    //!< polling period [ms]
+    uint8_t *dest;      //!< destination buffer (len bytes)
+  } TPollEntry;
+
+  //! Entry status
+  typedef struct {
+    uint32_t tick;      //!< elapsed time at completion [ms]
+    uint32_t stamp;     //!< MRT timestamp at completion [1/32us]
+    uint32_t count;     //!< number of successful reads
+    uint32_t errors;    //!< number of failed reads
+    uint32_t misses;    //!< number of periods skipped
+    uint8_t result;     //!< TIICResult of the last read
+  } TPollStatus;
+
+ private:
+  // Per entry
+  typedef struct {
+    CI2C::TI2CTrans t;      // must be the first member (done casts it back)
+    uint8_t *rxd;           // staging buffer
+    uint32_t due;           // next release [ms]
+    uint32_t late;          // periods skipped before this release
+    bool released;          // in the current batch
+    TPollStatus st;
+    volatile uint32_t seq;  // odd while dest and st are updated
+  } TPollWork;
+
+  CI2C *pI2C;
+  const TPollEntry *table;
+  uint8_t num;
+  TPollWork *work;
+  uint8_t *staging;
+
+  volatile uint8_t pending;   // reads left in the current batch
+  uint32_t busy_start;        // MRT timestamp at batch release
+  volatile uint32_t busy_us;  // bus busy time since get_utilisation
+  uint32_t window_tick;       // elapsed time at get_utilisation [ms]
+
+  xTaskHandle poll_task_handle;
+  bool kill_poll_task;
+
+  // Copy the result to dest and update the status
+  void publish (TPollWork *w, uint8_t result, uint32_t stamp);
+
+  // Completion of each read (called from I2C0 interrupt)
+  static void done (CI2C::TI2CTrans *t, void *arg);
+
+  // Poll cycle
+  void poll_task (void);
+
+ public:
+
+  //! i2c:bus, tbl:polling table (kept by the caller), n:number of entries
+  CI2CPoll (CI2C *i2c, const TPollEntry *tbl, uint8_t n);
+  ~CI2CPoll();
+
+  //! Start poll task.
+  void begin (void);
+  //! Stop poll task.
+  void end (void);
+
+  //! Get the latest data and status of entry i (lock free from tasks, buf:len bytes or NULL)
+  bool get (uint8_t i, void *buf, TPollStatus *st = NULL);
+
+  //! Bus utilisation since the previous call [0.1%]
+  uint16_t get_utilisation (void);
+};
+
+/*!
+ @brief I2C target (slave) class with a register map.
+ @note
+   SCL/SDA are assigned to GPIO terminals by the switch matrix (do not use them in CGPIO).
+   The register map protocol is handled by CI2CRegMap in the slave interrupt.
+ */
+class CI2CTarget : public CI2CRegMap {
+ private:
+  LPC_I2C_T *_i2c;
+  IRQn_Type _irq;
+  uint8_t _n;
+
+ public:
+  static CI2CTarget *anchor[3];
+
+  //! n:I2C 1...3, scl/sda:GPIO terminal (0...9), addr:7-bit address
+  //  map:register map of size bytes (up to 256), registers wr_first...wr_first+wr_len-1 are writable
+  CI2CTarget (uint8_t n, int8_t scl, int8_t sda, uint8_t addr, uint8_t *map, uint16_t size, uint16_t wr_first = 0, uint16_t wr_len = 0);
+  ~CI2CTarget();
+
+  //! Attach handler of writes from the master (NULL to detach)
+  void set_handler (TWriteHandler h, void *arg = NULL);
+
+  //! Update registers (atomic against the master)
+  void set (uint8_t reg, const void *data, uint16_t len);
+  //! Read registers (atomic against the master)
+  void get (uint8_t reg, void *buf, uint16_t len);
+
+  //! State machine (called from I2Cn_IRQHandler)
+  void isr (void);
+};
+
+//=======================================================================
+// IMU
+//=======================================================================
+/*!
+ @brief LSM6DS3TR-C + LIS3MDL IMU class.
+ @note
+   Accelerometer and gyroscope samples are stored in the FIFO of LSM6DS3TR-C and
+   drained in bursts by its own task, so no sample is lost to task scheduling.
+   INT1 (FIFO threshold) wakes the task through PININT, and the edge time is used to
+   timestamp each sample. Without INT1 the FIFO is polled every 1ms.
+   The latest magnetometer data is attached to each sample.
+ @attention
+   FreeRTOS scheduler must be running to use this class.
+ */
+class CIMU {
+ public:
+  //! Output data rate of accelerometer and gyroscope
+  typedef enum {
+    ODR_104 = 4,    //!< 104Hz
+    ODR_208 = 5,    //!< 208Hz
+    ODR_416 = 6,    //!< 416Hz
+    ODR_833 = 7,    //!< 833Hz
+    ODR_1660 = 8,   //!< 1.66kHz
+  } TODR;
+
+  //! Accelerometer full scale
+  typedef enum {
+    XL_2G = 0,      //!< 0.061mg/LSB
+    XL_16G = 1,     //!< 0.488mg/LSB
+    XL_4G = 2,      //!< 0.122mg/LSB
+    XL_8G = 3,      //!< 0.244mg/LSB
+  } TAccFS;
+
+  //! Gyroscope full scale
+  typedef enum {
+    G_250DPS = 0,   //!< 8.75mdps/LSB
+    G_500DPS = 1,   //!< 17.5mdps/LSB
+    G_1000DPS = 2,  //!< 35mdps/LSB
+    G_2000DPS = 3,  //!< 70mdps/LSB
+  } TGyroFS;
+
+  //! Sample
+  typedef struct {
+    uint32_t stamp;     //!< MRT timestamp [1/32us]
+    int16_t gyro[3];    //!< angular rate (raw)
+    int16_t acc[3];     //!< acceleration (raw)
+    int16_t mag[3];     //!< latest magnetic field (raw, 6842LSB/gauss)
+  } TIMUSample;
+
+ private:
+  const uint8_t ADDR_LSM6 = 0x6a;
+  const uint8_t ADDR_LIS3 = 0x1c;
+  static const uint8_t CHUNK = 16;    // samples per burst
+
+  CI2C *pI2C;
+  CGPIO *pGpio;
+  int8_t _int_term;                 // INT1 terminal (-1:polled)
+  uint8_t _int_ch;                  // PININT channel
+
+  uint32_t _period;                 // sample period [1/32us]
+  uint16_t _thr;                    // FIFO threshold [samples]
+  volatile uint32_t _edge_stamp;    // INT1 rising edge
+  volatile bool _edge;
+
+  bool _has_mag;                    // LIS3MDL found
+  int16_t _mag[3];
+  uint32_t _mag_tick;
+  uint8_t _buf[CHUNK * 12];
+
+  // Ring of samples
+  TIMUSample *_ring;
+  uint16_t _ring_size;
+  volatile uint32_t _head;          // total samples written
+  volatile uint32_t _tail;          // total samples read
+  uint32_t _lost;                   // samples dropped because the ring was full
+  uint32_t _overrun;                // FIFO overruns
+
+  xTaskHandle imu_task_handle;
+  bool kill_imu_task;
+
+  // INT1 rising edge (PININT handler)
+  static void int1 (uint8_t ch, uint32_t tick, void *arg);
+
+  // Write a register
+  uint8_t write1 (uint8_t addr, uint8_t reg, uint8_t val);
+
+  // Drain the FIFO into the ring
+  void drain (void);
+
+  // Sampling cycle
+  void imu_task (void);
+
+ public:
+
+  //! i2c:bus, gpio/int_term/int_ch:INT1 of LSM6DS3TR-C on GPIO terminal with PININT (NULL:polled)
+  //  ring:number of samples buffered
+  CIMU (CI2C *i2c, CGPIO *gpio = NULL, int8_t int_term = -1, uint8_t int_ch = 0, uint16_t ring = 64);
+  ~CIMU();
+
+  //! Check devices, configure them and start sampling (thr:FIFO threshold [samples])
+  bool begin (TODR odr = ODR_833, TAccFS afs = XL_16G, TGyroFS gfs = G_2000DPS, uint16_t thr = 8);
+  //! Stop sampling.
+  void end (void);
+
+  //! Number of samples buffered
+  uint16_t available (void);
+  //! Get the oldest sample (false:none)
+  bool get (TIMUSample *s);
+  //! Number of samples lost (ring full or FIFO overrun)
+  uint32_t get_lost (void);
+};
+
+/*!
+ @brief Attitude estimator for CIMU samples.
+ @note
+   CMahony with the gyro scale of CIMU, reads that are atomic against the updating task
+   and the duration of each update measured by MRT.
+ */
+class CAHRS : public CMahony {
+  uint32_t _exec;       // duration of the last update [1/32us]
+
+ public:
+
+  //! gfs:gyro full scale, rate:sample rate [Hz]
+  CAHRS (CIMU::TGyroFS gfs = CIMU::G_2000DPS, uint16_t rate = 833);
+
+  //! Update with one sample (raw values, mag:NULL or all zero for 6 axis)
+  void update (const int16_t gyro[3], const int16_t acc[3], const int16_t mag[3] = NULL);
+  void update (const CIMU::TIMUSample *s);
+
+  //! Roll, pitch and heading [0.01deg]
+  int32_t get_roll (void);
+  int32_t get_pitch (void);
+  int32_t get_heading (void);
+  //! Roll, pitch and heading at once [0.01deg]
+  void get_euler (int32_t *roll, int32_t *pitch, int32_t *heading);
+  //! Quaternion w, x, y, z (Q30)
+  void get_quaternion (int32_t q[4]);
+  //! Duration of the last update [1/32us]
+  uint32_t get_exec_time (void);
+};
+
+//=======================================================================
+// Seesaw
+//=======================================================================
+/*!
+ @brief Adafruit Seesaw device class (GPIO, encoder and NeoPixel).
+ @note
+   Reading a Seesaw register needs a delay between writing the register address and
+   reading the data. The bus is released during the delay, so other bus users are not blocked.
+   read_multi() writes the addresses of several devices back to back, waits once and reads
+   them back to back, so the delay is shared by the whole batch.
+ */
+class CSeesaw {
+ public:
+  //! Pin mode
+  typedef enum {
+    SS_INPUT,
+    SS_OUTPUT,
+    SS_INPUT_PULLUP,
+    SS_INPUT_PULLDOWN,
+  } TPinMode;
+
+  //! Batched read entry
+  typedef struct {
+    CSeesaw *dev;       //!< device (all devices must be on the same bus)
+    uint8_t base;       //!< module base address
+    uint8_t reg;        //!< register
+    void *buf;          //!< destination
+    uint8_t len;        //!< number of bytes to read
+    uint8_t result;     //!< CI2C::TIICResult
+    CI2C::TI2CTrans t;  //!< work area
+  } TRead;
+
+ private:
+  CI2C *pI2C;
+  uint8_t _addr;
+  uint16_t _delay;      // delay between register address and data [us]
+  uint16_t _pixels;     // number of NeoPixels
+
+ public:
+
+  //! i2c:bus, addr:7-bit address, delay:read delay [us]
+  CSeesaw (CI2C *i2c, uint8_t addr = 0x36, uint16_t delay = 250);
+
+  //! Reset the device and check the hardware ID.
+  bool begin (void);
+
+  //! Hardware ID (0:no response)
+  uint8_t get_hwid (void);
+  //! Product code and date code
+  uint32_t get_version (void);
+
+  //! Write a register (CI2C::TIICResult)
+  uint8_t write (uint8_t base, uint8_t reg, const void *data = NULL, uint8_t len = 0);
+  //! Read a register (CI2C::TIICResult)
+  uint8_t read (uint8_t base, uint8_t reg, void *buf, uint8_t len);
+  //! Read registers of several devices at once (false:any entry failed)
+  //  Entries for the same device are read in turn.
+  static bool read_multi (TRead *list, uint8_t n);
+
+  //! Set mode of the pins in the bit mask
+  bool pin_mode_bulk (uint32_t pins, TPinMode mode);
+  //! Set level of the output pins in the bit mask
+  bool digital_write_bulk (uint32_t pins, bool level);
+  //! Level of all pins masked by pins
+  uint32_t digital_read_bulk (uint32_t pins = 0xffffffffUL);
+
+  //! Encoder position
+  int32_t get_position (uint8_t enc = 0);
+  //! Encoder change since the last read
+  int32_t get_delta (uint8_t enc = 0);
+  //! Set encoder position
+  bool set_position (int32_t pos, uint8_t enc = 0);
+
+  //! Set up NeoPixel (pin:Seesaw pin, num:number of pixels)
+  bool pixel_begin (uint8_t pin, uint16_t num);
+  //! Set color of pixel n in the buffer
+  bool set_pixel (uint16_t n, uint8_t r, uint8_t g, uint8_t b);
+  //! Output the buffer to the pixels
+  bool show_pixel (void);
+};
+
 //=======================================================================
 // PCM Audio player
 //=======================================================================
@@ -754,6 +1693,49 @@ struct CPCM {
   void mrt_cb (void);
 };
 
+//=======================================================================
+// Parameter store
+//=======================================================================
+/*!
+ @brief Wear-levelled key/value parameter store on flash.
+ @note
+   CParamLog on the flash of LPC845, programmed by IAP and guarded by a mutex.
+   The default region 0xf400-0xfbff is the .paramstore section. The sample makefile places it at 0xf400
+   and leaves it out of the binary, so the linker reports an overlap when the program grows into it.
+ */
+class CParamStore : public CParamLog {
+ public:
+  //! Sectors of the default region (.paramstore, its address is given by the linker)
+  static const uint8_t _REGION_SECTORS = 2;
+
+  //! Flash access by IAP of LPC845
+  static const TFlashIF flash_iap;
+
+ private:
+  SemaphoreHandle_t _mutex;
+
+  void lock (void);
+  void unlock (void);
+
+ public:
+  static CParamStore *anchor;
+
+  //! addr:top of region (sector aligned, 0:the reserved region), sec:number of sectors (2 or more), f:flash access (NULL:IAP)
+  CParamStore (uint32_t addr = 0, uint8_t sec = _REGION_SECTORS, const TFlashIF *f = NULL);
+  ~CParamStore ();
+
+  //! Read data of key up to size bytes (false:not stored)
+  bool read (uint16_t key, void *dat, uint16_t size);
+  //! Write data of key (the previous data stays valid until the new record is complete)
+  bool write (uint16_t key, const void *dat, uint16_t size);
+  //! Remove key
+  bool remove (uint16_t key);
+  //! Size of data of key (-1:not stored)
+  int32_t size_of (uint16_t key);
+  //! Erase all records
+  void format (void);
+};
+
 //=======================================================================
 // Radio Controlled receiver
 //=======================================================================
@@ -763,10 +1745,16 @@ struct CPCM {
    Use CGPIO class pulse width measurement.
  */
 class CRCStick {
-  // NVM address
+  // NVM address written by older versions (read only when the parameter store has no calibration)
   const uint32_t _EEPROM_ADDR = 0xfc00;
 
+  // Acceptable pulse width and signal loss timeout [us]
+  const uint32_t _PULSE_MIN = 800;
+  const uint32_t _PULSE_MAX = 2200;
+  const uint32_t _PULSE_TIMEOUT = 25000;
+
   CGPIO *cgpio;
+  CParamStore *nvm;  // NULL:raw data at _EEPROM_ADDR
 
  public:
 
@@ -782,10 +1770,20 @@ class CRCStick {
 
   Tcaldata caldata;
 
-  // Interpolation
-  int32_t _INTERP (int32_t xi, int32_t xj, int32_t yi, int32_t yj, int32_t x);
+  // Normalization parameters for 1ch (made from caldata and deadband)
+  typedef struct {
+    int32_t   x0, x1, x3, x4; // pulse width at -1000, lower end of neutral, upper end of neutral, 1000
+    int32_t   k_lo, k_hi;     // 1000 / (x1 - x0), 1000 / (x4 - x3) in Q16
+    uint32_t  key;            // deadband used to make this (per_neu | per_ul << 8)
+  } TNormParam;
+  TNormParam norm[8];
+  volatile uint32_t norm_seq[8];  // sequence counter for lock-free reading
+
+  // Make normalization parameters
+  void make_norm (uint8_t ch, uint32_t key, TNormParam *p);
 
-  int interp1dim (const int32_t x, const int32_t *ar, const int32_t w);
+  // Discard all normalization parameters
+  void clear_norm (void);
 
   // moving mean
   void movingmean (int32_t *ave, int32_t dat, int32_t num);
@@ -801,7 +1799,9 @@ class CRCStick {
 
  public:
 
-  CRCStick (CGPIO *g);
+  //! g:pulse width measurement, p:store of the calibration (NULL:CParamStore::anchor, or the old NVM address if there is none)
+  //  No store is created here, so nothing is erased before main.
+  CRCStick (CGPIO *g, CParamStore *p = NULL);
 
   //! Calibration
   //  f_nextstep:Trigger to advance the operation under calibration to the next step
@@ -811,7 +1811,11 @@ class CRCStick {
   void get_calibration (Tcaldata *pcal);
 
   //! Normalize pulses to -1000...1000 (per_new: neutral, per_ul: % of deadband to measured full scale at both ends)
-  int32_t get_normal (uint8_t ch, int32_t per_neu, int32_t per_ul);
+  //  Returns 0 (neutral) while the signal is lost, and reports it with failsafe if given.
+  int32_t get_normal (uint8_t ch, int32_t per_neu, int32_t per_ul, bool *failsafe = NULL);
+
+  //! Check if the signal of ch is lost
+  bool get_failsafe (uint8_t ch);
 };
 
 //=======================================================================
@@ -930,6 +1934,63 @@ class CSpeedControl {
   int32_t get_counter (uint8_t ch, int n);
 };
 
+//=======================================================================
+// I/O scanner
+//=======================================================================
+/*!
+ @brief Periodic I/O scanner class.
+ @note
+   Samples CGPIO, CEXIO, ADC and encoder counts in its own task and publishes them as one snapshot.
+   The snapshot is double buffered with a sequence counter, so any task or ISR can read
+   the latest state without locking or bus access.
+ @attention
+   FreeRTOS scheduler must be running to use this class.
+ */
+class CIOScan {
+ public:
+  //! I/O snapshot
+  typedef struct {
+    uint32_t tick;      //!< elapsed time at sampling [ms]
+    uint32_t count;     //!< number of scans
+    uint16_t gpio;      //!< CGPIO digital input
+    uint16_t exio;      //!< CEXIO digital input
+    uint16_t adc[10];   //!< CGPIO ADC results (terminals in adc_mask only)
+    int32_t enc[2];     //!< encoder counts
+  } TIOSnapshot;
+
+ private:
+  CGPIO *pGpio;
+  CEXIO *pExio;
+  uint16_t adc_mask;
+  uint32_t period;
+
+  TIOSnapshot snap[2];
+  volatile uint32_t seq;  // snap[seq & 1] is stable
+
+  xTaskHandle scan_task_handle;
+  bool kill_scan_task;
+
+  // Scan cycle
+  void scan_task (void);
+
+ public:
+
+  //! g, e:sources (NULL:not sampled), adcmsk:ADC terminals to sample, ms:scan period [ms]
+  CIOScan (CGPIO *g, CEXIO *e = NULL, uint16_t adcmsk = 0, uint32_t ms = 1);
+  ~CIOScan();
+
+  //! Start scan task.
+  void begin (void);
+  //! Stop scan task.
+  void end (void);
+
+  //! Set scan period [ms].
+  void set_period (uint32_t ms);
+
+  //! Get the latest snapshot (lock free, also from ISR).
+  void get (TIOSnapshot *s);
+};
+
 
 
 //=======================================================================
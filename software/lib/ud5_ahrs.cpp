@@ -0,0 +1,89 @@
+/*!
+  @file    ud5_ahrs.cpp
+  @version 0.9981
+  @brief   Collection of classes for UD5 control
+  @date    2024/9/29
+  @author  T.Uemitsu
+
+  @copyright
+    Copyright (c) BestTechnology CO.,LTD. 2024
+    All rights reserved.
+
+  @par
+   The software is designed to use the minimum number of
+   functions provided by UD5.
+   Although it should be provided in the form of a library,
+   it is provided in the form of a header file in order to
+   lay aside the complexity of its introduction.
+ */
+
+#include "ud5.h"
+
+// gyro sensitivity [rad/s/LSB] in Q24 (250, 500, 1000, 2000dps)
+static const int32_t gyro_scale[4] = { 2562, 5124, 10249, 20497 };
+
+//=======================================================================
+// AHRS
+//=======================================================================
+/*!
+ @brief Attitude estimator for CIMU samples.
+ @note
+   CMahony with the gyro scale of CIMU, reads that are atomic against the updating task
+   and the duration of each update measured by MRT.
+ */
+CAHRS::CAHRS (CIMU::TGyroFS gfs, uint16_t rate) : CMahony (gyro_scale[gfs & 3], rate) {
+  _exec = 0;
+}
+
+// Update with one sample
+void CAHRS::update (const CIMU::TIMUSample *s) {
+  update (s->gyro, s->acc, s->mag);
+}
+
+// Update with raw values
+void CAHRS::update (const int16_t gyro[3], const int16_t acc[3], const int16_t mag[3]) {
+  uint32_t t0 = 0x7fffffffUL - LPC_MRT_CH3->TIMER;
+  CMahony::update (gyro, acc, mag);
+  _exec = ((0x7fffffffUL - LPC_MRT_CH3->TIMER) - t0) & 0x7fffffffUL;
+}
+
+// Roll [0.01deg]
+int32_t CAHRS::get_roll (void) {
+  int32_t r;
+  get_euler (&r, NULL, NULL);
+  return r;
+}
+
+// Pitch [0.01deg]
+int32_t CAHRS::get_pitch (void) {
+  int32_t p;
+  get_euler (NULL, &p, NULL);
+  return p;
+}
+
+// Heading [0.01deg] (0 to 35999)
+int32_t CAHRS::get_heading (void) {
+  int32_t h;
+  get_euler (NULL, NULL, &h);
+  return h;
+}
+
+// Roll, pitch and heading at once [0.01deg]
+void CAHRS::get_euler (int32_t *roll, int32_t *pitch, int32_t *heading) {
+  int32_t q[4];
+  get_quaternion (q);
+  to_euler (q, roll, pitch, heading);
+}
+
+// Quaternion w, x, y, z (Q30)
+void CAHRS::get_quaternion (int32_t q[4]) {
+  uint32_t primask = __get_PRIMASK();
+  __disable_irq();
+  for (int i = 0; i < 4; i++) q[i] = _q[i];
+  __set_PRIMASK (primask);
+}
+
+// Duration of the last update [1/32us]
+uint32_t CAHRS::get_exec_time (void) {
+  return _exec;
+}
@@ -0,0 +1,175 @@
+/*!
+  @file    ud5_dma.cpp
+  @version 0.9981
+  @brief   Collection of classes for UD5 control
+  @date    2024/9/29
+  @author  T.Uemitsu
+
+  @copyright
+    Copyright (c) BestTechnology CO.,LTD. 2024
+    All rights reserved.
+
+  @par
+   The software is designed to use the minimum number of
+   functions provided by UD5.
+   Although it should be provided in the form of a library,
+   it is provided in the form of a header file in order to
+   lay aside the complexity of its introduction.
+ */
+
+#include "ud5.h"
+
+//=======================================================================
+// DMA
+//=======================================================================
+/*!
+ @brief DMA channel and descriptor allocator.
+ @note
+   Drivers claim the channels they use and take linked descriptors from a shared pool,
+   so conflicts are detected at initialization instead of corrupting transfers.
+   DMA_IRQHandler dispatches INTA/INTB/error of each channel to the handler of its owner.
+ */
+const void *CDMA::ch_owner[MAX_DMA_CHANNEL] = { NULL };
+CDMA::TDMAHandler CDMA::ch_handler[MAX_DMA_CHANNEL] = { NULL };
+void *CDMA::ch_arg[MAX_DMA_CHANNEL] = { NULL };
+uint32_t CDMA::conflict = 0;
+
+DMA_CHDESC_T CDMA::desc_pool[_DESC_POOL] __attribute__ ((aligned (16)));
+const void *CDMA::desc_owner[_DESC_POOL] = { NULL };
+
+//! Enable DMA controller (only once)
+void CDMA::init (void) {
+  // DMA reinitialization suppression
+  if (! (LPC_DMA->CTRL & DMA_CTRL_ENABLE)) {
+    Chip_DMA_DeInit (LPC_DMA);
+    Chip_DMA_Init (LPC_DMA);
+    Chip_DMA_Enable (LPC_DMA);
+  }
+  NVIC_EnableIRQ (DMA_IRQn);
+}
+
+//! Claim channel for owner (false:owned by another)
+bool CDMA::claim (uint8_t ch, const void *owner) {
+  if ((ch >= MAX_DMA_CHANNEL) || (owner == NULL)) return false;
+  bool result = false;
+  uint32_t primask = __get_PRIMASK();
+  __disable_irq();
+  if ((ch_owner[ch] == NULL) || (ch_owner[ch] == owner)) {
+    ch_owner[ch] = owner;
+    result = true;
+  } else conflict |= 1UL << ch;
+  __set_PRIMASK (primask);
+  return result;
+}
+
+//! Release channel of owner
+void CDMA::release (uint8_t ch, const void *owner) {
+  if ((ch >= MAX_DMA_CHANNEL) || (ch_owner[ch] != owner)) return;
+  uint32_t primask = __get_PRIMASK();
+  __disable_irq();
+  Chip_DMA_DisableIntChannel (LPC_DMA, ch);
+  ch_handler[ch] = NULL;
+  ch_arg[ch] = NULL;
+  ch_owner[ch] = NULL;
+  __set_PRIMASK (primask);
+}
+
+//! Owner of channel (NULL:free)
+const void *CDMA::get_owner (uint8_t ch) {
+  return (ch < MAX_DMA_CHANNEL) ? ch_owner[ch] : NULL;
+}
+
+//! Channels whose claim has failed
+uint32_t CDMA::get_conflict (void) {
+  return conflict;
+}
+
+//! Set interrupt handler of owned channel (NULL:none)
+bool CDMA::set_handler (uint8_t ch, const void *owner, TDMAHandler h, void *arg) {
+  if ((ch >= MAX_DMA_CHANNEL) || (ch_owner[ch] != owner)) return false;
+  uint32_t primask = __get_PRIMASK();
+  __disable_irq();
+  ch_handler[ch] = h;
+  ch_arg[ch] = arg;
+  if (h != NULL) Chip_DMA_EnableIntChannel (LPC_DMA, ch);
+  else Chip_DMA_DisableIntChannel (LPC_DMA, ch);
+  __set_PRIMASK (primask);
+  return true;
+}
+
+//! Allocate n consecutive linked descriptors (16-byte aligned, NULL:not enough)
+DMA_CHDESC_T *CDMA::alloc_desc (uint8_t n, const void *owner) {
+  DMA_CHDESC_T *result = NULL;
+  if ((n == 0) || (owner == NULL)) return NULL;
+  uint32_t primask = __get_PRIMASK();
+  __disable_irq();
+  for (int i = 0, len = 0; i < _DESC_POOL; i++) {
+    len = (desc_owner[i] == NULL) ? len + 1 : 0;
+    if (len == n) {
+      for (int j = i + 1 - n; j <= i; j++) desc_owner[j] = owner;
+      result = &desc_pool[i + 1 - n];
+      break;
+    }
+  }
+  __set_PRIMASK (primask);
+  return result;
+}
+
+//! Free all descriptors of owner
+void CDMA::free_desc (const void *owner) {
+  uint32_t primask = __get_PRIMASK();
+  __disable_irq();
+  for (int i = 0; i < _DESC_POOL; i++) if (desc_owner[i] == owner) desc_owner[i] = NULL;
+  __set_PRIMASK (primask);
+}
+
+//! Append a segment of 8-bit transfers to descriptor chain d (split by 1024 transfers)
+bool CDMA::chain_add (DMA_CHDESC_T *d, uint8_t max, uint8_t *n, uint32_t cfg, uint32_t src, uint32_t dst, uint32_t len) {
+  while (len > 0) {
+    if (*n >= max) return false;
+    uint32_t c = MIN (len, 1024);
+    // Addresses are those of the last transfer
+    d[*n].xfercfg = cfg | DMA_XFERCFG_XFERCOUNT (c);
+    d[*n].source = (cfg & DMA_XFERCFG_SRCINC_1) ? src + c - 1 : src;
+    d[*n].dest = (cfg & DMA_XFERCFG_DSTINC_1) ? dst + c - 1 : dst;
+    if (cfg & DMA_XFERCFG_SRCINC_1) src += c;
+    if (cfg & DMA_XFERCFG_DSTINC_1) dst += c;
+    len -= c;
+    (*n)++;
+  }
+  return true;
+}
+
+//! Link n descriptors of chain d and add lastcfg (e.g. DMA_XFERCFG_SETINTA) to the last one
+void CDMA::chain_link (DMA_CHDESC_T *d, uint8_t n, uint32_t lastcfg) {
+  for (uint8_t i = 0; i < n; i++) {
+    d[i].next = (i + 1 < n) ? DMA_ADDR (&d[i + 1]) : DMA_ADDR (0);
+    d[i].xfercfg |= (i + 1 < n) ? DMA_XFERCFG_RELOAD : lastcfg;
+  }
+}
+
+//! Dispatch pending interrupts (called from DMA_IRQHandler, or polled while interrupts are disabled)
+void CDMA::dispatch (void) {
+  uint32_t ia = Chip_DMA_GetActiveIntAChannels (LPC_DMA);
+  uint32_t ib = Chip_DMA_GetActiveIntBChannels (LPC_DMA);
+  uint32_t ie = Chip_DMA_GetErrorIntChannels (LPC_DMA);
+  uint32_t act = ia | ib | ie;
+
+  for (uint8_t ch = 0; act != 0; ch++, act >>= 1) {
+    if ((act & 1) == 0) continue;
+    uint32_t msk = 1UL << ch;
+    uint8_t flags = ((ia & msk) ? fINTA : 0) | ((ib & msk) ? fINTB : 0) | ((ie & msk) ? fERROR : 0);
+    if (flags & fINTA) Chip_DMA_ClearActiveIntAChannel (LPC_DMA, ch);
+    if (flags & fINTB) Chip_DMA_ClearActiveIntBChannel (LPC_DMA, ch);
+    if (flags & fERROR) Chip_DMA_ClearErrorIntChannel (LPC_DMA, ch);
+    if (ch_handler[ch] != NULL) ch_handler[ch] (ch, flags, ch_arg[ch]);
+  }
+}
+
+// DMA interrupt routine
+//-----------------------------------
+//! Interrupt handler for DMA
+//! @note Call from CDMA.
+extern "C" void DMA_IRQHandler (void) {
+  CDMA::dispatch();
+}
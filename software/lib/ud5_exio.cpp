@@ -34,133 +34,193 @@ void CEXIO::init_SPI1 (void) {
   SPI_Init (&_spi1_conf);
   SPI_csw = _my_csw;
 
-  // DMA reinitialization suppression
-  if (! (LPC_DMA->CTRL & DMA_CTRL_ENABLE)) {
-    Chip_DMA_DeInit (LPC_DMA);
-    Chip_DMA_Init (LPC_DMA);
-    Chip_DMA_Enable (LPC_DMA);
-  }
+  CDMA::init();
+  _tx_sg = CDMA::alloc_desc (_SG_CHUNKS + 2, this);
+  _rx_sg = CDMA::alloc_desc (_SG_CHUNKS + 1, this);
+  _dma_ready = CDMA::claim (DMAREQ_SPI1_TX, this) && CDMA::claim (DMAREQ_SPI1_RX, this) && (_tx_sg != NULL) && (_rx_sg != NULL);
+  if (!_dma_ready) return;
 
-  // DMA transmit send configuration (use 2 descripotr just to have SSEL sent out automatically)
+  // DMA transmit send configuration (data via TXDAT, the last byte via TXDATCTL to have SSEL sent out automatically)
   Chip_DMA_DisableChannel (LPC_DMA, DMAREQ_SPI1_TX);
   Chip_DMA_EnableChannel (LPC_DMA, DMAREQ_SPI1_TX);
   Chip_DMA_DisableIntChannel (LPC_DMA, DMAREQ_SPI1_TX);
   Chip_DMA_SetupChannelConfig (LPC_DMA, DMAREQ_SPI1_TX, (DMA_CFG_PERIPHREQEN | DMA_CFG_TRIGBURST_SNGL | DMA_CFG_CHPRIORITY (3)));
-  // Data except the last byte is sent using TXDAT
-  Chip_DMA_Table[_DMAREQ_TX0].dest = DMA_ADDR (&_spi1_conf.SPIx->TXDAT);
-  Chip_DMA_Table[_DMAREQ_TX0].next = DMA_ADDR (&Chip_DMA_Table[_DMAREQ_TX1]); // 次のdescriptorへのリンク
-  // Last byte sent with flags using TXDATCTL
-  Chip_DMA_Table[_DMAREQ_TX1].source = DMA_ADDR (&_txbuflast);
-  Chip_DMA_Table[_DMAREQ_TX1].dest = DMA_ADDR (&_spi1_conf.SPIx->TXDATCTL);
-  Chip_DMA_Table[_DMAREQ_TX1].next = DMA_ADDR (0);
 
   // DMA receive configuration
   Chip_DMA_DisableChannel (LPC_DMA, DMAREQ_SPI1_RX);
   Chip_DMA_EnableChannel (LPC_DMA, DMAREQ_SPI1_RX);
   Chip_DMA_DisableIntChannel (LPC_DMA, DMAREQ_SPI1_RX);
   Chip_DMA_SetupChannelConfig (LPC_DMA, DMAREQ_SPI1_RX, (DMA_CFG_PERIPHREQEN | DMA_CFG_TRIGBURST_SNGL | DMA_CFG_CHPRIORITY (3)));
-  Chip_DMA_Table[DMAREQ_SPI1_RX].next = DMA_ADDR (0);
+
+  // Transactions are finished by the receive completion interrupt
+  _q_head = _q_tail = NULL;
+  CDMA::set_handler (DMAREQ_SPI1_RX, this, dma_done, this);
 }
 
-// SPI1 send/receive with DMA
+// Start DMA of the transaction
 // 8 bits wide regardless of spiconf.dataw
 //-----------------------------
-bool CEXIO::readwrite_SPI1 (const TSPIConf *SPIConf, const uint8_t *txd, uint8_t *rxd, uint16_t datalen) {
-  if (datalen > sizeof (_txb)) return false;
-
-  // Copy transmit data to buffer
-  __aeabi_memcpy4 (_txb, txd, datalen);
-
-  // SPI initial condition setting
-  Chip_SPI_ClearStatus (SPIConf->SPIx, SPI_STAT_CLR_RXOV | SPI_STAT_CLR_TXUR | SPI_STAT_CLR_SSA | SPI_STAT_CLR_SSD);
-  SPIConf->SPIx->TXCTRL =
-    SPI_TXCTL_ASSERT_SSEL |   // Assert SSEL
-    SPI_TXCTL_FLEN (8 - 1);   // Bit width of transmitted data -1
-
-  // Receive settings
-  Chip_DMA_Table[DMAREQ_SPI1_RX].xfercfg =
-    DMA_XFERCFG_CFGVALID |
-    DMA_XFERCFG_WIDTH_8 |
-    DMA_XFERCFG_SRCINC_0 |
-    DMA_XFERCFG_DSTINC_1 |
-    DMA_XFERCFG_RELOAD |
-    DMA_XFERCFG_XFERCOUNT (datalen);
-  Chip_DMA_Table[DMAREQ_SPI1_RX].source = DMA_ADDR (&SPIConf->SPIx->RXDAT);
-  Chip_DMA_Table[DMAREQ_SPI1_RX].dest = DMA_ADDR (_rxb) + datalen - 1;
-
-  Chip_DMA_SetupTranChannel (LPC_DMA, DMAREQ_SPI1_RX, (DMA_CHDESC_T *)&Chip_DMA_Table[DMAREQ_SPI1_RX]);
-  Chip_DMA_SetupChannelTransfer (LPC_DMA, DMAREQ_SPI1_RX, Chip_DMA_Table[DMAREQ_SPI1_RX].xfercfg);
-  Chip_DMA_SetValidChannel (LPC_DMA, DMAREQ_SPI1_RX);
-  Chip_DMA_SWTriggerChannel (LPC_DMA, DMAREQ_SPI1_RX);
-
-  // Transmission settings excluding the last byte
-  Chip_DMA_Table[_DMAREQ_TX0].xfercfg =
-    DMA_XFERCFG_CFGVALID |
-    DMA_XFERCFG_SWTRIG |
-    DMA_XFERCFG_WIDTH_8 |
-    DMA_XFERCFG_SRCINC_1 |
-    DMA_XFERCFG_DSTINC_0 |
-    DMA_XFERCFG_RELOAD |
-    DMA_XFERCFG_XFERCOUNT (datalen - 1);
-  Chip_DMA_Table[_DMAREQ_TX0].source = DMA_ADDR (_txb) + datalen - 1 - 1;
+void CEXIO::start_SPI1 (TSPITrans *t) {
+  uint16_t total = t->cmdlen + t->len;
+  uint8_t ntx = 0, nrx = 0;
+  uint32_t txd = (t->txd != NULL) ? DMA_ADDR (t->txd) : DMA_ADDR (&_tx_fill);
+  uint32_t rxd = (t->rxd != NULL) ? DMA_ADDR (t->rxd) : DMA_ADDR (&_rx_discard);
+  uint32_t txinc = (t->txd != NULL) ? DMA_XFERCFG_SRCINC_1 : DMA_XFERCFG_SRCINC_0;
+  uint32_t rxinc = (t->rxd != NULL) ? DMA_XFERCFG_DSTINC_1 : DMA_XFERCFG_DSTINC_0;
+  uint32_t txcfg = DMA_XFERCFG_CFGVALID | DMA_XFERCFG_SWTRIG | DMA_XFERCFG_WIDTH_8 | DMA_XFERCFG_DSTINC_0;
+  uint32_t rxcfg = DMA_XFERCFG_CFGVALID | DMA_XFERCFG_WIDTH_8 | DMA_XFERCFG_SRCINC_0;
+  uint32_t txdat = DMA_ADDR (&_spi1_conf.SPIx->TXDAT), rxdat = DMA_ADDR (&_spi1_conf.SPIx->RXDAT);
+  uint8_t last;
+
+  // Receive chain (command phase is discarded)
+  CDMA::chain_add (_rx_sg, _SG_CHUNKS + 1, &nrx, rxcfg | DMA_XFERCFG_DSTINC_0, rxdat, DMA_ADDR (&_rx_discard), t->cmdlen);
+  CDMA::chain_add (_rx_sg, _SG_CHUNKS + 1, &nrx, rxcfg | rxinc, rxdat, rxd, t->len);
+
+  // Transmit chain excluding the last byte
+  if (t->len > 0) {
+    CDMA::chain_add (_tx_sg, _SG_CHUNKS + 2, &ntx, txcfg | DMA_XFERCFG_SRCINC_1, DMA_ADDR (t->cmd), txdat, t->cmdlen);
+    CDMA::chain_add (_tx_sg, _SG_CHUNKS + 2, &ntx, txcfg | txinc, txd, txdat, t->len - 1);
+    last = (t->txd != NULL) ? t->txd[t->len - 1] : _tx_fill;
+  } else {
+    CDMA::chain_add (_tx_sg, _SG_CHUNKS + 2, &ntx, txcfg | DMA_XFERCFG_SRCINC_1, DMA_ADDR (t->cmd), txdat, total - 1);
+    last = t->cmd[total - 1];
+  }
 
   // Transmission setting for last byte only
   _txbuflast =
     SPI_TXDATCTL_EOF |                      // End of frame
     SPI_TXDATCTL_EOT |                      // End of transmit, SSEL deasserts at end of transfer
     SPI_TXDATCTL_LEN (8 - 1) |              // Bit width of transmitted data -1
-    SPI_TXDATCTL_DATA (_txb[datalen - 1]);  // Transmission data
-  Chip_DMA_Table[_DMAREQ_TX1].xfercfg =
+    SPI_TXDATCTL_DATA (last);               // Transmission data
+  _tx_sg[ntx].xfercfg =
     DMA_XFERCFG_CFGVALID |
     DMA_XFERCFG_SWTRIG |
     DMA_XFERCFG_WIDTH_32 |
     DMA_XFERCFG_SRCINC_0 |
     DMA_XFERCFG_DSTINC_0 |
     DMA_XFERCFG_XFERCOUNT (1);
+  _tx_sg[ntx].source = DMA_ADDR (&_txbuflast);
+  _tx_sg[ntx].dest = DMA_ADDR (&_spi1_conf.SPIx->TXDATCTL);
+  ntx++;
 
-  Chip_DMA_SetupTranChannel (LPC_DMA, DMAREQ_SPI1_TX, (DMA_CHDESC_T *)&Chip_DMA_Table[_DMAREQ_TX0]);
+  // Link descriptors (interrupt when the last byte is received)
+  CDMA::chain_link (_tx_sg, ntx, 0);
+  CDMA::chain_link (_rx_sg, nrx, DMA_XFERCFG_SETINTA);
+
+  // SPI initial condition setting
+  Chip_SPI_ClearStatus (_spi1_conf.SPIx, SPI_STAT_CLR_RXOV | SPI_STAT_CLR_TXUR | SPI_STAT_CLR_SSA | SPI_STAT_CLR_SSD);
+  _spi1_conf.SPIx->TXCTRL =
+    SPI_TXCTL_ASSERT_SSEL |   // Assert SSEL
+    SPI_TXCTL_FLEN (8 - 1);   // Bit width of transmitted data -1
+
+  // Receive settings (the first descriptor is copied into the channel table)
+  Chip_DMA_SetupTranChannel (LPC_DMA, DMAREQ_SPI1_RX, &_rx_sg[0]);
+  Chip_DMA_SetupChannelTransfer (LPC_DMA, DMAREQ_SPI1_RX, _rx_sg[0].xfercfg);
+  Chip_DMA_SetValidChannel (LPC_DMA, DMAREQ_SPI1_RX);
+  Chip_DMA_SWTriggerChannel (LPC_DMA, DMAREQ_SPI1_RX);
+
+  Chip_DMA_SetupTranChannel (LPC_DMA, DMAREQ_SPI1_TX, &_tx_sg[0]);
   Chip_DMA_SetValidChannel (LPC_DMA, DMAREQ_SPI1_TX);
 
   // Excitation of transmission
-  Chip_DMA_SetupChannelTransfer (LPC_DMA, DMAREQ_SPI1_TX, Chip_DMA_Table[_DMAREQ_TX0].xfercfg);
+  Chip_DMA_SetupChannelTransfer (LPC_DMA, DMAREQ_SPI1_TX, _tx_sg[0].xfercfg);
+}
 
-  // Waiting for transmission completion
-  while ((Chip_DMA_GetActiveChannels (LPC_DMA) & (1 << DMAREQ_SPI1_TX)) != 0) ;
-  while (! (SPIConf->SPIx->STAT & SPI_STAT_LE));
+//! Queue SPI1 transaction (returns immediately)
+bool CEXIO::submit (TSPITrans *t) {
+  uint16_t total = t->cmdlen + t->len;
+  if (!_dma_ready || (total == 0) || (t->cmdlen > sizeof (t->cmd)) || (t->len > SPI_MAX_LEN)) return false;
+  t->done = false;
+  t->next = NULL;
+
+  uint32_t primask = __get_PRIMASK();
+  __disable_irq();
+  if (_q_head == NULL) {
+    _q_head = _q_tail = t;
+    start_SPI1 (t);
+  } else {
+    _q_tail->next = t;
+    _q_tail = t;
+  }
+  __set_PRIMASK (primask);
+  return true;
+}
+
+//! Wait for completion of the transaction submitted with task set
+void CEXIO::wait (TSPITrans *t) {
+  while (!t->done) {
+    // The interrupt cannot run while disabled (e.g. stack overflow hook)
+    if (__get_PRIMASK()) CDMA::dispatch();
+    else if (t->task != NULL) ulTaskNotifyTake (pdTRUE, portMAX_DELAY);
+  }
+}
+
+// Receive DMA completion (CDMA handler)
+void CEXIO::dma_done (uint8_t ch, uint8_t flags, void *arg) {
+  if (flags & CDMA::fINTA) ((CEXIO *)arg)->spi1_done();
+}
+
+// Finish the transaction at the head of queue
+void CEXIO::spi1_done (void) {
+  TSPITrans *t = _q_head;
+  if (t == NULL) return;
+
+  // Start the next one before notifying
+  _q_head = t->next;
+  if (_q_head != NULL) start_SPI1 (_q_head);
+  else _q_tail = NULL;
+
+  BaseType_t woken = pdFALSE;
+  if (t->cb != NULL) {
+    // cb may submit t again
+    t->done = true;
+    t->cb (t, t->arg);
+  } else {
+    if ((t->task != NULL) && !__get_PRIMASK()) vTaskNotifyGiveFromISR (t->task, &woken);
+    // t may be released by its owner after this
+    t->done = true;
+  }
+  portYIELD_FROM_ISR (woken);
+}
+
+// SPI1 send/receive with DMA (blocks the caller only)
+// 8 bits wide regardless of spiconf.dataw
+//-----------------------------
+bool CEXIO::readwrite_SPI1 (const uint8_t *txd, uint8_t *rxd, uint16_t datalen) {
+  TSPITrans t = { txd, rxd, datalen, NULL, NULL, NULL, false, NULL };
+  return run_SPI1 (&t);
+}
 
-  // Copying received data
-  __aeabi_memcpy4 (rxd, _rxb, datalen);
+// Run the transaction and wait for it (blocks the caller only)
+bool CEXIO::run_SPI1 (TSPITrans *t) {
+  // Other tasks run during the transfer
+  t->task = NULL;
+  if ((xTaskGetSchedulerState() == taskSCHEDULER_RUNNING) && !__get_PRIMASK()) t->task = xTaskGetCurrentTaskHandle();
+  if (!submit (t)) return false;
+  wait (t);
 
   return true;
 }
 
 // PCAL9722 register write
 uint16_t CEXIO::PCAL_reg_write (uint8_t adr, const uint8_t *dat, uint16_t size) {
-  uint8_t w[size + 2];
-  uint8_t r[size + 2];
-  w[0] = (_PCAL9722_addr << 1);
-  w[1] = adr;
-  __aeabi_memcpy4 (w + 2, dat, size);
-  readwrite_SPI1 (&_spi1_conf, w, r, size + 2);
-
-  return size;
+  TSPITrans t = { dat, NULL, size, NULL, NULL, NULL, false, NULL, { (uint8_t)(_PCAL9722_addr << 1), adr }, 2 };
+  return run_SPI1 (&t) ? size : 0;
 }
 
 // PCAL9722 register read
 uint16_t CEXIO::PCAL_reg_read (uint8_t adr, uint8_t *dat, uint16_t size) {
-  uint8_t w[size + 2];
-  uint8_t r[size + 2];
-  w[0] = (_PCAL9722_addr << 1) | 0x1;
-  w[1] = adr;
-  readwrite_SPI1 (&_spi1_conf, w, r, size + 2);
-  __aeabi_memcpy4 (dat, r + 2, size);
-
-  return size;
+  TSPITrans t = { NULL, dat, size, NULL, NULL, NULL, false, NULL, { (uint8_t)((_PCAL9722_addr << 1) | 0x1), adr }, 2 };
+  return run_SPI1 (&t) ? size : 0;
 }
 
 // For LED GPIOs only
 bool CEXIO::PCAL_LED_Write (uint8_t mode, uint8_t b) {
-  if ((xTaskGetSchedulerState() == taskSCHEDULER_RUNNING)) xSemaphoreTake (_mutex, portMAX_DELAY);
+  // Deferred (interrupts disabled means no flush task, so written at once)
+  bool deferred = _deferred && !__get_PRIMASK();
+  uint32_t primask = __get_PRIMASK();
+  if (deferred) __disable_irq();
+  else if ((xTaskGetSchedulerState() == taskSCHEDULER_RUNNING)) xSemaphoreTake (_mutex, portMAX_DELAY);
   switch (mode) {
     case 0: // off
       _LED_stat &= ~b;
@@ -176,11 +236,105 @@ bool CEXIO::PCAL_LED_Write (uint8_t mode, uint8_t b) {
       break;
   }
   _LED_stat &= 0x3f;
+  if (deferred) {
+    _dirty |= 2;
+    _pending_upd++;
+    __set_PRIMASK (primask);
+    return true;
+  }
   bool result = PCAL_reg_write (0x06, (const uint8_t *)&_LED_stat, 1) == 1;
   if ((xTaskGetSchedulerState() == taskSCHEDULER_RUNNING)) xSemaphoreGive (_mutex);
   return result;
 }
 
+// Read registers into shadow
+void CEXIO::PCAL_shadow_load (void) {
+  PCAL_reg_read (0x0c, (uint8_t *)&_r_cfg, 2);
+  PCAL_reg_read (0x4c, (uint8_t *)&_r_pe, 2);
+  PCAL_reg_read (0x50, (uint8_t *)&_r_pud, 2);
+  PCAL_reg_read (0x04, (uint8_t *)&_r_out, 2);
+}
+
+// Write only the configuration registers that differ from shadow
+void CEXIO::PCAL_config_write (uint16_t r_c, uint16_t r_pe, uint16_t r_pud) {
+  if (r_c != _r_cfg) PCAL_reg_write (0x0c, (const uint8_t *)&r_c, 2);
+  if (r_pe != _r_pe) PCAL_reg_write (0x4c, (const uint8_t *)&r_pe, 2);
+  if (r_pud != _r_pud) PCAL_reg_write (0x50, (const uint8_t *)&r_pud, 2);
+  _r_cfg = r_c;
+  _r_pe = r_pe;
+  _r_pud = r_pud;
+}
+
+// Apply pin mode to configuration register values
+void CEXIO::PCAL_config_make (uint8_t ch, TPinMode pm, uint16_t *r_c, uint16_t *r_pe, uint16_t *r_pud) {
+  uint16_t msk = 1 << ch;
+  switch (pm) {
+    case tPinDIN:
+      *r_c |= msk;
+      *r_pe &= ~msk;
+      *r_pud |= msk;
+      break;
+    case tPinDIN_PU:
+      *r_c |= msk;
+      *r_pe |= msk;
+      *r_pud |= msk;
+      break;
+    case tPinDIN_PD:
+      *r_c |= msk;
+      *r_pe |= msk;
+      *r_pud &= ~msk;
+      break;
+    case tPinDOUT:
+      *r_c &= ~msk;
+      *r_pe &= ~msk;
+      *r_pud |= msk;
+      break;
+    default:
+      break;
+  }
+}
+
+// INT edge (PININT handler)
+void CEXIO::int_edge (uint8_t ch, uint32_t tick, void *arg) {
+  CEXIO *p = (CEXIO *)arg;
+  // INT is active low
+  if (p->_int_gpio->get_gpio() & (1 << p->_int_adch)) return;
+  if (p->_int_busy) p->_int_pending = true;
+  else {
+    p->_int_tick = tick;
+    p->int_read();
+  }
+}
+
+// Interrupt status and input port have been read
+void CEXIO::int_done (TSPITrans *t, void *arg) {
+  CEXIO *p = (CEXIO *)arg;
+  TChangeEvent ev;
+  BaseType_t woken = pdFALSE;
+
+  ev.tick = p->_int_tick;
+  ev.status = p->_int_rxb[0][0] | (p->_int_rxb[0][1] << 8);
+  ev.input = p->_int_rxb[1][0] | (p->_int_rxb[1][1] << 8);
+  p->_in_last = ev.input;
+  if (ev.status != 0) xQueueSendFromISR (p->_int_queue, &ev, &woken);
+
+  // INT asserted again while reading
+  p->_int_busy = false;
+  if (p->_int_pending) {
+    p->_int_tick = 0x7fffffffUL - LPC_MRT_CH3->TIMER;
+    p->int_read();
+  }
+  portYIELD_FROM_ISR (woken);
+}
+
+// Queue reading of interrupt status and input port (reading input port clears INT)
+void CEXIO::int_read (void) {
+  _int_busy = true;
+  _int_pending = false;
+  submit (&_int_t[0]);
+  submit (&_int_t[1]);
+}
+
 CEXIO::CEXIO() {
   PIO_Configure (pins, PIO_LISTSIZE (pins));
 
@@ -189,6 +343,13 @@ CEXIO::CEXIO() {
   init_SPI1();
   PCAL_reg_write (0x06, (const uint8_t[1]) { 0 }, 1);
   PCAL_reg_write (0x0c, (const uint8_t[3]) { 0xff, 0xff, 0xc0 }, 3);
+  PCAL_shadow_load();
+  _int_gpio = NULL;
+  _int_queue = NULL;
+  _deferred = false;
+  _dirty = 0;
+  _pending_upd = _coalesced = 0;
+  _flush_task_handle = NULL;
   anchor = this;
 }
 
@@ -201,11 +362,21 @@ CEXIO::CEXIO (const TPinMode cfg[16]) {
   init_SPI1();
   PCAL_reg_write (0x06, (const uint8_t[1]) { 0 }, 1);
   PCAL_reg_write (0x0c, (const uint8_t[3]) { 0xff, 0xff, 0xc0 }, 3);
-  for (int i = 0; i < 16; i++) set_config (i, cfg[i]);
+  PCAL_shadow_load();
+  _int_gpio = NULL;
+  _int_queue = NULL;
+  _deferred = false;
+  _dirty = 0;
+  _pending_upd = _coalesced = 0;
+  _flush_task_handle = NULL;
+  set_config (cfg);
   anchor = this;
 }
 
 CEXIO::~CEXIO() {
+  set_deferred (false);
+  set_change_detect (0);
+  if (_int_queue != NULL) vQueueDelete (_int_queue);
   PCAL_reg_write (0x4c, (const uint8_t[3]) { 0, 0, 0 }, 2);
   PCAL_reg_write (0x50, (const uint8_t[3]) { 0xff, 0xff, 0xff }, 3);
   PCAL_reg_write (0x0c, (const uint8_t[3]) { 0xff, 0xff, 0xff }, 3);
@@ -213,6 +384,9 @@ CEXIO::~CEXIO() {
 
   Chip_DMA_DisableChannel (LPC_DMA, DMAREQ_SPI1_TX);
   Chip_DMA_DisableChannel (LPC_DMA, DMAREQ_SPI1_RX);
+  CDMA::release (DMAREQ_SPI1_TX, this);
+  CDMA::release (DMAREQ_SPI1_RX, this);
+  CDMA::free_desc (this);
   Chip_SPI_DeInit (_spi1_conf.SPIx);
   Chip_Clock_DisablePeriphClock (SYSCON_CLOCK_SPI1);
 
@@ -248,48 +422,29 @@ void CEXIO::set_LED_toggle (uint8_t b) {
 
 //! GPIO function setting.
 bool CEXIO::set_config (uint8_t ch, TPinMode pm) {
+  if (ch > 15) return false;
   if ((xTaskGetSchedulerState() == taskSCHEDULER_RUNNING)) xSemaphoreTake (_mutex, portMAX_DELAY);
-  bool result = false;
-  if (ch <= 15) {
-    uint16_t r_c, r_pe, r_pud, msk = 1 << ch;
-    PCAL_reg_read (0x0c, (uint8_t *)&r_c, 2);
-    PCAL_reg_read (0x4c, (uint8_t *)&r_pe, 2);
-    PCAL_reg_read (0x50, (uint8_t *)&r_pud, 2);
-
-    switch (pm) {
-      case tPinDIN:
-        r_c |= msk;
-        r_pe &= ~msk;
-        r_pud |= msk;
-        break;
-      case tPinDIN_PU:
-        r_c |= msk;
-        r_pe |= msk;
-        r_pud |= msk;
-        break;
-      case tPinDIN_PD:
-        r_c |= msk;
-        r_pe |= msk;
-        r_pud &= ~msk;
-        break;
-      case tPinDOUT:
-        r_c &= ~msk;
-        r_pe &= ~msk;
-        r_pud |= msk;
-        break;
-      default:
-        break;
-    }
-    PCAL_reg_write (0x0c, (const uint8_t *)&r_c, 2);
-    PCAL_reg_write (0x4c, (const uint8_t *)&r_pe, 2);
-    PCAL_reg_write (0x50, (const uint8_t *)&r_pud, 2);
-  }
+  uint16_t r_c = _r_cfg, r_pe = _r_pe, r_pud = _r_pud;
+  PCAL_config_make (ch, pm, &r_c, &r_pe, &r_pud);
+  PCAL_config_write (r_c, r_pe, r_pud);
   if ((xTaskGetSchedulerState() == taskSCHEDULER_RUNNING)) xSemaphoreGive (_mutex);
-  return result;
+  return true;
+}
+
+//! GPIO function setting for all terminals at once (only changed registers are written)
+bool CEXIO::set_config (const TPinMode cfg[16]) {
+  if ((xTaskGetSchedulerState() == taskSCHEDULER_RUNNING)) xSemaphoreTake (_mutex, portMAX_DELAY);
+  uint16_t r_c = _r_cfg, r_pe = _r_pe, r_pud = _r_pud;
+  for (int i = 0; i < 16; i++) PCAL_config_make (i, cfg[i], &r_c, &r_pe, &r_pud);
+  PCAL_config_write (r_c, r_pe, r_pud);
+  if ((xTaskGetSchedulerState() == taskSCHEDULER_RUNNING)) xSemaphoreGive (_mutex);
+  return true;
 }
 
 //! Digital input.
+//  While input change detection is enabled, returns the input port read at the last INT without SPI access.
 uint16_t CEXIO::get_gpio (void) {
+  if (_int_gpio != NULL) return _in_last;
   if ((xTaskGetSchedulerState() == taskSCHEDULER_RUNNING)) xSemaphoreTake (_mutex, portMAX_DELAY);
   uint16_t r;
   PCAL_reg_read (0x00, (uint8_t *)&r, 2);
@@ -299,10 +454,134 @@ uint16_t CEXIO::get_gpio (void) {
 
 //! Digital output.
 bool CEXIO::set_gpio (uint16_t out) {
+  // Deferred (interrupts disabled means no flush task, so written at once)
+  if (_deferred && !__get_PRIMASK()) {
+    __disable_irq();
+    _r_out = out;
+    _dirty |= 1;
+    _pending_upd++;
+    __enable_irq();
+    return true;
+  }
   if ((xTaskGetSchedulerState() == taskSCHEDULER_RUNNING)) xSemaphoreTake (_mutex, portMAX_DELAY);
   bool result = PCAL_reg_write (0x04, (const uint8_t *)&out, 2) == 2;
+  _r_out = out;
+  if ((xTaskGetSchedulerState() == taskSCHEDULER_RUNNING)) xSemaphoreGive (_mutex);
+  return result;
+}
+
+// Periodic flush of deferred outputs
+void CEXIO::flush_task (void) {
+  while (!_kill_flush_task) {
+    commit();
+    // set_deferred ends the wait by a notification
+    ulTaskNotifyTake (pdTRUE, _flush_period);
+  }
+  _flush_task_handle = NULL;
+  vTaskDelete (NULL);
+}
+
+//! Deferred output mode
+//  LED and output writes only update the shadow, and the merged state is sent in one transfer.
+//  ms:flush period by internal task (0:only by commit)
+void CEXIO::set_deferred (bool on, uint32_t ms) {
+  // The task may be in commit() with the mutex taken and a transfer queued, so let it delete itself
+  if (_flush_task_handle != NULL) {
+    _kill_flush_task = true;
+    xTaskNotifyGive (_flush_task_handle);
+    while (_flush_task_handle != NULL) vTaskDelay (1);
+  }
+  _deferred = on;
+  _flush_period = ms;
+  if (!on) commit();
+  else if (ms > 0) {
+    _kill_flush_task = false;
+    xTaskCreate ([] (void *arg) { static_cast<CEXIO *> (arg)->flush_task(); }, "EXFL", 100, this, 1, &_flush_task_handle);
+  }
+}
+
+//! Send deferred LED and output state now
+bool CEXIO::commit (void) {
+  if ((xTaskGetSchedulerState() == taskSCHEDULER_RUNNING)) xSemaphoreTake (_mutex, portMAX_DELAY);
+
+  // Take the merged state
+  uint8_t w[3];
+  uint32_t primask = __get_PRIMASK();
+  __disable_irq();
+  uint8_t dirty = _dirty;
+  uint32_t n = _pending_upd;
+  w[0] = _r_out;
+  w[1] = _r_out >> 8;
+  w[2] = _LED_stat;
+  _dirty = 0;
+  _pending_upd = 0;
+  __set_PRIMASK (primask);
+
+  // Output port 0, 1 and LED (port 2) are consecutive registers
+  bool result = true;
+  if (dirty == 3) result = PCAL_reg_write (0x04, w, 3) == 3;
+  else if (dirty == 1) result = PCAL_reg_write (0x04, w, 2) == 2;
+  else if (dirty == 2) result = PCAL_reg_write (0x06, &w[2], 1) == 1;
+  if (n > 1) _coalesced += n - 1;
+
   if ((xTaskGetSchedulerState() == taskSCHEDULER_RUNNING)) xSemaphoreGive (_mutex);
   return result;
 }
 
+//! Number of LED and output updates merged into other transfers
+uint32_t CEXIO::get_coalesced (void) {
+  return _coalesced;
+}
+
+//! Detect input changes by the INT output of PCAL9722 instead of polling
+//  msk :pins to watch (latched and unmasked, 0:disable)
+//  g   :CGPIO with the terminal wired to INT (GP21 of Pmod I/F pin 11)
+//  adch:its terminal (0...9), ch:PININT channel used for it (0...7), depth:number of events kept
+bool CEXIO::set_change_detect (uint16_t msk, CGPIO *g, uint8_t adch, uint8_t ch, uint8_t depth) {
+  if ((msk != 0) && ((g == NULL) || (adch > 9) || (ch > 7))) return false;
+  if ((xTaskGetSchedulerState() == taskSCHEDULER_RUNNING)) xSemaphoreTake (_mutex, portMAX_DELAY);
+
+  // Stop the current detection
+  if (_int_gpio != NULL) {
+    _int_gpio->set_pinint_handler (_int_ch, NULL);
+    _int_gpio = NULL;
+    while (_int_busy) {
+      if (__get_PRIMASK()) CDMA::dispatch();
+    }
+  }
+  uint16_t m = ~msk;
+  PCAL_reg_write (0x54, (const uint8_t *)&m, 2);  // interrupt mask
+  PCAL_reg_write (0x48, (const uint8_t *)&msk, 2); // input latch
+
+  if (msk != 0) {
+    if (_int_queue == NULL) _int_queue = xQueueCreate (depth, sizeof (TChangeEvent));
+    for (int i = 0; i < 2; i++) {
+      // interrupt status, input port
+      _int_t[i] = { NULL, _int_rxb[i], 2, NULL, this, NULL, false, NULL, { (uint8_t)((_PCAL9722_addr << 1) | 0x1), (uint8_t)((i == 0) ? 0x58 : 0x00) }, 2 };
+    }
+    _int_t[1].cb = int_done;
+    _int_busy = _int_pending = false;
+
+    // Reading the input port releases INT
+    uint16_t r;
+    PCAL_reg_read (0x00, (uint8_t *)&r, 2);
+    _in_last = r;
+
+    _int_gpio = g;
+    _int_adch = adch;
+    _int_ch = ch;
+    g->set_pinint_handler (ch, int_edge, this);
+    g->set_config (adch, (CGPIO::TPinMode) (CGPIO::tPinINT0_EDGE + ch));
+  }
+
+  if ((xTaskGetSchedulerState() == taskSCHEDULER_RUNNING)) xSemaphoreGive (_mutex);
+  return true;
+}
+
+//! Get input change event (ms:maximum waiting time)
+bool CEXIO::get_change_event (TChangeEvent *ev, uint32_t ms) {
+  if (_int_queue == NULL) return false;
+  return xQueueReceive (_int_queue, ev, (xTaskGetSchedulerState() == taskSCHEDULER_RUNNING) ? ms : 0) == pdTRUE;
+}
+
 CEXIO *CEXIO::anchor = NULL;
@@ -28,13 +28,40 @@
    The pins directly connected to the MCU can be used as GPIO/ADC/DAC.
    It also supports pulse width measurement and 2-phase encoder acquisition.
  */
-inline uint8_t CGPIO::enc_phase (uint8_t ch) {
-  return Chip_GPIO_GetPinState (LPC_GPIO_PORT, 0, PinInfo[enc_phase_pin[ch][0]].No) | (Chip_GPIO_GetPinState (LPC_GPIO_PORT, 0, PinInfo[enc_phase_pin[ch][1]].No) << 1);
+const int8_t CGPIO::enc_dirtable[16] = { 0, 1, -1, 0, -1, 0, 0, 1, 1, 0, 0, -1, 0, -1, 1, 0 };
+
+// Rebuild decoding table and current phase of encoder ch
+void CGPIO::enc_setup (uint8_t ch) {
+  uint32_t port = Chip_GPIO_GetPortValue (LPC_GPIO_PORT, 0);
+  for (int i = 0; i < 16; i++) enc[ch].table[i] = enc_polrev[ch] ? -enc_dirtable[i] : enc_dirtable[i];
+  enc[ch].state = ((port >> enc[ch].phase_pin[0]) & 1) | (((port >> enc[ch].phase_pin[1]) & 1) << 1);
+}
+
+// Extend raw counter to 64 bits
+int64_t CGPIO::enc_extend (uint8_t ch) {
+  uint32_t primask = __get_PRIMASK();
+  __disable_irq();
+  int32_t c = enc[ch].counter;
+  enc_position[ch] += (int32_t) ((uint32_t)c - (uint32_t)enc_last[ch]);
+  enc_last[ch] = c;
+  int64_t r = enc_position[ch];
+  __set_PRIMASK (primask);
+  return r;
 }
 
 CGPIO::CGPIO() {
   anchor = this;
-  for (int i = 0; i < 8; i++) previous_mpw_gpiono[i] = 0;
+  for (int i = 0; i < 8; i++) {
+    previous_mpw_gpiono[i] = 0;
+    // Filter disabled, no timeout
+    pwd[i] = pwdup[i] = 0;
+    pwd_min[i] = pwd_max[i] = pwd_timeout[i] = 0;
+    pwd_hist[i][0] = pwd_hist[i][1] = pwd_hist[i][2] = 0;
+    pwd_hist_ind[i] = 0;
+    pwd_tick[i] = 0;
+    pwd_alive[i] = false;
+    pwd_glitch[i] = 0;
+  }
   pulse_update_cnt = 0;
   // PININT
   Chip_Clock_EnablePeriphClock (SYSCON_CLOCK_GPIOINT);
@@ -45,7 +72,17 @@ CGPIO::CGPIO() {
 //! To initialize all terminals at once at instance
 CGPIO::CGPIO (const TPinMode cfg[10]) {
   anchor = this;
-  for (int i = 0; i < 8; i++) previous_mpw_gpiono[i] = 0;
+  for (int i = 0; i < 8; i++) {
+    previous_mpw_gpiono[i] = 0;
+    // Filter disabled, no timeout
+    pwd[i] = pwdup[i] = 0;
+    pwd_min[i] = pwd_max[i] = pwd_timeout[i] = 0;
+    pwd_hist[i][0] = pwd_hist[i][1] = pwd_hist[i][2] = 0;
+    pwd_hist_ind[i] = 0;
+    pwd_tick[i] = 0;
+    pwd_alive[i] = false;
+    pwd_glitch[i] = 0;
+  }
   pulse_update_cnt = 0;
   // PININT
   Chip_Clock_EnablePeriphClock (SYSCON_CLOCK_GPIOINT);
@@ -55,37 +92,78 @@ CGPIO::CGPIO (const TPinMode cfg[10]) {
 };
 
 CGPIO::~CGPIO() {
+  for (int i = 0; i < 8; i++) set_pinint_handler (i, NULL);
   for (int i = 0; i < 10; i++) NVIC_EnableIRQ ((IRQn_Type) (PININT0_IRQn + i));
   PIO_Configure (pins, PIO_LISTSIZE (pins));
 }
 
-//! PININT interrupt callback
-void CGPIO::PIN_INT_cb (uint8_t ch) {
-  if (Chip_PININT_GetIntStatus (LPC_PININT) & (1 << ch)) {
-    Chip_PININT_ClearIntStatus (LPC_PININT, (1 << ch));
-    int8_t n;
-    switch (pinint_interruptor[ch] & 0xf0) {
-      case 0: {   // Pulse width measurement
-          uint32_t t = LPC_MRT_CH3->TIMER;  // Obtain 31-bit countdown value by 32 MHz (assuming MRT has already started)
-          pulse_update_cnt++;
-          // Up Edge
-          if (Chip_GPIO_GetPinState (LPC_GPIO_PORT, 0, previous_mpw_gpiono[ch])) pwdup[ch] = t;
-          // Down Edge (Ignore counter value overflow)
-          else if (t < pwdup[ch]) pwd[ch] = pwdup[ch] - t;
-          break;
-        }
-      case 0x10:  // Encoder ch 0
-        enc_ind[0] = (enc_ind[0] << 2) | enc_phase (0);
-        if ((n = enc_dirtable[enc_ind[0] & 15])) enc_polrev[0] ? (enc_counter[0] -= n) : (enc_counter[0] += n);
-        break;
-      case 0x20:  // Encoder ch 1
-        enc_ind[1] = (enc_ind[1] << 2) | enc_phase (1);
-        if ((n = enc_dirtable[enc_ind[1] & 15])) enc_polrev[1] ? (enc_counter[1] -= n) : (enc_counter[1] += n);
-        break;
+// Built-in edge handlers
+//-----------------------------------
+void CGPIO::pinint_nop (uint8_t ch, uint32_t tick, void *arg) {
+}
+
+// Pulse width measurement
+void CGPIO::pinint_mpw (uint8_t ch, uint32_t tick, void *arg) {
+  CGPIO *p = (CGPIO *)arg;
+  p->pulse_update_cnt++;
+  // Up Edge
+  if (Chip_GPIO_GetPinState (LPC_GPIO_PORT, 0, p->previous_mpw_gpiono[ch])) p->pwdup[ch] = tick;
+  // Down Edge
+  else {
+    uint32_t w = (tick - p->pwdup[ch]) & 0x7fffffffUL;
+    if (p->pwd_min[ch] < p->pwd_max[ch]) {
+      // Discard glitches and out-of-range pulses
+      if ((w < p->pwd_min[ch]) || (w > p->pwd_max[ch])) {
+        p->pwd_glitch[ch]++;
+        return;
+      }
+      // Median of the last 3 pulses
+      // The first pulse after start or signal loss fills the whole history
+      uint32_t *h = p->pwd_hist[ch];
+      if (!p->pwd_alive[ch] || ((p->pwd_timeout[ch] != 0) && (((tick - p->pwd_tick[ch]) & 0x7fffffffUL) > p->pwd_timeout[ch]))) h[0] = h[1] = h[2] = w;
+      else h[p->pwd_hist_ind[ch]] = w;
+      p->pwd_hist_ind[ch] = (p->pwd_hist_ind[ch] >= 2) ? 0 : p->pwd_hist_ind[ch] + 1;
+      w = MAX (MIN (h[0], h[1]), MIN (MAX (h[0], h[1]), h[2]));
     }
+    p->pwd[ch] = w;
+    p->pwd_tick[ch] = tick;
+    p->pwd_alive[ch] = true;
   }
 }
 
+// 2-phase encoder
+// Both phases are taken with a single port read, and the direction comes from a table with the polarity folded in.
+void CGPIO::pinint_enc (uint8_t ch, uint32_t tick, void *arg) {
+  TEncoder *e = (TEncoder *)arg;
+  uint32_t port = Chip_GPIO_GetPortValue (LPC_GPIO_PORT, 0);
+  uint32_t ind = ((e->state << 2) | ((port >> e->phase_pin[0]) & 1) | (((port >> e->phase_pin[1]) & 1) << 1)) & 15;
+  e->state = ind;
+  e->counter += e->table[ind];
+  e->error += (0x1248 >> ind) & 1;  // 0011, 0110, 1001, 1100
+}
+
+// Assign a GPIO to PININTn for both edges and install the handler
+void CGPIO::pinint_setup (uint8_t n, uint8_t gpio_no, TPinIntHandler h, void *arg) {
+  NVIC_DisableIRQ ((IRQn_Type) (PININT0_IRQn + n));
+  pinint_table[n].arg = arg;
+  pinint_table[n].handler = (h != NULL) ? h : pinint_nop;
+  Chip_SYSCON_SetPinInterrupt (n, gpio_no);
+
+  Chip_PININT_ClearIntStatus (LPC_PININT, 1 << n); // clear INT status
+  Chip_PININT_EnableRisingEdgeOrLevel (LPC_PININT, (1 << n) | LPC_PININT->SIENR);  // Rising edge
+  Chip_PININT_EnableFallingEdgeOrLevel (LPC_PININT, (1 << n) | LPC_PININT->SIENF); // Falling edge
+  NVIC_EnableIRQ ((IRQn_Type) (PININT0_IRQn + n));
+}
+
+//! Attach your own edge handler to PININTn (ch: 0...7, NULL to detach)
+void CGPIO::set_pinint_handler (uint8_t ch, TPinIntHandler h, void *arg) {
+  if (ch > 7) return;
+  NVIC_DisableIRQ ((IRQn_Type) (PININT0_IRQn + ch));
+  pinint_table[ch].arg = arg;
+  pinint_table[ch].handler = (h != NULL) ? h : pinint_nop;
+  NVIC_EnableIRQ ((IRQn_Type) (PININT0_IRQn + ch));
+}
+
 //! GPIO function setting
 void CGPIO::set_config (uint8_t adch, TPinMode pm) {
   if (adch < 10) {
@@ -130,15 +208,9 @@ void CGPIO::set_config (uint8_t adch, TPinMode pm) {
         n = pm - tPinINT0_MPW;
         pin.pin_type = PIO_TYPE_INPUT;
         pin.pin_mode = PIO_MODE_PULLUP;     // pull-up
-        Chip_SYSCON_SetPinInterrupt (n, pin.gpio_no);
         previous_mpw_gpiono[n] = pin.gpio_no;
         pwd[n] = 0;
-
-        Chip_PININT_ClearIntStatus (LPC_PININT, 1 << n); // clear INT status
-        Chip_PININT_EnableRisingEdgeOrLevel (LPC_PININT, (1 << n) | LPC_PININT->SIENR);  // Rising edge
-        Chip_PININT_EnableFallingEdgeOrLevel (LPC_PININT, (1 << n) | LPC_PININT->SIENF); // Falling edge
-        NVIC_EnableIRQ ((IRQn_Type) (PININT0_IRQn + n));
-        pinint_interruptor[n] = n;
+        pinint_setup (n, pin.gpio_no, pinint_mpw, this);
         break;
 
       // Encoder Ch 0 phase A
@@ -146,28 +218,18 @@ void CGPIO::set_config (uint8_t adch, TPinMode pm) {
         n = pm - tPinINT0_ENC0A;
         pin.pin_type = PIO_TYPE_INPUT;
         pin.pin_mode = PIO_MODE_PULLUP;     // pull-up
-        Chip_SYSCON_SetPinInterrupt (n, pin.gpio_no);
-        enc_phase_pin[0][0] = adch;
-
-        Chip_PININT_ClearIntStatus (LPC_PININT, 1 << n); // clear INT status
-        Chip_PININT_EnableRisingEdgeOrLevel (LPC_PININT, (1 << n) | LPC_PININT->SIENR);  // Rising edge
-        Chip_PININT_EnableFallingEdgeOrLevel (LPC_PININT, (1 << n) | LPC_PININT->SIENF); // Falling edge
-        NVIC_EnableIRQ ((IRQn_Type) (PININT0_IRQn + n));
-        pinint_interruptor[n] = 0x10 | n;
+        enc[0].phase_pin[0] = pin.gpio_no;
+        enc_setup (0);
+        pinint_setup (n, pin.gpio_no, pinint_enc, &enc[0]);
         break;
       // Encoder Ch 0 phase B
       case tPinINT0_ENC0B ... tPinINT7_ENC0B:
         n = pm - tPinINT0_ENC0B;
         pin.pin_type = PIO_TYPE_INPUT;
         pin.pin_mode = PIO_MODE_PULLUP;     // pull-up
-        Chip_SYSCON_SetPinInterrupt (n, pin.gpio_no);
-        enc_phase_pin[0][1] = adch;
-
-        Chip_PININT_ClearIntStatus (LPC_PININT, 1 << n); // clear INT status
-        Chip_PININT_EnableRisingEdgeOrLevel (LPC_PININT, (1 << n) | LPC_PININT->SIENR);  // Rising edge
-        Chip_PININT_EnableFallingEdgeOrLevel (LPC_PININT, (1 << n) | LPC_PININT->SIENF); // Falling edge
-        NVIC_EnableIRQ ((IRQn_Type) (PININT0_IRQn + n));
-        pinint_interruptor[n] = 0x10 | n;
+        enc[0].phase_pin[1] = pin.gpio_no;
+        enc_setup (0);
+        pinint_setup (n, pin.gpio_no, pinint_enc, &enc[0]);
         break;
 
       // Encoder Ch 1 phase A
@@ -175,28 +237,27 @@ void CGPIO::set_config (uint8_t adch, TPinMode pm) {
         n = pm - tPinINT0_ENC1A;
         pin.pin_type = PIO_TYPE_INPUT;
         pin.pin_mode = PIO_MODE_PULLUP;     // pull-up
-        Chip_SYSCON_SetPinInterrupt (n, pin.gpio_no);
-        enc_phase_pin[1][0] = adch;
-
-        Chip_PININT_ClearIntStatus (LPC_PININT, 1 << n); // clear INT status
-        Chip_PININT_EnableRisingEdgeOrLevel (LPC_PININT, (1 << n) | LPC_PININT->SIENR);  // Rising edge
-        Chip_PININT_EnableFallingEdgeOrLevel (LPC_PININT, (1 << n) | LPC_PININT->SIENF); // Falling edge
-        NVIC_EnableIRQ ((IRQn_Type) (PININT0_IRQn + n));
-        pinint_interruptor[n] = 0x20 | n;
+        enc[1].phase_pin[0] = pin.gpio_no;
+        enc_setup (1);
+        pinint_setup (n, pin.gpio_no, pinint_enc, &enc[1]);
         break;
       // Encoder Ch 1 phase B
       case tPinINT0_ENC1B ... tPinINT7_ENC1B:
         n = pm - tPinINT0_ENC1B;
         pin.pin_type = PIO_TYPE_INPUT;
         pin.pin_mode = PIO_MODE_PULLUP;     // pull-up
-        Chip_SYSCON_SetPinInterrupt (n, pin.gpio_no);
-        enc_phase_pin[1][1] = adch;
-
-        Chip_PININT_ClearIntStatus (LPC_PININT, 1 << n); // clear INT status
-        Chip_PININT_EnableRisingEdgeOrLevel (LPC_PININT, (1 << n) | LPC_PININT->SIENR);  // Rising edge
-        Chip_PININT_EnableFallingEdgeOrLevel (LPC_PININT, (1 << n) | LPC_PININT->SIENF); // Falling edge
-        NVIC_EnableIRQ ((IRQn_Type) (PININT0_IRQn + n));
-        pinint_interruptor[n] = 0x20 | n;
+        enc[1].phase_pin[1] = pin.gpio_no;
+        enc_setup (1);
+        pinint_setup (n, pin.gpio_no, pinint_enc, &enc[1]);
+        break;
+
+      // User edge handler (attach with set_pinint_handler)
+      case tPinINT0_EDGE ... tPinINT7_EDGE:
+        n = pm - tPinINT0_EDGE;
+        pin.pin_type = PIO_TYPE_INPUT;
+        pin.pin_mode = PIO_MODE_PULLUP;     // pull-up
+        if ((pinint_table[n].handler == pinint_mpw) || (pinint_table[n].handler == pinint_enc)) pinint_table[n].handler = pinint_nop;
+        pinint_setup (n, pin.gpio_no, pinint_table[n].handler, pinint_table[n].arg);
         break;
 
       // SPI
@@ -249,7 +310,7 @@ uint16_t CGPIO::get_adc (uint8_t ch) {
 
 //! Get pulse width measurement (ch: 0...7)
 uint32_t CGPIO::get_pwd (uint8_t ch) {
-  if (ch <= 7) return pwd[ch];
+  if (ch <= 7) return get_pwd_alive (ch) ? pwd[ch] : 0;
   return 0;
 }
 
@@ -257,61 +318,126 @@ uint32_t CGPIO::get_pulse_update_cnt (void) {
   return pulse_update_cnt;
 }
 
+//! Set plausibility window and signal loss timeout of pulse width measurement (ch: 0...7)
+void CGPIO::set_pwd_filter (uint8_t ch, uint32_t min_us, uint32_t max_us, uint32_t timeout_us) {
+  if (ch > 7) return;
+  uint32_t primask = __get_PRIMASK();
+  __disable_irq();
+  pwd_min[ch] = min_us * _USTICK;
+  pwd_max[ch] = max_us * _USTICK;
+  pwd_timeout[ch] = MIN (timeout_us, 0x3fffffffUL / _USTICK) * _USTICK;
+  // The median filter is seeded by the next valid pulse
+  pwd_alive[ch] = false;
+  pwd_hist_ind[ch] = 0;
+  pwd_glitch[ch] = 0;
+  __set_PRIMASK (primask);
+}
+
+//! Check if the pulse is being received (ch: 0...7)
+bool CGPIO::get_pwd_alive (uint8_t ch) {
+  if (ch > 7) return false;
+  if (pwd_timeout[ch] == 0) return true;
+  uint32_t primask = __get_PRIMASK();
+  __disable_irq();
+  // Once timed out, stay lost until the next accepted pulse (avoids 31-bit wrap of the age)
+  if (pwd_alive[ch] && (((0x7fffffffUL - LPC_MRT_CH3->TIMER) - pwd_tick[ch]) & 0x7fffffffUL) > pwd_timeout[ch]) pwd_alive[ch] = false;
+  bool r = pwd_alive[ch];
+  __set_PRIMASK (primask);
+  return r;
+}
+
+//! Get elapsed time since the last accepted pulse in microseconds (ch: 0...7)
+uint32_t CGPIO::get_pwd_age (uint8_t ch) {
+  if (ch > 7) return 0;
+  return (((0x7fffffffUL - LPC_MRT_CH3->TIMER) - pwd_tick[ch]) & 0x7fffffffUL) / _USTICK;
+}
+
+//! Get number of pulses rejected by the plausibility window (ch: 0...7)
+uint32_t CGPIO::get_pwd_glitch (uint8_t ch) {
+  if (ch > 7) return 0;
+  return pwd_glitch[ch];
+}
+
 int32_t CGPIO::get_ENC_rawcounter (uint8_t ch) {
   if (ch > 1) return 0;
-  return enc_counter[ch];
+  return enc[ch].counter;
 }
 
 int32_t CGPIO::get_encoder_count (uint8_t ch) {
   if (ch > 1) return 0;
-  return enc_counter[ch] - enc_offset[ch];
+  return enc[ch].counter - enc_offset[ch];
+}
+
+//! Get encoder position since reset_encoder_count without 32-bit wrap-around
+int64_t CGPIO::get_encoder_position (uint8_t ch) {
+  if (ch > 1) return 0;
+  return enc_extend (ch) - enc_position_offset[ch];
+}
+
+//! Get number of illegal phase transitions (missed edges)
+uint32_t CGPIO::get_encoder_error (uint8_t ch) {
+  if (ch > 1) return 0;
+  return enc[ch].error;
+}
+
+//! Reverse the counting direction of the encoder
+void CGPIO::set_encoder_reverse (uint8_t ch, bool rev) {
+  if (ch > 1) return;
+  enc_polrev[ch] = rev;
+  for (int i = 0; i < 16; i++) enc[ch].table[i] = rev ? -enc_dirtable[i] : enc_dirtable[i];
 }
 
 void CGPIO::reset_encoder_count (uint8_t ch) {
   if (ch > 1) return;
-  enc_offset[ch] = enc_counter[ch];
+  enc_position_offset[ch] = enc_extend (ch);
+  enc_offset[ch] = enc_last[ch];
 }
 
 CGPIO *CGPIO::anchor = NULL;
 
-// PININT interrupt routine for pulse width measurement
+CGPIO::TPinIntEntry CGPIO::pinint_table[8] = {
+  { pinint_nop, NULL }, { pinint_nop, NULL }, { pinint_nop, NULL }, { pinint_nop, NULL },
+  { pinint_nop, NULL }, { pinint_nop, NULL }, { pinint_nop, NULL }, { pinint_nop, NULL },
+};
+
+// PININT interrupt routine
 //-----------------------------------
 //! Interrupt handler for PININT0 @note Call from CGPIO.
 extern "C" void PIN_INT0_IRQHandler (void) {
-  CGPIO::anchor->PIN_INT_cb (0);
+  CGPIO::PIN_INT_dispatch (0);
 }
 
 //! Interrupt handler for PININT1 @note Call from CGPIO.
 extern "C" void PIN_INT1_IRQHandler (void) {
-  CGPIO::anchor->PIN_INT_cb (1);
+  CGPIO::PIN_INT_dispatch (1);
 }
 
 //! Interrupt handler for PININT2 @note Call from CGPIO.
 extern "C" void PIN_INT2_IRQHandler (void) {
-  CGPIO::anchor->PIN_INT_cb (2);
+  CGPIO::PIN_INT_dispatch (2);
 }
 
 //! Interrupt handler for PININT3 @note Call from CGPIO.
 extern "C" void PIN_INT3_IRQHandler (void) {
-  CGPIO::anchor->PIN_INT_cb (3);
+  CGPIO::PIN_INT_dispatch (3);
 }
 
 //! Interrupt handler for PININT4 @note Call from CGPIO.
 extern "C" void PIN_INT4_IRQHandler (void) {
-  CGPIO::anchor->PIN_INT_cb (4);
+  CGPIO::PIN_INT_dispatch (4);
 }
 
 //! Interrupt handler for PININT5 @note Call from CGPIO.
 extern "C" void PIN_INT5_IRQHandler (void) {
-  CGPIO::anchor->PIN_INT_cb (5);
+  CGPIO::PIN_INT_dispatch (5);
 }
 
 //! Interrupt handler for PININT6 @note Call from CGPIO.
 extern "C" void PIN_INT6_IRQHandler (void) {
-  CGPIO::anchor->PIN_INT_cb (6);
+  CGPIO::PIN_INT_dispatch (6);
 }
 
 //! Interrupt handler for PININT7 @note Call from CGPIO.
 extern "C" void PIN_INT7_IRQHandler (void) {
-  CGPIO::anchor->PIN_INT_cb (7);
+  CGPIO::PIN_INT_dispatch (7);
 }
@@ -26,57 +26,162 @@
  @brief Arduino-like I2C class.
  @note
    It was created to flow the numerous resources for Arduino.
+   Transfers are queued as transactions and run by the I2C interrupt.
+   begin/write/read/end are thin transactions that hold the bus between calls.
+   Each byte is guarded by the hardware timeout sized to the bus speed, and a bus
+   held low by a device is freed by toggling SCL.
  */
-inline uint8_t CI2C::i2c_get_stat (void) {
-  return (LPC_I2C0->STAT >> 1) & 0x07;
-}
-
-bool CI2C::i2c_wait_SI (LPC_I2C_T *I2Cx) {
-  uint32_t  elap = UD5_GET_ELAPSEDTIME() + FLAG_TIMEOUT;
-  while (! (I2Cx->STAT & I2C_MSTCTL_MSTCONTINUE)) {
-    if (UD5_GET_ELAPSEDTIME() > elap) return false;
-    if (csw != NULL) csw();
+// Start the transaction at the head of queue
+// Call with interrupts disabled
+void CI2C::start (void) {
+  TI2CTrans *t = _q_head;
+  _pos = 0;
+  _err = IIC_OK;
+  _stopping = false;
+  LPC_I2C0->STAT = I2C_STAT_MSTRARBLOSS | I2C_STAT_MSTSTSTPERR | I2C_STAT_EVENTTIMEOUT | I2C_STAT_SCLTIMEOUT;
+  if (! (t->flags & fNOSTART)) {
+    // (Repeated) start, address for reading only when there is nothing to write
+    bool rd = ((t->cmdlen + t->txlen) == 0) && ((t->rxlen > 0) || (t->flags & fREAD));
+    LPC_I2C0->MSTDAT = (t->addr << 1) | (rd ? 1 : 0);
+    LPC_I2C0->MSTCTL = I2C_MSTCTL_MSTSTART;
   }
-  return true;
+  // The held bus is already pending, so the interrupt comes at once
+  LPC_I2C0->INTENSET = _MSTINT;
 }
 
-bool CI2C::i2c_wait_stat (LPC_I2C_T *I2Cx) {
-  uint32_t  elap = UD5_GET_ELAPSEDTIME() + FLAG_TIMEOUT;
-  while (elap > UD5_GET_ELAPSEDTIME()) {
-    if (i2c_get_stat() != 0x03) return true;
-    if (csw != NULL) csw();
+// STOP unless the bus is held
+void CI2C::stop_or_hold (TI2CTrans *t) {
+  if ((t->flags & fNOSTOP) && (_err == IIC_OK)) finish (IIC_OK);
+  else {
+    // Sends NAK to complete previous RD
+    LPC_I2C0->MSTCTL = I2C_MSTCTL_MSTSTOP;
+    _stopping = true;
   }
-  return true;
 }
 
-bool CI2C::i2c_read (LPC_I2C_T *I2Cx, void *dat, bool fin) {
-  uint8_t   t;
+// Finish the transaction at the head of queue
+void CI2C::finish (uint8_t result) {
+  TI2CTrans *t = _q_head;
+  LPC_I2C0->INTENCLR = _MSTINT;
+  if (t == NULL) return;
+  t->result = result;
 
-  if (!i2c_wait_SI (I2Cx)) return false;
-  uint8_t stat = i2c_get_stat();
+  // Start the next one before notifying
+  _q_head = t->next;
+  if (_q_head != NULL) start();
+  else _q_tail = NULL;
 
-  if (stat != 0x01) { // RX RDY
-    return false;
+  BaseType_t woken = pdFALSE;
+  if (t->cb != NULL) {
+    // cb may submit t again
+    t->done = true;
+    t->cb (t, t->arg);
+  } else {
+    if ((t->task != NULL) && !__get_PRIMASK()) vTaskNotifyGiveFromISR (t->task, &woken);
+    // t may be released by its owner after this
+    t->done = true;
   }
-  t = I2Cx->MSTDAT & 0xFF; // Store read byte
-  if (!fin) I2Cx->MSTCTL = (1 << 0);// Send ACK and Continue to read
-  * (uint8_t *)dat = t;
-  return true;
+  portYIELD_FROM_ISR (woken);
 }
 
-
-int CI2C::i2c_write (LPC_I2C_T *I2Cx, int value, uint8_t addr) {
-  // write the data
-  I2Cx->MSTDAT = value;
-  // Set continue for data. Should not be set for addr since that uses STA
-  I2Cx->MSTCTL = I2C_MSTCTL_MSTCONTINUE;
-  // wait and return status
-  i2c_wait_SI (I2Cx);
-  return i2c_get_stat();
+// Remove transaction from queue
+bool CI2C::cancel (TI2CTrans *t) {
+  bool result = false;
+  uint32_t primask = __get_PRIMASK();
+  __disable_irq();
+  if (t->done) {
+    // Already completed
+  } else if (t == _q_head) {
+    // Abandon the bus, the next one starts from idle or fails
+    LPC_I2C0->MSTCTL = I2C_MSTCTL_MSTSTOP;
+    t->cb = NULL;
+    t->task = NULL;
+    finish (IIC_TIMEOUT);
+    result = true;
+  } else {
+    for (TI2CTrans *p = _q_head; p != NULL; p = p->next) {
+      if (p->next != t) continue;
+      p->next = t->next;
+      if (_q_tail == t) _q_tail = p;
+      t->result = IIC_TIMEOUT;
+      t->done = true;
+      result = true;
+      break;
+    }
+  }
+  __set_PRIMASK (primask);
+  return result;
 }
 
-inline void CI2C::i2c_genestart (LPC_I2C_T *I2Cx) {
-  I2Cx->MSTCTL = I2C_MSTCTL_MSTSTART; // STA bit
+//! State machine (called from I2C0_IRQHandler, or polled while interrupts are disabled)
+void CI2C::isr (void) {
+  TI2CTrans *t = _q_head;
+  uint32_t stat = LPC_I2C0->STAT;
+
+  if (t == NULL) {
+    LPC_I2C0->INTENCLR = _MSTINT;
+    return;
+  }
+  // No bus event or SCL held low for the byte timeout
+  if (stat & (I2C_STAT_EVENTTIMEOUT | I2C_STAT_SCLTIMEOUT)) {
+    LPC_I2C0->STAT = I2C_STAT_EVENTTIMEOUT | I2C_STAT_SCLTIMEOUT;
+    LPC_I2C0->MSTCTL = I2C_MSTCTL_MSTSTOP;
+    finish (IIC_TIMEOUT);
+    return;
+  }
+  // The master returns to idle by itself
+  if (stat & (I2C_STAT_MSTRARBLOSS | I2C_STAT_MSTSTSTPERR)) {
+    LPC_I2C0->STAT = I2C_STAT_MSTRARBLOSS | I2C_STAT_MSTSTSTPERR;
+    finish ((stat & I2C_STAT_MSTRARBLOSS) ? IIC_ARBLOSS : IIC_BUSERR);
+    return;
+  }
+  if (! (stat & I2C_STAT_MSTPENDING)) return;
+
+  uint16_t wlen = t->cmdlen + t->txlen;
+  switch ((stat & I2C_STAT_MSTSTATE) >> 1) {
+    case 0: // Idle
+      if (_stopping || ((wlen + t->rxlen) == 0)) finish (_err);
+      else finish (IIC_PARAM);
+      break;
+    case 1: // RX ready
+      if (_pos < t->rxlen) {
+        t->rxd[_pos++] = LPC_I2C0->MSTDAT;
+        t->count = _pos;
+        // ACK and continue to read
+        if (_pos < t->rxlen) {
+          LPC_I2C0->MSTCTL = I2C_MSTCTL_MSTCONTINUE;
+          break;
+        }
+      }
+      stop_or_hold (t);
+      break;
+    case 2: // TX ready (previous byte acknowledged)
+      t->count = _pos;
+      if (_pos < wlen) {
+        LPC_I2C0->MSTDAT = (_pos < t->cmdlen) ? t->cmd[_pos] : t->txd[_pos - t->cmdlen];
+        _pos++;
+        LPC_I2C0->MSTCTL = I2C_MSTCTL_MSTCONTINUE;
+      } else if ((t->rxlen > 0) && (wlen > 0)) {
+        // Repeated start for reading
+        _pos = 0;
+        LPC_I2C0->MSTDAT = (t->addr << 1) | 1;
+        LPC_I2C0->MSTCTL = I2C_MSTCTL_MSTSTART;
+      } else stop_or_hold (t);
+      break;
+    case 3: // NACK address
+      _err = IIC_NACK_ADDR;
+      stop_or_hold (t);
+      break;
+    case 4: // NACK data
+      if (_pos > 0) t->count = _pos - 1;
+      _err = IIC_NACK_DATA;
+      stop_or_hold (t);
+      break;
+    default:
+      _err = IIC_BUSERR;
+      stop_or_hold (t);
+      break;
+  }
 }
 
 CI2C::CI2C (TIICMode m) {
@@ -87,23 +192,42 @@ CI2C::CI2C (TIICMode m) {
   LPC_SYSCON->I2C0CLKSEL = SYSCON_FLEXCOMMCLKSELSRC_MAINCLK;
   Chip_I2C_Init (LPC_I2C0);       // Enable I2C clock and reset I2C peripheral
   LPC_I2C0->CFG = (LPC_I2C0->CFG & I2C_CFG_MASK) | I2C_CFG_MSTEN; // Enable Master mode
+  _q_head = _q_tail = NULL;
+  _last = IIC_OK;
+  _recovering = false;
   set_freq (m);
-  csw = _my_csw;
   _mutex = xSemaphoreCreateMutex();
+  _lock_owner = NULL;
+  _lock_nest = 0;
+  anchor = this;
+  NVIC_EnableIRQ (I2C0_IRQn);
 }
 
 CI2C::~CI2C() {
+  NVIC_DisableIRQ (I2C0_IRQn);
   Chip_SYSCON_PeriphReset (RESET_I2C0);
   vSemaphoreDelete (_mutex);
+  anchor = NULL;
 }
 
 //! Take semaphore.
 void CI2C::lock_sem (void) {
-  if ((xTaskGetSchedulerState() == taskSCHEDULER_RUNNING)) xSemaphoreTake (_mutex, portMAX_DELAY);
+  if ((xTaskGetSchedulerState() != taskSCHEDULER_RUNNING)) return;
+  TaskHandle_t me = xTaskGetCurrentTaskHandle();
+  if (_lock_owner != me) {
+    xSemaphoreTake (_mutex, portMAX_DELAY);
+    _lock_owner = me;
+  }
+  _lock_nest++;
 }
 //! Give semaphore.
 void CI2C::unlock_sem (void) {
-  if ((xTaskGetSchedulerState() == taskSCHEDULER_RUNNING)) xSemaphoreGive (_mutex);
+  if ((xTaskGetSchedulerState() != taskSCHEDULER_RUNNING)) return;
+  if ((_lock_owner != xTaskGetCurrentTaskHandle()) || (_lock_nest == 0)) return;
+  if (--_lock_nest == 0) {
+    _lock_owner = NULL;
+    xSemaphoreGive (_mutex);
+  }
 }
 
 //! Set clock frequency
@@ -113,80 +237,212 @@ bool CI2C::set_freq (TIICMode m) {
       // Speed = 100kbps
       Chip_I2C_SetClockDiv (LPC_I2C0, SystemCoreClock / (100000 * 4)); // Setup clock rate for I2C
       Chip_I2CM_SetBusSpeed (LPC_I2C0, 100000);
+      _freq = 100000;
       break;
     case IIC_Fm: // Fast Mode high
       // Speed = 400kbps
       Chip_I2C_SetClockDiv (LPC_I2C0, SystemCoreClock / (400000 * 4)); // Setup clock rate for I2C
       Chip_I2CM_SetBusSpeed (LPC_I2C0, 400000);
+      _freq = 400000;
       break;
     case IIC_Fmp: // Fast Mode Plus
       // Speed = 1Mbps
       Chip_I2C_SetClockDiv (LPC_I2C0, SystemCoreClock / (1000000 * 4)); // Setup clock rate for I2C
       Chip_I2CM_SetBusSpeed (LPC_I2C0, 1000000);
+      _freq = 1000000;
       Chip_IOCON_PinSetI2CMode (/*LPC_IOCON, */IOCON_PIO0_10, PIN_I2CMODE_FASTPLUS);
       Chip_IOCON_PinSetI2CMode (/*LPC_IOCON, */IOCON_PIO0_11, PIN_I2CMODE_FASTPLUS);
       break;
   }
   Chip_I2CM_Enable (LPC_I2C0);              // Enable Master Mode
+  set_timeout ((4 * 9 * 1000000UL) / _freq);
   return true;
 }
 
-//! Join the I2C bus.
-bool CI2C::begin (uint8_t addr, bool read) {
-  LPC_I2C0->MSTDAT = (addr << 1) | (read ? 1 : 0);
+//! Set byte timeout [us] (longer for devices that stretch the clock)
+void CI2C::set_timeout (uint32_t byte_us) {
+  // The timeout counts 16 I2C function clocks (= 4 SCL periods)
+  uint32_t to = (((uint64_t)byte_us * _freq) + 3999999UL) / 4000000UL;
+  to = MIN (MAX (to, 1), 4096);
+  _byte_us = (to * 4000000UL) / _freq;
+  LPC_I2C0->TIMEOUT = ((to - 1) << 4) | 0x0f;
+  LPC_I2C0->CFG = (LPC_I2C0->CFG & I2C_CFG_MASK) | I2C_CFG_TIMEOUTEN;
+}
+
+//! Timeout of the transaction [us]
+uint32_t CI2C::timeout_us (const TI2CTrans *t) {
+  // Address twice, data and STOP
+  return (3 + t->cmdlen + t->txlen + t->rxlen) * _byte_us;
+}
+
+//! Free the bus held low by a device (SCL toggled up to 9 times followed by STOP)
+bool CI2C::recover (void) {
+  const TPin gp[2] = {
+    { _SCL, PIO_TYPE_OUTPUT_1, 0, PIO_MODE_OPENDRAIN },
+    { _SDA, PIO_TYPE_OUTPUT_1, 0, PIO_MODE_OPENDRAIN },
+  };
+  uint32_t half = MAX (500000UL / _freq, 1);
+
+  uint32_t primask = __get_PRIMASK();
+  __disable_irq();
+  if (_recovering || ((_q_head != NULL) && !(_q_head->flags & fNOSTART))) {
+    // Another transaction is on the bus, it fails and recovers by itself if the bus is held
+    __set_PRIMASK (primask);
+    return true;
+  }
+  _recovering = true;
+  __set_PRIMASK (primask);
+
+  LPC_I2C0->CFG = (LPC_I2C0->CFG & I2C_CFG_MASK) & ~I2C_CFG_MSTEN;
+  PIO_Configure (gp, PIO_LISTSIZE (gp));
+  // Clock out the rest of the byte the device is sending
+  for (int i = 0; (i < 9) && !Chip_GPIO_GetPinState (LPC_GPIO_PORT, 0, _SDA); i++) {
+    Chip_GPIO_SetPinState (LPC_GPIO_PORT, 0, _SCL, false);
+    _wait.us (half);
+    Chip_GPIO_SetPinState (LPC_GPIO_PORT, 0, _SCL, true);
+    _wait.us (half);
+  }
+  // STOP (SDA rises while SCL is high)
+  Chip_GPIO_SetPinState (LPC_GPIO_PORT, 0, _SCL, false);
+  _wait.us (half);
+  Chip_GPIO_SetPinState (LPC_GPIO_PORT, 0, _SDA, false);
+  _wait.us (half);
+  Chip_GPIO_SetPinState (LPC_GPIO_PORT, 0, _SCL, true);
+  _wait.us (half);
+  Chip_GPIO_SetPinState (LPC_GPIO_PORT, 0, _SDA, true);
+  _wait.us (half);
+  bool result = Chip_GPIO_GetPinState (LPC_GPIO_PORT, 0, _SCL) && Chip_GPIO_GetPinState (LPC_GPIO_PORT, 0, _SDA);
 
-  i2c_genestart (LPC_I2C0);
+  PIO_Configure (pins, PIO_LISTSIZE (pins));
+  LPC_I2C0->STAT = I2C_STAT_MSTRARBLOSS | I2C_STAT_MSTSTSTPERR | I2C_STAT_EVENTTIMEOUT | I2C_STAT_SCLTIMEOUT;
+  LPC_I2C0->CFG = (LPC_I2C0->CFG & I2C_CFG_MASK) | I2C_CFG_MSTEN;
 
-  i2c_wait_SI (LPC_I2C0);
-  return (i2c_get_stat() != 0x03); // NAK SlaveAddress
+  // Start the transactions queued meanwhile
+  primask = __get_PRIMASK();
+  __disable_irq();
+  _recovering = false;
+  if (_q_head != NULL) start();
+  __set_PRIMASK (primask);
+  return result;
 }
 
-//! Release the I2C bus.
-bool CI2C::end (void) {
-  uint32_t timeout = UD5_GET_ELAPSEDTIME() + LONG_TIMEOUT;
+//! Queue transaction (returns immediately)
+bool CI2C::submit (TI2CTrans *t) {
+  if ((t->cmdlen > sizeof (t->cmd)) || ((t->rxlen > 0) && (t->rxd == NULL)) || ((t->txlen > 0) && (t->txd == NULL))) return false;
+  t->result = IIC_OK;
+  t->count = 0;
+  t->done = false;
+  t->next = NULL;
 
-  // STP bit and Continue bit. Sends NAK to complete previous RD
-  LPC_I2C0->MSTCTL = I2C_MSTCTL_MSTSTOP | I2C_MSTCTL_MSTCONTINUE;
+  uint32_t primask = __get_PRIMASK();
+  __disable_irq();
+  if (_q_head == NULL) {
+    _q_head = _q_tail = t;
+    if (!_recovering) start();
+  } else {
+    _q_tail->next = t;
+    _q_tail = t;
+  }
+  __set_PRIMASK (primask);
+  return true;
+}
 
-  //Spin until Ready (b0 == 1)and Status is Idle (b3..b1 == 000)
-  while ((LPC_I2C0->STAT & (I2C_STAT_MSTSTATE | I2C_STAT_MSTPENDING)) != ((0 << 1) | I2C_STAT_MSTPENDING)) {
-    if (UD5_GET_ELAPSEDTIME() > timeout) return false;
-    if (csw != NULL) csw();
+//! Wait for completion of the transaction submitted with task set (false:timeout)
+//  The time is counted from the start of the transaction on the bus.
+bool CI2C::wait (TI2CTrans *t, uint32_t us) {
+  uint32_t tm = 0x7fffffffUL - LPC_MRT_CH3->TIMER;
+  while (!t->done) {
+    uint32_t now = 0x7fffffffUL - LPC_MRT_CH3->TIMER;
+    // Not counted while waiting in queue
+    if ((_q_head != t) && (us > 0)) tm = now;
+    uint32_t el = ((now - tm) & 0x7fffffffUL) / _USTICK;
+    if (el >= us) {
+      if (cancel (t)) return false;
+      continue;
+    }
+    // The interrupt cannot run while disabled
+    if (__get_PRIMASK()) isr();
+    else if (t->task != NULL) ulTaskNotifyTake (pdTRUE, ((us - el) + 999) / 1000);
   }
   return true;
 }
 
+//! Run transaction and wait for it (blocks the caller only)
+uint8_t CI2C::run (TI2CTrans *t) {
+  // Other tasks run during the transfer
+  t->task = NULL;
+  if ((xTaskGetSchedulerState() == taskSCHEDULER_RUNNING) && !__get_PRIMASK()) t->task = xTaskGetCurrentTaskHandle();
+  if (!submit (t)) return _last = IIC_PARAM;
+  wait (t, timeout_us (t));
+  _last = t->result;
+  // The device may still hold the bus
+  if ((_last == IIC_TIMEOUT) || (_last == IIC_BUSERR)) {
+    if (!recover()) _last = IIC_STUCK;
+  }
+  return _last;
+}
+
+//! Write register address, then read len bytes after repeated start
+//! @note The last byte is NACKed and followed by STOP.
+uint8_t CI2C::read_reg (uint8_t addr, uint8_t reg, void *buf, uint16_t len) {
+  TI2CTrans t = { addr, 0, { reg }, 1, NULL, 0, (uint8_t *)buf, len };
+  lock_sem();
+  uint8_t result = run (&t);
+  unlock_sem();
+  return result;
+}
+
+//! Write register address followed by len bytes
+uint8_t CI2C::write_reg (uint8_t addr, uint8_t reg, const void *data, uint16_t len) {
+  TI2CTrans t = { addr, 0, { reg }, 1, (const uint8_t *)data, len };
+  lock_sem();
+  uint8_t result = run (&t);
+  unlock_sem();
+  return result;
+}
+
+//! Join the I2C bus.
+bool CI2C::begin (uint8_t addr, bool read) {
+  TI2CTrans t = { addr, (uint8_t) ((read ? fREAD : 0) | fNOSTOP) };
+  return run (&t) == IIC_OK; // NAK SlaveAddress
+}
+
+//! Release the I2C bus.
+bool CI2C::end (void) {
+  TI2CTrans t = { 0, fNOSTART };
+  return run (&t) == IIC_OK;
+}
+
 //! Transmission of 1 byte.
 int CI2C::write (uint8_t val) {
-  if (0x02 == i2c_write (LPC_I2C0, val, 0)) return 1;
-  return 0;
+  return write (&val, 1);
 }
 int CI2C::write (const uint8_t *val, int l) {
-  int i;
-  for (i = 0; i < l; i++) {
-    if (0x02 != i2c_write (LPC_I2C0, *val++, 0)) break;
-  }
-  return i;
+  if (l <= 0) return 0;
+  TI2CTrans t = { 0, fNOSTART | fNOSTOP, { 0 }, 0, val, (uint16_t)l };
+  run (&t);
+  return t.count;
 }
 
 //! Receive specified byte length
 bool CI2C::read (void *prxd, int length) {
-  bool result = false;
-  if (length > 0) {
-    if (i2c_wait_stat (LPC_I2C0)) {
-      while (length--) {
-        if ((result = i2c_read (LPC_I2C0, (void *)prxd, length == 0))) {
-          prxd = (void *) ((uint8_t *)prxd + 1);
-        } else break;
-      }
-    }
-  }
-  return result;
+  if (length <= 0) return false;
+  TI2CTrans t = { 0, fNOSTART | fNOSTOP, { 0 }, 0, NULL, 0, (uint8_t *)prxd, (uint16_t)length };
+  return run (&t) == IIC_OK;
 }
 
 //! Check if the device are actually connected.
 bool CI2C::ping (uint8_t addr) {
-  bool b = false;
-  if (begin (addr)) b = end();
-  return b;
+  TI2CTrans t = { addr, 0 };
+  return run (&t) == IIC_OK;
+}
+
+CI2C *CI2C::anchor = NULL;
+
+// I2C0 interrupt routine
+//-----------------------------------
+//! Interrupt handler for I2C0
+//! @note Call from CI2C.
+extern "C" void I2C0_IRQHandler (void) {
+  if (CI2C::anchor != NULL) CI2C::anchor->isr();
 }
@@ -0,0 +1,219 @@
+/*!
+  @file    ud5_i2cpoll.cpp
+  @version 0.9981
+  @brief   Collection of classes for UD5 control
+  @date    2024/9/29
+  @author  T.Uemitsu
+
+  @copyright
+    Copyright (c) BestTechnology CO.,LTD. 2024
+    All rights reserved.
+
+  @par
+   The software is designed to use the minimum number of
+   functions provided by UD5.
+   Although it should be provided in the form of a library,
+   it is provided in the form of a header file in order to
+   lay aside the complexity of its introduction.
+ */
+
+#include "ud5.h"
+
+//=======================================================================
+// I2C polling scheduler
+//=======================================================================
+/*!
+ @brief Periodic I2C register polling class.
+ @note
+   Reads the registers listed in a table at their own periods from one task.
+   The reads due in the same tick are queued together, so CI2C runs them back to back.
+   Each result is published with a timestamp, and skipped periods and bus utilisation are counted.
+ @attention
+   FreeRTOS scheduler must be running to use this class.
+ */
+// Copy the result to dest and update the status
+void CI2CPoll::publish (TPollWork *w, uint8_t result, uint32_t stamp) {
+  const TPollEntry *e = &table[w - work];
+  w->seq++;
+  __DMB();
+  w->st.tick = xTaskGetTickCountFromISR();
+  w->st.stamp = stamp;
+  w->st.result = result;
+  w->st.misses += w->late;
+  w->late = 0;
+  if (result == CI2C::IIC_OK) {
+    __aeabi_memcpy (e->dest, w->rxd, e->len);
+    w->st.count++;
+  } else w->st.errors++;
+  __DMB();
+  w->seq++;
+}
+
+// Completion of each read (called from I2C0 interrupt)
+void CI2CPoll::done (CI2C::TI2CTrans *t, void *arg) {
+  uint32_t stamp = 0x7fffffffUL - LPC_MRT_CH3->TIMER;
+  CI2CPoll *p = static_cast<CI2CPoll *> (arg);
+  p->publish ((TPollWork *)t, t->result, stamp);
+  if (--p->pending == 0) {
+    p->busy_us += ((stamp - p->busy_start) & 0x7fffffffUL) / _USTICK;
+    BaseType_t woken = pdFALSE;
+    vTaskNotifyGiveFromISR (p->poll_task_handle, &woken);
+    portYIELD_FROM_ISR (woken);
+  }
+}
+
+// Poll cycle
+void CI2CPoll::poll_task (void) {
+  portTickType t = xTaskGetTickCount();
+
+  while (!kill_poll_task) {
+    uint32_t now = xTaskGetTickCount();
+    uint8_t n = 0;
+
+    // Entries due in this tick (a late release skips the missed periods)
+    for (int i = 0; i < num; i++) {
+      TPollWork *w = &work[i];
+      if ((int32_t) (now - w->due) < 0) continue;
+      uint32_t period = MAX (table[i].period, 1);
+      uint32_t late = (now - w->due) / period;
+      w->late += late;
+      w->due += (late + 1) * period;
+      w->released = true;
+      n++;
+    }
+
+    if (n > 0) {
+      pI2C->lock_sem();
+      ulTaskNotifyTake (pdTRUE, 0);
+      pending = n;
+      busy_start = 0x7fffffffUL - LPC_MRT_CH3->TIMER;
+      // Queue the whole batch at once, the interrupt chains them without gaps
+      uint32_t us = 0;
+      for (int i = 0; i < num; i++) {
+        TPollWork *w = &work[i];
+        if (!w->released) continue;
+        w->t.cb = done;
+        w->t.arg = this;
+        w->t.task = NULL;
+        pI2C->submit (&w->t);
+        us += pI2C->timeout_us (&w->t);
+      }
+      while (pending > 0) {
+        if (ulTaskNotifyTake (pdTRUE, (us / 1000) + 1) == 0) break;
+      }
+      if (pending > 0) {
+        // Cancel the rest of the batch
+        uint32_t stamp = 0x7fffffffUL - LPC_MRT_CH3->TIMER;
+        for (int i = 0; i < num; i++) {
+          TPollWork *w = &work[i];
+          if (!w->released || w->t.done) continue;
+          if (!pI2C->wait (&w->t, 0)) publish (w, CI2C::IIC_TIMEOUT, stamp);
+        }
+        pending = 0;
+        busy_us += ((stamp - busy_start) & 0x7fffffffUL) / _USTICK;
+      }
+      // A device may still hold the bus
+      bool stuck = false;
+      for (int i = 0; i < num; i++) {
+        if (work[i].released && ((work[i].t.result == CI2C::IIC_TIMEOUT) || (work[i].t.result == CI2C::IIC_BUSERR))) stuck = true;
+        work[i].released = false;
+      }
+      if (stuck) pI2C->recover();
+      pI2C->unlock_sem();
+    }
+
+    vTaskDelayUntil (&t, 1);
+  }
+  poll_task_handle = NULL;
+  vTaskDelete (NULL);
+}
+
+//! i2c:bus, tbl:polling table (kept by the caller), n:number of entries
+CI2CPoll::CI2CPoll (CI2C *i2c, const TPollEntry *tbl, uint8_t n) {
+  pI2C = i2c;
+  table = tbl;
+  num = 0;
+  pending = 0;
+  busy_start = 0;
+  busy_us = 0;
+  window_tick = 0;
+  poll_task_handle = NULL;
+  kill_poll_task = false;
+
+  uint32_t size = 0;
+  for (int i = 0; i < n; i++) size += tbl[i].len;
+  work = (TPollWork *)malloc (n * sizeof (TPollWork));
+  staging = (uint8_t *)malloc (size);
+  if ((work == NULL) || (staging == NULL)) return;
+
+  __aeabi_memclr4 (work, n * sizeof (TPollWork));
+  uint8_t *p = staging;
+  for (int i = 0; i < n; i++) {
+    TPollWork *w = &work[i];
+    w->rxd = p;
+    p += tbl[i].len;
+    w->t.addr = tbl[i].addr;
+    w->t.cmd[0] = tbl[i].reg;
+    w->t.cmdlen = 1;
+    w->t.rxd = w->rxd;
+    w->t.rxlen = tbl[i].len;
+    w->t.done = true;
+  }
+  num = n;
+}
+
+CI2CPoll::~CI2CPoll() {
+  end();
+  free (work);
+  free (staging);
+}
+
+//! Start poll task.
+void CI2CPoll::begin (void) {
+  if ((poll_task_handle == NULL) && (num > 0)) {
+    uint32_t now = xTaskGetTickCount();
+    for (int i = 0; i < num; i++) work[i].due = now;
+    window_tick = now;
+    busy_us = 0;
+    kill_poll_task = false;
+    xTaskCreate ([] (void *arg) { static_cast<CI2CPoll *> (arg)->poll_task(); }, "I2CP", 100, this, 2, &poll_task_handle);
+  }
+}
+
+//! Stop poll task.
+//  Waits for the batch in progress, so that no completion refers to the task.
+void CI2CPoll::end (void) {
+  if (poll_task_handle != NULL) {
+    kill_poll_task = true;
+    while (poll_task_handle != NULL) vTaskDelay (1);
+  }
+}
+
+//! Get the latest data and status of entry i (lock free from tasks, buf:len bytes or NULL)
+bool CI2CPoll::get (uint8_t i, void *buf, TPollStatus *st) {
+  if (i >= num) return false;
+  TPollWork *w = &work[i];
+  uint32_t q;
+  do {
+    q = w->seq;
+    __DMB();
+    if (buf != NULL) __aeabi_memcpy (buf, table[i].dest, table[i].len);
+    if (st != NULL) *st = w->st;
+    __DMB();
+  } while ((q & 1) || (q != w->seq));
+  return w->st.count > 0;
+}
+
+//! Bus utilisation since the previous call [0.1%]
+uint16_t CI2CPoll::get_utilisation (void) {
+  uint32_t now = xTaskGetTickCount();
+  uint32_t primask = __get_PRIMASK();
+  __disable_irq();
+  uint32_t b = busy_us;
+  busy_us = 0;
+  __set_PRIMASK (primask);
+  uint32_t el = now - window_tick;
+  window_tick = now;
+  // busy[us] / (el[ms] * 1000) * 1000
+  return (el > 0) ? MIN (b / el, 1000) : 0;
+}
@@ -0,0 +1,43 @@
+/*!
+  @file    ud5_i2cregmap.cpp
+  @version 0.9981
+  @brief   I2C target register map used by CI2CTarget
+  @date    2024/9/29
+  @author  T.Uemitsu
+
+  @copyright
+    Copyright (c) BestTechnology CO.,LTD. 2024
+    All rights reserved.
+
+  @par
+   Depends only on the C library so that it can be built and tested on a host
+   against a simulated register block.
+ */
+
+#include  <string.h>
+#include  "ud5_i2cregmap.h"
+
+//=======================================================================
+// I2C target register map
+//=======================================================================
+// Commit the data written to the map
+void CI2CRegMap::commit (void) {
+  if (_wlen == 0) return;
+  memcpy (&_map[_wreg], _wbuf, _wlen);
+  _writes++;
+  if (_handler != NULL) _handler (_wreg, _wlen, _handler_arg);
+  _wlen = 0;
+}
+
+//! map:register map of size bytes (up to 256), registers wr_first...wr_first+wr_len-1 are writable
+CI2CRegMap::CI2CRegMap (uint8_t *map, uint16_t size, uint16_t wr_first, uint16_t wr_len) {
+  _map = map;
+  _size = (size < 256) ? size : 256;
+  _wr_first = wr_first;
+  _wr_end = (wr_first + wr_len < _size) ? wr_first + wr_len : _size;
+  _ptr = _rbase = _rpos = _wreg = _wlen = 0;
+  _first = false;
+  _handler = NULL;
+  _handler_arg = NULL;
+  _reads = _writes = 0;
+}
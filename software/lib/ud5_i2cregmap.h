@@ -0,0 +1,140 @@
+/*!
+  @file    ud5_i2cregmap.h
+  @version 0.9981
+  @brief   I2C target register map used by CI2CTarget
+  @date    2024/9/29
+  @author  T.Uemitsu
+
+  @copyright
+    Copyright (c) BestTechnology CO.,LTD. 2024
+    All rights reserved.
+
+  @par
+   Depends only on the C library so that it can be built and tested on a host
+   against a simulated register block.
+ */
+
+#pragma once
+
+#include  <stdint.h>
+#include  <stddef.h>
+#include  <string.h>
+
+//=======================================================================
+// I2C target register map
+//=======================================================================
+/*!
+ @brief Register map served by the slave function of an I2C block.
+ @note
+   The bus master writes the register address followed by data, or writes the register
+   address and reads after a repeated start. The address auto-increments.
+   Up to BURST bytes of a read are taken from a snapshot made at the address match,
+   and the data written is committed to the map at STOP, so bursts are not torn.
+   Only STAT, SLVCTL and SLVDAT of the I2C block are accessed by isr.
+ */
+class CI2CRegMap {
+ public:
+  //! Bytes of a burst kept consistent
+  static const uint8_t BURST = 32;
+
+  //! Called from ISR after the master wrote registers reg...reg+len-1
+  typedef void (*TWriteHandler) (uint8_t reg, uint8_t len, void *arg);
+
+  //! Slave bits of STAT and SLVCTL of the LPC845 I2C
+  static const uint32_t _STAT_SLVPENDING = 1UL << 8;
+  static const uint32_t _STAT_SLVSTATE = 3UL << 9;
+  static const uint32_t _STAT_SLVDESEL = 1UL << 15;
+  static const uint32_t _SLVCTL_CONTINUE = 1UL << 0;
+  static const uint32_t _SLVCTL_NACK = 1UL << 1;
+  //! Slave state in STAT
+  enum { _SLV_ADDR, _SLV_RX, _SLV_TX };
+
+ protected:
+  uint8_t *_map;
+  uint16_t _size;
+  uint16_t _wr_first, _wr_end;   // writable registers
+
+  uint8_t _ptr;                  // register address
+  bool _first;                   // next received byte is the register address
+  uint8_t _snap[BURST];          // read snapshot
+  uint8_t _rbase;                // first register of the read
+  uint8_t _rpos;                 // bytes sent in the read
+  uint8_t _wbuf[BURST];          // data written
+  uint8_t _wreg, _wlen;          // first register and bytes of the write
+
+  TWriteHandler _handler;
+  void *_handler_arg;
+
+  volatile uint32_t _reads, _writes;
+
+  // Commit the data written to the map
+  void commit (void);
+
+ public:
+  //! map:register map of size bytes (up to 256), registers wr_first...wr_first+wr_len-1 are writable
+  CI2CRegMap (uint8_t *map, uint16_t size, uint16_t wr_first, uint16_t wr_len);
+
+  //! Number of read/write transactions from the master
+  uint32_t get_reads (void) { return _reads; }
+  uint32_t get_writes (void) { return _writes; }
+
+  //! State machine on the slave registers of i2c (LPC_I2C_T on the target)
+  template <class T> void isr (T *i2c) {
+    uint32_t stat = i2c->STAT;
+
+    // STOP or addressed to another device
+    if (stat & _STAT_SLVDESEL) {
+      i2c->STAT = _STAT_SLVDESEL;
+      commit();
+    }
+    if (! (stat & _STAT_SLVPENDING)) return;
+
+    switch ((stat & _STAT_SLVSTATE) >> 9) {
+      case _SLV_ADDR:
+        // Repeated start ends the previous write
+        commit();
+        if (i2c->SLVDAT & 1) {
+          // Read from the register address
+          _rbase = _ptr;
+          _rpos = 0;
+          if (_ptr < _size) memcpy (_snap, &_map[_ptr], (_size - _ptr < BURST) ? _size - _ptr : BURST);
+          _reads++;
+        } else _first = true;
+        i2c->SLVCTL = _SLVCTL_CONTINUE;
+        break;
+
+      case _SLV_RX: {
+        uint8_t d = i2c->SLVDAT;
+        if (_first) {
+          // Register address
+          _first = false;
+          _ptr = _wreg = d;
+          i2c->SLVCTL = (d < _size) ? _SLVCTL_CONTINUE : _SLVCTL_NACK;
+        } else {
+          uint16_t reg = _wreg + _wlen;
+          if ((reg >= _wr_first) && (reg < _wr_end) && (_wlen < BURST)) {
+            _wbuf[_wlen++] = d;
+            _ptr = reg + 1;
+            i2c->SLVCTL = _SLVCTL_CONTINUE;
+          } else i2c->SLVCTL = _SLVCTL_NACK;  // read only
+        }
+        break;
+      }
+
+      case _SLV_TX: {
+        uint16_t reg = _rbase + _rpos;
+        if (reg >= _size) i2c->SLVDAT = 0xff;
+        else if (_rpos < BURST) i2c->SLVDAT = _snap[_rpos];
+        else i2c->SLVDAT = _map[reg];
+        _rpos++;
+        _ptr = reg + 1;
+        i2c->SLVCTL = _SLVCTL_CONTINUE;
+        break;
+      }
+
+      default:
+        i2c->SLVCTL = _SLVCTL_NACK;
+        break;
+    }
+  }
+};
@@ -0,0 +1,145 @@
+/*!
+  @file    ud5_i2ctarget.cpp
+  @version 0.9981
+  @brief   Collection of classes for UD5 control
+  @date    2024/9/29
+  @author  T.Uemitsu
+
+  @copyright
+    Copyright (c) BestTechnology CO.,LTD. 2024
+    All rights reserved.
+
+  @par
+   The software is designed to use the minimum number of
+   functions provided by UD5.
+   Although it should be provided in the form of a library,
+   it is provided in the form of a header file in order to
+   lay aside the complexity of its introduction.
+ */
+
+#include "ud5.h"
+
+//=======================================================================
+// I2C target
+//=======================================================================
+/*!
+ @brief I2C target (slave) class with a register map.
+ @note
+   SCL/SDA are assigned to GPIO terminals by the switch matrix (do not use them in CGPIO).
+   The register map protocol is handled by CI2CRegMap in the slave interrupt.
+ */
+CI2CTarget *CI2CTarget::anchor[3] = { NULL, NULL, NULL };
+
+//! State machine (called from I2Cn_IRQHandler)
+void CI2CTarget::isr (void) {
+  CI2CRegMap::isr (_i2c);
+}
+
+//! n:I2C 1...3, scl/sda:GPIO terminal (0...9), addr:7-bit address
+//  map:register map of size bytes (up to 256), registers wr_first...wr_first+wr_len-1 are writable
+CI2CTarget::CI2CTarget (uint8_t n, int8_t scl, int8_t sda, uint8_t addr, uint8_t *map, uint16_t size, uint16_t wr_first, uint16_t wr_len)
+  : CI2CRegMap (map, size, wr_first, wr_len) {
+  uint8_t swm_scl, swm_sda;
+  switch (n) {
+    case 1:
+      _i2c = LPC_I2C1;
+      _irq = I2C1_IRQn;
+      LPC_SYSCON->I2C1CLKSEL = SYSCON_FLEXCOMMCLKSELSRC_MAINCLK;
+      swm_scl = SWM_I2C1_SCL_IO;
+      swm_sda = SWM_I2C1_SDA_IO;
+      break;
+    case 2:
+      _i2c = LPC_I2C2;
+      _irq = I2C2_IRQn;
+      LPC_SYSCON->I2C2CLKSEL = SYSCON_FLEXCOMMCLKSELSRC_MAINCLK;
+      swm_scl = SWM_I2C2_SCL_IO;
+      swm_sda = SWM_I2C2_SDA_IO;
+      break;
+    case 3:
+      _i2c = LPC_I2C3;
+      _irq = I2C3_IRQn;
+      LPC_SYSCON->I2C3CLKSEL = SYSCON_FLEXCOMMCLKSELSRC_MAINCLK;
+      swm_scl = SWM_I2C3_SCL_IO;
+      swm_sda = SWM_I2C3_SDA_IO;
+      break;
+    default:
+      _i2c = NULL;
+      return;
+  }
+  _n = n - 1;
+  if ((map == NULL) || (scl < 0) || (scl > 9) || (sda < 0) || (sda > 9)) {
+    _i2c = NULL;
+    return;
+  }
+
+  // Standard pins need open drain for I2C
+  const TPin pins[2] = {
+    { _term_pio[scl], PIO_TYPE_MOVABLE, swm_scl, PIO_MODE_OPENDRAIN },
+    { _term_pio[sda], PIO_TYPE_MOVABLE, swm_sda, PIO_MODE_OPENDRAIN },
+  };
+  PIO_Configure (pins, PIO_LISTSIZE (pins));
+
+  // SCL is stretched while the interrupt handles each byte
+  Chip_I2C_Init (_i2c);           // Enable I2C clock and reset I2C peripheral
+  Chip_I2C_SetClockDiv (_i2c, 2);
+  Chip_I2CS_SetSlaveAddr (_i2c, 0, addr);
+  Chip_I2CS_EnableSlaveAddr (_i2c, 0);
+  Chip_I2CS_Enable (_i2c);        // Enable Slave Mode
+  anchor[_n] = this;
+  _i2c->INTENSET = I2C_INTENSET_SLVPENDING | I2C_INTENSET_SLVDESEL;
+  NVIC_EnableIRQ (_irq);
+}
+
+CI2CTarget::~CI2CTarget() {
+  if (_i2c == NULL) return;
+  NVIC_DisableIRQ (_irq);
+  Chip_I2C_DeInit (_i2c);
+  anchor[_n] = NULL;
+}
+
+//! Attach handler of writes from the master (NULL to detach)
+void CI2CTarget::set_handler (TWriteHandler h, void *arg) {
+  uint32_t primask = __get_PRIMASK();
+  __disable_irq();
+  _handler_arg = arg;
+  _handler = h;
+  __set_PRIMASK (primask);
+}
+
+//! Update registers (atomic against the master)
+void CI2CTarget::set (uint8_t reg, const void *data, uint16_t len) {
+  if (reg >= _size) return;
+  len = MIN (len, _size - reg);
+  uint32_t primask = __get_PRIMASK();
+  __disable_irq();
+  __aeabi_memcpy (&_map[reg], data, len);
+  __set_PRIMASK (primask);
+}
+
+//! Read registers (atomic against the master)
+void CI2CTarget::get (uint8_t reg, void *buf, uint16_t len) {
+  if (reg >= _size) return;
+  len = MIN (len, _size - reg);
+  uint32_t primask = __get_PRIMASK();
+  __disable_irq();
+  __aeabi_memcpy (buf, &_map[reg], len);
+  __set_PRIMASK (primask);
+}
+
+// I2C1...3 interrupt routine
+//-----------------------------------
+//! Interrupt handler for I2C1
+//! @note Call from CI2CTarget.
+extern "C" void I2C1_IRQHandler (void) {
+  if (CI2CTarget::anchor[0] != NULL) CI2CTarget::anchor[0]->isr();
+}
+//! Interrupt handler for I2C2
+//! @note Call from CI2CTarget.
+extern "C" void I2C2_IRQHandler (void) {
+  if (CI2CTarget::anchor[1] != NULL) CI2CTarget::anchor[1]->isr();
+}
+//! Interrupt handler for I2C3
+//! @note Call from CI2CTarget.
+extern "C" void I2C3_IRQHandler (void) {
+  if (CI2CTarget::anchor[2] != NULL) CI2CTarget::anchor[2]->isr();
+}
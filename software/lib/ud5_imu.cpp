@@ -0,0 +1,253 @@
+/*!
+  @file    ud5_imu.cpp
+  @version 0.9981
+  @brief   Collection of classes for UD5 control
+  @date    2024/9/29
+  @author  T.Uemitsu
+
+  @copyright
+    Copyright (c) BestTechnology CO.,LTD. 2024
+    All rights reserved.
+
+  @par
+   The software is designed to use the minimum number of
+   functions provided by UD5.
+   Although it should be provided in the form of a library,
+   it is provided in the form of a header file in order to
+   lay aside the complexity of its introduction.
+ */
+
+#include "ud5.h"
+
+// LSM6DS3TR-C registers
+#define LSM6_FIFO_CTRL1     (0x06)
+#define LSM6_FIFO_CTRL2     (0x07)
+#define LSM6_FIFO_CTRL3     (0x08)
+#define LSM6_FIFO_CTRL5     (0x0a)
+#define LSM6_INT1_CTRL      (0x0d)
+#define LSM6_WHO_AM_I       (0x0f)
+#define LSM6_CTRL1_XL       (0x10)
+#define LSM6_CTRL2_G        (0x11)
+#define LSM6_CTRL3_C        (0x12)
+#define LSM6_FIFO_STATUS1   (0x3a)
+#define LSM6_FIFO_DATA_OUT  (0x3e)
+
+// LIS3MDL registers (MSB of register address enables auto increment)
+#define LIS3_WHO_AM_I       (0x0f)
+#define LIS3_CTRL_REG1      (0x20)
+#define LIS3_CTRL_REG2      (0x21)
+#define LIS3_CTRL_REG3      (0x22)
+#define LIS3_CTRL_REG4      (0x23)
+#define LIS3_CTRL_REG5      (0x24)
+#define LIS3_OUT_X_L        (0x28 | 0x80)
+
+//=======================================================================
+// IMU
+//=======================================================================
+/*!
+ @brief LSM6DS3TR-C + LIS3MDL IMU class.
+ @note
+   Accelerometer and gyroscope samples are stored in the FIFO of LSM6DS3TR-C and
+   drained in bursts by its own task, so no sample is lost to task scheduling.
+   INT1 (FIFO threshold) wakes the task through PININT, and the edge time is used to
+   timestamp each sample. Without INT1 the FIFO is polled every 1ms.
+   The latest magnetometer data is attached to each sample.
+ @attention
+   FreeRTOS scheduler must be running to use this class.
+ */
+// INT1 rising edge (PININT handler)
+void CIMU::int1 (uint8_t ch, uint32_t tick, void *arg) {
+  CIMU *p = static_cast<CIMU *> (arg);
+  if (!Chip_GPIO_GetPinState (LPC_GPIO_PORT, 0, _term_pio[p->_int_term])) return;
+  p->_edge_stamp = tick;
+  p->_edge = true;
+  if (p->imu_task_handle != NULL) {
+    BaseType_t woken = pdFALSE;
+    vTaskNotifyGiveFromISR (p->imu_task_handle, &woken);
+    portYIELD_FROM_ISR (woken);
+  }
+}
+
+// Write a register
+uint8_t CIMU::write1 (uint8_t addr, uint8_t reg, uint8_t val) {
+  return pI2C->write_reg (addr, reg, &val, 1);
+}
+
+// Drain the FIFO into the ring
+void CIMU::drain (void) {
+  uint8_t st[4];
+  if (pI2C->read_reg (ADDR_LSM6, LSM6_FIFO_STATUS1, st, 4) != CI2C::IIC_OK) return;
+  uint32_t now = 0x7fffffffUL - LPC_MRT_CH3->TIMER;
+  uint16_t words = ((st[1] & 0x07) << 8) | st[0];
+  uint16_t pattern = ((st[3] & 0x03) << 8) | st[2];
+  if (st[1] & 0x40) _overrun++;
+
+  // Realign to the first word of a sample (gyro X)
+  if ((pattern > 0) && (pattern < 6)) {
+    uint8_t skip = 6 - pattern;
+    if ((words < skip) || (pI2C->read_reg (ADDR_LSM6, LSM6_FIFO_DATA_OUT, _buf, skip * 2) != CI2C::IIC_OK)) return;
+    words -= skip;
+  }
+  uint16_t n = words / 6;
+  if (n == 0) return;
+
+  // The FIFO reached the threshold at the edge, otherwise the newest sample is now
+  uint32_t primask = __get_PRIMASK();
+  __disable_irq();
+  bool edge = _edge;
+  uint32_t t0 = edge ? (_edge_stamp - (_thr - 1) * _period) : (now - (n - 1) * _period);
+  _edge = false;
+  __set_PRIMASK (primask);
+
+  for (uint16_t i = 0; i < n;) {
+    uint16_t c = MIN (n - i, CHUNK);
+    // FIFO_DATA_OUT rolls back to itself, so one burst reads many words
+    if (pI2C->read_reg (ADDR_LSM6, LSM6_FIFO_DATA_OUT, _buf, c * 12) != CI2C::IIC_OK) return;
+    for (uint16_t j = 0; j < c; j++) {
+      if ((_head - _tail) >= _ring_size) {
+        _lost++;
+        continue;
+      }
+      TIMUSample *s = &_ring[_head % _ring_size];
+      const uint8_t *b = &_buf[j * 12];
+      s->stamp = (t0 + (i + j) * _period) & 0x7fffffffUL;
+      for (int k = 0; k < 3; k++) {
+        s->gyro[k] = (int16_t) (b[k * 2] | (b[k * 2 + 1] << 8));
+        s->acc[k] = (int16_t) (b[k * 2 + 6] | (b[k * 2 + 7] << 8));
+        s->mag[k] = _mag[k];
+      }
+      __DMB();
+      _head++;
+    }
+    i += c;
+  }
+}
+
+// Sampling cycle
+void CIMU::imu_task (void) {
+  // Twice the time to reach the threshold
+  uint32_t ms = (_int_term >= 0) ? (((2 * _thr * _period) / 32000UL) + 1) : 1;
+
+  while (!kill_imu_task) {
+    ulTaskNotifyTake (pdTRUE, ms);
+    drain();
+    // INT1 stays high while the FIFO filled during the burst is above the threshold
+    if ((_int_term >= 0) && Chip_GPIO_GetPinState (LPC_GPIO_PORT, 0, _term_pio[_int_term])) drain();
+
+    // LIS3MDL at 155Hz
+    uint32_t tick = xTaskGetTickCount();
+    if (_has_mag && ((tick - _mag_tick) >= 6)) {
+      uint8_t b[6];
+      if (pI2C->read_reg (ADDR_LIS3, LIS3_OUT_X_L, b, 6) == CI2C::IIC_OK) {
+        for (int k = 0; k < 3; k++) _mag[k] = (int16_t) (b[k * 2] | (b[k * 2 + 1] << 8));
+      }
+      _mag_tick = tick;
+    }
+  }
+  imu_task_handle = NULL;
+  vTaskDelete (NULL);
+}
+
+//! i2c:bus, gpio/int_term/int_ch:INT1 of LSM6DS3TR-C on GPIO terminal with PININT (NULL:polled)
+//  ring:number of samples buffered
+CIMU::CIMU (CI2C *i2c, CGPIO *gpio, int8_t int_term, uint8_t int_ch, uint16_t ring) {
+  pI2C = i2c;
+  pGpio = gpio;
+  _int_term = ((gpio != NULL) && (int_term >= 0) && (int_term <= 9) && (int_ch < 8)) ? int_term : -1;
+  _int_ch = int_ch;
+  _period = (_USTICK * 1000000UL) / 833;
+  _thr = 1;
+  _edge_stamp = 0;
+  _edge = false;
+  _has_mag = false;
+  __aeabi_memclr (_mag, sizeof (_mag));
+  _mag_tick = 0;
+  _ring_size = MAX (ring, 1);
+  _ring = (TIMUSample *)malloc (_ring_size * sizeof (TIMUSample));
+  _head = _tail = 0;
+  _lost = _overrun = 0;
+  imu_task_handle = NULL;
+  kill_imu_task = false;
+
+  if (_int_term >= 0) {
+    pGpio->set_pinint_handler (_int_ch, int1, this);
+    pGpio->set_config (_int_term, (CGPIO::TPinMode) (CGPIO::tPinINT0_EDGE + _int_ch));
+  }
+}
+
+CIMU::~CIMU() {
+  end();
+  if (_int_term >= 0) pGpio->set_pinint_handler (_int_ch, NULL);
+  free (_ring);
+}
+
+//! Check devices, configure them and start sampling (thr:FIFO threshold [samples])
+bool CIMU::begin (TODR odr, TAccFS afs, TGyroFS gfs, uint16_t thr) {
+  static const uint16_t hz[5] = { 104, 208, 416, 833, 1666 };
+  uint8_t id = 0;
+
+  if ((pI2C == NULL) || (_ring == NULL) || (odr < ODR_104) || (odr > ODR_1660)) return false;
+  if ((pI2C->read_reg (ADDR_LSM6, LSM6_WHO_AM_I, &id, 1) != CI2C::IIC_OK) || (id != 0x6a)) return false;
+  end();
+
+  // FIFO of 2048 words holds 341 samples
+  _thr = MIN (MAX (thr, 1), 256);
+  _period = (_USTICK * 1000000UL) / hz[odr - ODR_104];
+  uint16_t words = _thr * 6;
+
+  write1 (ADDR_LSM6, LSM6_FIFO_CTRL5, 0x00);                 // bypass (clear FIFO)
+  write1 (ADDR_LSM6, LSM6_CTRL3_C, 0x44);                    // BDU, IF_INC
+  write1 (ADDR_LSM6, LSM6_CTRL1_XL, (odr << 4) | (afs << 2));
+  write1 (ADDR_LSM6, LSM6_CTRL2_G, (odr << 4) | (gfs << 2));
+  write1 (ADDR_LSM6, LSM6_FIFO_CTRL1, words & 0xff);         // threshold [words]
+  write1 (ADDR_LSM6, LSM6_FIFO_CTRL2, (words >> 8) & 0x07);
+  write1 (ADDR_LSM6, LSM6_FIFO_CTRL3, 0x09);                 // gyro and accel without decimation
+  write1 (ADDR_LSM6, LSM6_INT1_CTRL, 0x08);                  // INT1 = FIFO threshold
+  write1 (ADDR_LSM6, LSM6_FIFO_CTRL5, (odr << 3) | 0x06);    // continuous mode
+
+  id = 0;
+  _has_mag = (pI2C->read_reg (ADDR_LIS3, LIS3_WHO_AM_I, &id, 1) == CI2C::IIC_OK) && (id == 0x3d);
+  if (_has_mag) {
+    write1 (ADDR_LIS3, LIS3_CTRL_REG1, 0x62);  // ultra-high performance, 155Hz
+    write1 (ADDR_LIS3, LIS3_CTRL_REG2, 0x00);  // +/-4gauss
+    write1 (ADDR_LIS3, LIS3_CTRL_REG4, 0x0c);  // ultra-high performance (Z)
+    write1 (ADDR_LIS3, LIS3_CTRL_REG5, 0x40);  // BDU
+    write1 (ADDR_LIS3, LIS3_CTRL_REG3, 0x00);  // continuous conversion
+  }
+
+  _head = _tail = 0;
+  _lost = _overrun = 0;
+  _edge = false;
+  kill_imu_task = false;
+  xTaskCreate ([] (void *arg) { static_cast<CIMU *> (arg)->imu_task(); }, "IMU", 150, this, 3, &imu_task_handle);
+  return imu_task_handle != NULL;
+}
+
+//! Stop sampling.
+void CIMU::end (void) {
+  if (imu_task_handle != NULL) {
+    kill_imu_task = true;
+    xTaskNotifyGive (imu_task_handle);
+    while (imu_task_handle != NULL) vTaskDelay (1);
+    write1 (ADDR_LSM6, LSM6_FIFO_CTRL5, 0x00);
+  }
+}
+
+//! Number of samples buffered
+uint16_t CIMU::available (void) {
+  return _head - _tail;
+}
+
+//! Get the oldest sample (false:none)
+bool CIMU::get (TIMUSample *s) {
+  if (_head == _tail) return false;
+  *s = _ring[_tail % _ring_size];
+  __DMB();
+  _tail++;
+  return true;
+}
+
+//! Number of samples lost (ring full or FIFO overrun)
+uint32_t CIMU::get_lost (void) {
+  return _lost + _overrun;
+}
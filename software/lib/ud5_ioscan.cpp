@@ -0,0 +1,114 @@
+/*!
+  @file    ud5_ioscan.cpp
+  @version 0.9981
+  @brief   Collection of classes for UD5 control
+  @date    2024/9/29
+  @author  T.Uemitsu
+
+  @copyright
+    Copyright (c) BestTechnology CO.,LTD. 2024
+    All rights reserved.
+
+  @par
+   The software is designed to use the minimum number of
+   functions provided by UD5.
+   Although it should be provided in the form of a library,
+   it is provided in the form of a header file in order to
+   lay aside the complexity of its introduction.
+ */
+
+#include "ud5.h"
+
+//=======================================================================
+// I/O scanner
+//=======================================================================
+/*!
+ @brief Periodic I/O scanner class.
+ @note
+   Samples CGPIO, CEXIO, ADC and encoder counts in its own task and publishes them as one snapshot.
+   The snapshot is double buffered with a sequence counter, so any task or ISR can read
+   the latest state without locking or bus access.
+ @attention
+   FreeRTOS scheduler must be running to use this class.
+ */
+// Scan cycle
+void CIOScan::scan_task (void) {
+  portTickType t = xTaskGetTickCount();
+  TIOSnapshot s;
+  __aeabi_memclr4 (&s, sizeof (TIOSnapshot));
+
+  while (!kill_scan_task) {
+    s.tick = xTaskGetTickCount();
+    s.count++;
+    if (pGpio != NULL) {
+      s.gpio = pGpio->get_gpio();
+      for (int i = 0; i < 10; i++) if (adc_mask & (1 << i)) s.adc[i] = pGpio->get_adc (i);
+      for (int i = 0; i < 2; i++) s.enc[i] = pGpio->get_encoder_count (i);
+    }
+    if (pExio != NULL) s.exio = pExio->get_gpio();
+
+    // Readers use snap[1] while snap[0] is written, and then snap[0] while snap[1] is written
+    seq++;
+    __DMB();
+    snap[0] = s;
+    __DMB();
+    seq++;
+    __DMB();
+    snap[1] = s;
+    __DMB();
+
+    vTaskDelayUntil (&t, period);
+  }
+  scan_task_handle = NULL;
+  vTaskDelete (NULL);
+}
+
+//! g, e:sources (NULL:not sampled), adcmsk:ADC terminals to sample, ms:scan period [ms]
+CIOScan::CIOScan (CGPIO *g, CEXIO *e, uint16_t adcmsk, uint32_t ms) {
+  pGpio = g;
+  pExio = e;
+  adc_mask = adcmsk;
+  period = MAX (ms, 1);
+  seq = 0;
+  __aeabi_memclr4 (snap, sizeof (snap));
+  scan_task_handle = NULL;
+  kill_scan_task = false;
+}
+
+CIOScan::~CIOScan() {
+  end();
+}
+
+//! Start scan task.
+void CIOScan::begin (void) {
+  if (scan_task_handle == NULL) {
+    kill_scan_task = false;
+    xTaskCreate ([] (void *arg) { static_cast<CIOScan *> (arg)->scan_task(); }, "IOSC", 100, this, 1, &scan_task_handle);
+  }
+}
+
+//! Stop scan task.
+void CIOScan::end (void) {
+  if (scan_task_handle != NULL) {
+    // The task may hold the CEXIO mutex, so let it finish the cycle and delete itself
+    kill_scan_task = true;
+    while (scan_task_handle != NULL) vTaskDelay (1);
+  }
+}
+
+//! Set scan period [ms].
+void CIOScan::set_period (uint32_t ms) {
+  period = MAX (ms, 1);
+}
+
+//! Get the latest snapshot (lock free, also from ISR).
+//  An ISR that interrupts the scan task reads the buffer not being written, so it never spins.
+void CIOScan::get (TIOSnapshot *s) {
+  uint32_t q;
+  do {
+    q = seq;
+    __DMB();
+    *s = snap[q & 1];
+    __DMB();
+  } while (q != seq);
+}
@@ -0,0 +1,205 @@
+/*!
+  @file    ud5_mahony.cpp
+  @version 0.9981
+  @brief   Fixed-point Mahony filter used by CAHRS
+  @date    2024/9/29
+  @author  T.Uemitsu
+
+  @copyright
+    Copyright (c) BestTechnology CO.,LTD. 2024
+    All rights reserved.
+
+  @par
+   Depends only on the C library so that it can be built and tested on a host
+   against a double precision reference.
+ */
+
+#include  "ud5_mahony.h"
+
+// Q30 multiply
+#define QMUL(a,b)   ((int32_t) (((int64_t) (a) * (b)) >> 30))
+#define Q30_ONE     (1L << 30)
+
+// atan(2^-i) [0.01deg x 256]
+static const int32_t cordic_tbl[16] = {
+  1152000, 680065, 359328, 182400, 91554, 45822, 22916, 11459,
+  5730, 2865, 1432, 716, 358, 179, 90, 45
+};
+// 1/CORDIC gain (Q30)
+#define CORDIC_INVGAIN  (652032874L)
+
+//=======================================================================
+// Mahony filter
+//=======================================================================
+/*!
+ @brief Fixed-point attitude estimator (Mahony filter).
+ @note
+   The quaternion is kept in Q30 and the angular rate in Q24 [rad/s], so no floating point
+   is used. With magnetic field the heading is absolute, otherwise it drifts with the gyro bias.
+   The magnetometer axes must be aligned with the accelerometer.
+   Euler angles are computed with CORDIC, in 0.01 degrees.
+   No locking is done here, CAHRS adds it for the target.
+ */
+// integer square root
+uint32_t CMahony::isqrt (uint32_t v) {
+  uint32_t r = 0, b = 1UL << 30;
+  while (b > v) b >>= 2;
+  while (b) {
+    if (v >= r + b) {
+      v -= r + b;
+      r = (r >> 1) + b;
+    } else r >>= 1;
+    b >>= 2;
+  }
+  return r;
+}
+
+// normalize a raw vector to Q30 (false if zero)
+bool CMahony::normalize (const int16_t v[3], int32_t n[3]) {
+  // each square is up to 2^30, so the sum fits in 32 bits unsigned
+  uint32_t s = (uint32_t) ((int32_t)v[0] * v[0]) + (uint32_t) ((int32_t)v[1] * v[1]) + (uint32_t) ((int32_t)v[2] * v[2]);
+  if (s == 0) return false;
+  int64_t norm = isqrt (s);
+  for (int i = 0; i < 3; i++) n[i] = (int32_t) (((int64_t)v[i] << 30) / norm);
+  return true;
+}
+
+//! gscale:gyro sensitivity [rad/s/LSB] in Q24, rate:sample rate [Hz]
+CMahony::CMahony (int32_t gscale, uint16_t rate) {
+  _gscale = gscale;
+  set_rate (rate);
+  set_gain (500, 0);
+  reset();
+}
+
+// Set gains (kp, ki:1/1000)
+void CMahony::set_gain (uint16_t kp, uint16_t ki) {
+  _two_kp = ((int32_t)kp << 17) / 1000;
+  _two_ki = ((int32_t)ki << 17) / 1000;
+}
+
+// Set sample rate [Hz]
+void CMahony::set_rate (uint16_t rate) {
+  _dt = Q30_ONE / ((rate > 0) ? rate : 1);
+}
+
+// Level attitude, no heading.
+void CMahony::reset (void) {
+  _q[0] = Q30_ONE;
+  _q[1] = _q[2] = _q[3] = 0;
+  _ifb[0] = _ifb[1] = _ifb[2] = 0;
+}
+
+// Update with raw values
+void CMahony::update (const int16_t gyro[3], const int16_t acc[3], const int16_t mag[3]) {
+  int32_t q0 = _q[0], q1 = _q[1], q2 = _q[2], q3 = _q[3];
+  int32_t g[3], a[3], m[3];
+
+  for (int i = 0; i < 3; i++) g[i] = (int32_t)gyro[i] * _gscale;
+
+  if (normalize (acc, a)) {
+    int32_t q0q0 = QMUL (q0, q0), q0q1 = QMUL (q0, q1), q0q2 = QMUL (q0, q2), q0q3 = QMUL (q0, q3);
+    int32_t q1q1 = QMUL (q1, q1), q1q2 = QMUL (q1, q2), q1q3 = QMUL (q1, q3);
+    int32_t q2q2 = QMUL (q2, q2), q2q3 = QMUL (q2, q3), q3q3 = QMUL (q3, q3);
+    const int32_t half = Q30_ONE / 2;
+
+    // estimated direction of gravity (half)
+    int32_t vx = q1q3 - q0q2, vy = q0q1 + q2q3, vz = q0q0 - half + q3q3;
+    // error is cross product between estimated and measured direction (Q28)
+    int64_t ex = (int64_t)a[1] * vz - (int64_t)a[2] * vy;
+    int64_t ey = (int64_t)a[2] * vx - (int64_t)a[0] * vz;
+    int64_t ez = (int64_t)a[0] * vy - (int64_t)a[1] * vx;
+
+    if (mag && normalize (mag, m)) {
+      // reference direction of earth's magnetic field
+      int32_t hx = (int32_t) (((int64_t)m[0] * (half - q2q2 - q3q3) + (int64_t)m[1] * (q1q2 - q0q3) + (int64_t)m[2] * (q1q3 + q0q2)) >> 29);
+      int32_t hy = (int32_t) (((int64_t)m[0] * (q1q2 + q0q3) + (int64_t)m[1] * (half - q1q1 - q3q3) + (int64_t)m[2] * (q2q3 - q0q1)) >> 29);
+      int32_t bz = (int32_t) (((int64_t)m[0] * (q1q3 - q0q2) + (int64_t)m[1] * (q2q3 + q0q1) + (int64_t)m[2] * (half - q1q1 - q2q2)) >> 29);
+      int32_t bx = (int32_t)isqrt ((uint32_t) ((hx >> 15) * (hx >> 15)) + (uint32_t) ((hy >> 15) * (hy >> 15))) << 15;
+      // estimated direction of magnetic field (half)
+      int32_t wx = QMUL (bx, half - q2q2 - q3q3) + QMUL (bz, q1q3 - q0q2);
+      int32_t wy = QMUL (bx, q1q2 - q0q3) + QMUL (bz, q0q1 + q2q3);
+      int32_t wz = QMUL (bx, q0q2 + q1q3) + QMUL (bz, half - q1q1 - q2q2);
+      ex += (int64_t)m[1] * wz - (int64_t)m[2] * wy;
+      ey += (int64_t)m[2] * wx - (int64_t)m[0] * wz;
+      ez += (int64_t)m[0] * wy - (int64_t)m[1] * wx;
+    }
+    int32_t e[3] = { (int32_t) (ex >> 32), (int32_t) (ey >> 32), (int32_t) (ez >> 32) };
+
+    for (int i = 0; i < 3; i++) {
+      // integral feedback
+      if (_two_ki > 0) {
+        _ifb[i] += (int32_t) (((((int64_t)_two_ki * e[i]) >> 20) * _dt) >> 30);
+        g[i] += _ifb[i];
+      } else _ifb[i] = 0;
+      // proportional feedback
+      g[i] += (int32_t) (((int64_t)_two_kp * e[i]) >> 20);
+    }
+  }
+
+  // integrate rate of change of quaternion
+  for (int i = 0; i < 3; i++) g[i] = (int32_t) (((int64_t)g[i] * (_dt >> 1)) >> 24);
+  _q[0] = q0 + (-QMUL (q1, g[0]) - QMUL (q2, g[1]) - QMUL (q3, g[2]));
+  _q[1] = q1 + (QMUL (q0, g[0]) + QMUL (q2, g[2]) - QMUL (q3, g[1]));
+  _q[2] = q2 + (QMUL (q0, g[1]) - QMUL (q1, g[2]) + QMUL (q3, g[0]));
+  _q[3] = q3 + (QMUL (q0, g[2]) + QMUL (q1, g[1]) - QMUL (q2, g[0]));
+
+  // normalize quaternion (a Newton step is enough since the norm stays close to 1)
+  int64_t n2 = 0;
+  for (int i = 0; i < 4; i++) n2 += QMUL (_q[i], _q[i]);
+  int32_t f = Q30_ONE + (int32_t) ((Q30_ONE - n2) >> 1);
+  for (int i = 0; i < 4; i++) _q[i] = QMUL (_q[i], f);
+}
+
+// atan2 in 0.01 degrees (CORDIC vectoring)
+int32_t CMahony::atan2_cd (int32_t y, int32_t x, int32_t *mag) {
+  int32_t a = 0;
+  // half the inputs so that the CORDIC gain does not overflow
+  x >>= 1;
+  y >>= 1;
+  if (x < 0) {
+    a = (y >= 0) ? (18000L << 8) : -(18000L << 8);
+    x = -x;
+    y = -y;
+  }
+  for (int i = 0; i < 16; i++) {
+    int32_t xn;
+    if (y > 0) {
+      xn = x + (y >> i);
+      y -= x >> i;
+      a += cordic_tbl[i];
+    } else {
+      xn = x - (y >> i);
+      y += x >> i;
+      a -= cordic_tbl[i];
+    }
+    x = xn;
+  }
+  if (mag) *mag = (int32_t) (((int64_t)x * CORDIC_INVGAIN) >> 29);
+  return (a + 128) >> 8;
+}
+
+// Roll, pitch and heading of q [0.01deg]
+void CMahony::to_euler (const int32_t q[4], int32_t *roll, int32_t *pitch, int32_t *heading) {
+  if (roll || pitch) {
+    int32_t c, r;
+    r = atan2_cd (2 * (QMUL (q[0], q[1]) + QMUL (q[2], q[3])), Q30_ONE - 2 * (QMUL (q[1], q[1]) + QMUL (q[2], q[2])), &c);
+    if (roll) *roll = r;
+    // the length of the roll vector is cos(pitch)
+    if (pitch) *pitch = atan2_cd (2 * (QMUL (q[0], q[2]) - QMUL (q[1], q[3])), c);
+  }
+  if (heading) {
+    int32_t h = atan2_cd (2 * (QMUL (q[0], q[3]) + QMUL (q[1], q[2])), Q30_ONE - 2 * (QMUL (q[2], q[2]) + QMUL (q[3], q[3])));
+    *heading = (h < 0) ? h + 36000 : ((h >= 36000) ? h - 36000 : h);
+  }
+}
+
+// Roll, pitch and heading at once [0.01deg]
+void CMahony::get_euler (int32_t *roll, int32_t *pitch, int32_t *heading) {
+  to_euler (_q, roll, pitch, heading);
+}
+
+// Quaternion w, x, y, z (Q30)
+void CMahony::get_quaternion (int32_t q[4]) {
+  for (int i = 0; i < 4; i++) q[i] = _q[i];
+}
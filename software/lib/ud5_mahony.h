@@ -0,0 +1,70 @@
+/*!
+  @file    ud5_mahony.h
+  @version 0.9981
+  @brief   Fixed-point Mahony filter used by CAHRS
+  @date    2024/9/29
+  @author  T.Uemitsu
+
+  @copyright
+    Copyright (c) BestTechnology CO.,LTD. 2024
+    All rights reserved.
+
+  @par
+   Depends only on the C library so that it can be built and tested on a host
+   against a double precision reference.
+ */
+
+#pragma once
+
+#include  <stdint.h>
+#include  <stddef.h>
+
+//=======================================================================
+// Mahony filter
+//=======================================================================
+/*!
+ @brief Fixed-point attitude estimator (Mahony filter).
+ @note
+   The quaternion is kept in Q30 and the angular rate in Q24 [rad/s], so no floating point
+   is used. With magnetic field the heading is absolute, otherwise it drifts with the gyro bias.
+   The magnetometer axes must be aligned with the accelerometer.
+   Euler angles are computed with CORDIC, in 0.01 degrees.
+   No locking is done here, CAHRS adds it for the target.
+ */
+class CMahony {
+ protected:
+  int32_t _q[4];        // quaternion (Q30)
+  int32_t _ifb[3];      // integral feedback (Q24 rad/s)
+  int32_t _gscale;      // rad/s per LSB (Q24)
+  int32_t _dt;          // sample period (Q30 s)
+  int32_t _two_kp;      // 2Kp (Q16)
+  int32_t _two_ki;      // 2Ki (Q16)
+
+  // integer square root
+  static uint32_t isqrt (uint32_t v);
+  // normalize a raw vector to Q30 (false if zero)
+  static bool normalize (const int16_t v[3], int32_t n[3]);
+  // atan2 in 0.01 degrees (mag:CORDIC gain times the length of (x, y))
+  static int32_t atan2_cd (int32_t y, int32_t x, int32_t *mag = NULL);
+  // Roll, pitch and heading of q [0.01deg]
+  static void to_euler (const int32_t q[4], int32_t *roll, int32_t *pitch, int32_t *heading);
+
+ public:
+  //! gscale:gyro sensitivity [rad/s/LSB] in Q24, rate:sample rate [Hz]
+  CMahony (int32_t gscale, uint16_t rate);
+
+  //! Set gains (kp, ki:1/1000)
+  void set_gain (uint16_t kp, uint16_t ki);
+  //! Set sample rate [Hz]
+  void set_rate (uint16_t rate);
+  //! Level attitude, no heading.
+  void reset (void);
+
+  //! Update with one sample (raw values, mag:NULL or all zero for 6 axis)
+  void update (const int16_t gyro[3], const int16_t acc[3], const int16_t mag[3] = NULL);
+
+  //! Roll, pitch and heading at once [0.01deg]
+  void get_euler (int32_t *roll, int32_t *pitch, int32_t *heading);
+  //! Quaternion w, x, y, z (Q30)
+  void get_quaternion (int32_t q[4]);
+};
@@ -0,0 +1,129 @@
+/*!
+  @file    ud5_nvm.cpp
+  @version 0.9981
+  @brief   Collection of classes for UD5 control
+  @date    2024/9/29
+  @author  T.Uemitsu
+
+  @copyright
+    Copyright (c) BestTechnology CO.,LTD. 2024
+    All rights reserved.
+
+  @par
+   The software is designed to use the minimum number of
+   functions provided by UD5.
+   Although it should be provided in the form of a library,
+   it is provided in the form of a header file in order to
+   lay aside the complexity of its introduction.
+ */
+
+#include "ud5.h"
+
+//=======================================================================
+// Parameter store
+//=======================================================================
+/*!
+ @brief Wear-levelled key/value parameter store on flash.
+ @note
+   CParamLog on the flash of LPC845, programmed by IAP and guarded by a mutex.
+   The default region 0xf400-0xfbff is the .paramstore section. The sample makefile places it at 0xf400
+   and leaves it out of the binary, so the linker reports an overlap when the program grows into it.
+ */
+// Default region (erased state, in case it is written out with the program)
+static_assert (CParamStore::_REGION_SECTORS * CParamStore::_SECTOR_SIZE == 2048, "size of .paramstore");
+asm (
+  ".section .paramstore,\"a\"\n"
+  ".balign 1024\n"
+  ".global _paramstore_region\n"
+  "_paramstore_region:\n"
+  ".fill 2048, 1, 0xff\n"
+  ".previous\n");
+extern "C" const uint8_t _paramstore_region[];
+
+// Erase one page by IAP
+static bool iap_erase_page (uint32_t addr) {
+  uint32_t sec = addr / CParamStore::_SECTOR_SIZE, pg = addr / CParamStore::_PAGE_SIZE;
+  uint32_t primask = __get_PRIMASK();
+  __disable_irq();
+  bool r = (Chip_IAP_PreSectorForReadWrite (sec, sec) == IAP_CMD_SUCCESS) && (Chip_IAP_ErasePage (pg, pg) == IAP_CMD_SUCCESS);
+  __set_PRIMASK (primask);
+  return r;
+}
+
+// Program one page by IAP
+static bool iap_write_page (uint32_t addr, const uint32_t *src) {
+  uint32_t sec = addr / CParamStore::_SECTOR_SIZE;
+  uint32_t primask = __get_PRIMASK();
+  __disable_irq();
+  bool r = (Chip_IAP_PreSectorForReadWrite (sec, sec) == IAP_CMD_SUCCESS) && (Chip_IAP_CopyRamToFlash (addr, (uint32_t *)src, CParamStore::_PAGE_SIZE) == IAP_CMD_SUCCESS);
+  __set_PRIMASK (primask);
+  return r;
+}
+
+// Flash is memory mapped
+static const uint8_t *iap_map (uint32_t addr) {
+  return (const uint8_t *)addr;
+}
+
+const CParamStore::TFlashIF CParamStore::flash_iap = { iap_erase_page, iap_write_page, iap_map };
+
+void CParamStore::lock (void) {
+  if ((xTaskGetSchedulerState() == taskSCHEDULER_RUNNING)) xSemaphoreTake (_mutex, portMAX_DELAY);
+}
+
+void CParamStore::unlock (void) {
+  if ((xTaskGetSchedulerState() == taskSCHEDULER_RUNNING)) xSemaphoreGive (_mutex);
+}
+
+//! addr:top of region (sector aligned, 0:the reserved region), sec:number of sectors (2 or more), f:flash access (NULL:IAP)
+CParamStore::CParamStore (uint32_t addr, uint8_t sec, const TFlashIF *f) :
+  CParamLog ((addr != 0) ? addr : (uint32_t)_paramstore_region, (addr != 0) ? sec : _REGION_SECTORS, (f != NULL) ? f : &flash_iap) {
+  _mutex = xSemaphoreCreateMutex();
+  anchor = this;
+}
+
+CParamStore::~CParamStore () {
+  vSemaphoreDelete (_mutex);
+  anchor = NULL;
+}
+
+//! Read data of key up to size bytes (false:not stored)
+bool CParamStore::read (uint16_t key, void *dat, uint16_t size) {
+  lock();
+  bool result = CParamLog::read (key, dat, size);
+  unlock();
+  return result;
+}
+
+//! Write data of key (the previous data stays valid until the new record is complete)
+bool CParamStore::write (uint16_t key, const void *dat, uint16_t size) {
+  lock();
+  bool result = CParamLog::write (key, dat, size);
+  unlock();
+  return result;
+}
+
+//! Remove key
+bool CParamStore::remove (uint16_t key) {
+  lock();
+  bool result = CParamLog::remove (key);
+  unlock();
+  return result;
+}
+
+//! Size of data of key (-1:not stored)
+int32_t CParamStore::size_of (uint16_t key) {
+  lock();
+  int32_t result = CParamLog::size_of (key);
+  unlock();
+  return result;
+}
+
+//! Erase all records
+void CParamStore::format (void) {
+  lock();
+  CParamLog::format();
+  unlock();
+}
+
+CParamStore *CParamStore::anchor = NULL;
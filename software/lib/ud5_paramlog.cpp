@@ -0,0 +1,210 @@
+/*!
+  @file    ud5_paramlog.cpp
+  @version 0.9981
+  @brief   Flash record log used by CParamStore
+  @date    2024/9/29
+  @author  T.Uemitsu
+
+  @copyright
+    Copyright (c) BestTechnology CO.,LTD. 2024
+    All rights reserved.
+
+  @par
+   Depends only on the C library so that it can be built and tested on a host
+   against a simulated flash array.
+ */
+
+#include  <string.h>
+#include  "ud5_paramlog.h"
+
+//=======================================================================
+// Parameter log
+//=======================================================================
+/*!
+ @brief Wear-levelled key/value record log on flash.
+ @note
+   Records are appended to a log that rotates through the reserved sectors.
+   Only the sector about to be reused is erased, after its live records have been moved.
+   Flash is accessed page by page through TFlashIF.
+   No locking is done here, CParamStore adds it for the target.
+ */
+// CRC-16/CCITT without table
+static uint16_t crc16 (uint16_t crc, const uint8_t *p, uint32_t n) {
+  while (n--) {
+    crc ^= (uint16_t)*p++ << 8;
+    for (int i = 0; i < 8; i++) crc = (crc & 0x8000) ? (crc << 1) ^ 0x1021 : (crc << 1);
+  }
+  return crc;
+}
+
+// Check that the page is erased
+bool CParamLog::page_erased (uint16_t pg) {
+  const uint8_t *p = fif->map (base + pg * _PAGE_SIZE);
+  for (uint32_t i = 0; i < _PAGE_SIZE; i++) if (p[i] != 0xff) return false;
+  return true;
+}
+
+// Check the record at pg and returns the number of pages (0:invalid)
+uint16_t CParamLog::check_record (uint16_t pg, TRecHeader *h) {
+  const uint8_t *p = fif->map (base + pg * _PAGE_SIZE);
+  memcpy (h, p, sizeof (TRecHeader));
+  if ((h->magic != _MAGIC) || (h->key >= _MAX_KEYS) || (h->len > _MAX_DATA)) return 0;
+  // A record never crosses a sector
+  uint16_t n = record_pages (h->len), ppsec = _SECTOR_SIZE / _PAGE_SIZE;
+  if ((pg % ppsec) + n > ppsec) return 0;
+  uint16_t crc = crc16 (0xffff, p, offsetof (TRecHeader, crc));
+  crc = crc16 (crc, p + sizeof (TRecHeader), h->len);
+  return (crc == h->crc) ? n : 0;
+}
+
+// Append a record at head
+bool CParamLog::append (uint16_t key, const void *dat, uint16_t len) {
+  uint16_t n = record_pages (len), pg = head;
+  TRecHeader h = { _MAGIC, key, seq + 1, len, 0 };
+
+  // The source may be in the region, so copy it before programming
+  memset (pagebuf, 0xff, sizeof (pagebuf));
+  memcpy (pagebuf, &h, sizeof (TRecHeader));
+  if (len > 0) memcpy ((uint8_t *)pagebuf + sizeof (TRecHeader), dat, len);
+  h.crc = crc16 (crc16 (0xffff, (uint8_t *)pagebuf, offsetof (TRecHeader, crc)), (uint8_t *)pagebuf + sizeof (TRecHeader), len);
+  memcpy (pagebuf, &h, sizeof (TRecHeader));
+
+  // Pages are consumed even if programming fails
+  head += n;
+  seq++;
+  for (uint16_t i = 0; i < n; i++)
+    if (!fif->write_page (base + (pg + i) * _PAGE_SIZE, &pagebuf[i * _PAGE_SIZE / 4])) return false;
+
+  // Read back, then the record replaces the previous one
+  if (check_record (pg, &h) != n) return false;
+  index[key].page = pg;
+  index[key].len = len;
+  index[key].seq = seq;
+  return true;
+}
+
+// Move head to the next sector and reclaim the one after it
+bool CParamLog::advance (void) {
+  uint16_t ppsec = _SECTOR_SIZE / _PAGE_SIZE;
+  uint16_t sec = (head / ppsec + ((head % ppsec) != 0 ? 1 : 0)) % sectors;
+  head = sec * ppsec;
+  return reclaim ((sec + 1) % sectors);
+}
+
+// Move live records out of the sector and erase it
+bool CParamLog::reclaim (uint16_t sec) {
+  uint16_t ppsec = _SECTOR_SIZE / _PAGE_SIZE;
+  bool result = true;
+  for (uint16_t k = 0; k < _MAX_KEYS; k++) {
+    if ((index[k].page == _NONE) || ((index[k].page / ppsec) != sec)) continue;
+    // A removed key is forgotten since all older records are in this sector
+    if (index[k].len == 0) {
+      index[k].page = _NONE;
+      continue;
+    }
+    if (((head % ppsec) + record_pages (index[k].len)) > ppsec) return false;
+    result &= append (k, fif->map (base + index[k].page * _PAGE_SIZE + sizeof (TRecHeader)), index[k].len);
+  }
+  for (uint16_t pg = sec * ppsec; pg < (sec + 1) * ppsec; pg++)
+    if (!page_erased (pg)) result &= fif->erase_page (base + pg * _PAGE_SIZE);
+  return result;
+}
+
+// Build index and find head
+void CParamLog::mount (void) {
+  uint16_t ppsec = _SECTOR_SIZE / _PAGE_SIZE;
+  int32_t last = -1;
+  TRecHeader h;
+
+  for (uint16_t k = 0; k < _MAX_KEYS; k++) index[k].page = _NONE;
+  seq = 0;
+  for (uint16_t pg = 0; pg < pages;) {
+    uint16_t n = check_record (pg, &h);
+    if (n == 0) {
+      pg++;
+      continue;
+    }
+    if ((index[h.key].page == _NONE) || (h.seq > index[h.key].seq)) {
+      index[h.key].page = pg;
+      index[h.key].len = h.len;
+      index[h.key].seq = h.seq;
+    }
+    if (h.seq > seq) {
+      seq = h.seq;
+      last = pg + n;
+    }
+    pg += n;
+  }
+
+  if (last < 0) {
+    format();
+    return;
+  }
+
+  // Skip pages left by an interrupted write after the newest record
+  head = last;
+  while (((head % ppsec) != 0) && !page_erased (head)) head++;
+  head %= pages;
+
+  // Finish a reclaim interrupted by power loss
+  uint16_t next = (head / ppsec + 1) % sectors;
+  for (uint16_t pg = next * ppsec; pg < (next + 1) * ppsec; pg++) {
+    if (!page_erased (pg)) {
+      reclaim (next);
+      break;
+    }
+  }
+}
+
+//! addr:top of region (sector aligned), sec:number of sectors (2 or more), f:flash access
+CParamLog::CParamLog (uint32_t addr, uint8_t sec, const TFlashIF *f) {
+  fif = f;
+  base = addr;
+  sectors = (sec > 2) ? sec : 2;
+  pages = sectors * (_SECTOR_SIZE / _PAGE_SIZE);
+  mount();
+}
+
+//! Read data of key up to size bytes (false:not stored)
+bool CParamLog::read (uint16_t key, void *dat, uint16_t size) {
+  if ((key >= _MAX_KEYS) || (index[key].page == _NONE) || (index[key].len == 0)) return false;
+  memcpy (dat, fif->map (base + index[key].page * _PAGE_SIZE + sizeof (TRecHeader)), (size < index[key].len) ? size : index[key].len);
+  return true;
+}
+
+//! Write data of key (the previous data stays valid until the new record is complete)
+bool CParamLog::write (uint16_t key, const void *dat, uint16_t size) {
+  uint16_t ppsec = _SECTOR_SIZE / _PAGE_SIZE;
+  if ((key >= _MAX_KEYS) || (size > _MAX_DATA)) return false;
+
+  // Live records must fit in one sector together with a record being moved
+  uint16_t n = record_pages (size), live = n;
+  for (uint16_t k = 0; k < _MAX_KEYS; k++)
+    if ((k != key) && (index[k].page != _NONE)) live += record_pages (index[k].len);
+  if ((live + _MAX_PAGES) > ppsec) return false;
+
+  // Entering a new sector reclaims the one after it
+  if ((((head % ppsec) == 0) || ((head % ppsec) + n > ppsec)) && !advance()) return false;
+  return append (key, dat, size);
+}
+
+//! Remove key
+bool CParamLog::remove (uint16_t key) {
+  if ((key >= _MAX_KEYS) || (index[key].page == _NONE) || (index[key].len == 0)) return true;
+  return write (key, NULL, 0);
+}
+
+//! Size of data of key (-1:not stored)
+int32_t CParamLog::size_of (uint16_t key) {
+  if ((key >= _MAX_KEYS) || (index[key].page == _NONE) || (index[key].len == 0)) return -1;
+  return index[key].len;
+}
+
+//! Erase all records
+void CParamLog::format (void) {
+  for (uint16_t pg = 0; pg < pages; pg++)
+    if (!page_erased (pg)) fif->erase_page (base + pg * _PAGE_SIZE);
+  for (uint16_t k = 0; k < _MAX_KEYS; k++) index[k].page = _NONE;
+  head = 0;
+  seq = 0;
+}
@@ -0,0 +1,118 @@
+/*!
+  @file    ud5_paramlog.h
+  @version 0.9981
+  @brief   Flash record log used by CParamStore
+  @date    2024/9/29
+  @author  T.Uemitsu
+
+  @copyright
+    Copyright (c) BestTechnology CO.,LTD. 2024
+    All rights reserved.
+
+  @par
+   Depends only on the C library so that it can be built and tested on a host
+   against a simulated flash array.
+ */
+
+#pragma once
+
+#include  <stdint.h>
+#include  <stddef.h>
+
+//=======================================================================
+// Parameter log
+//=======================================================================
+/*!
+ @brief Wear-levelled key/value record log on flash.
+ @note
+   Records are appended to a log that rotates through the reserved sectors.
+   Only the sector about to be reused is erased, after its live records have been moved.
+   Flash is accessed page by page through TFlashIF.
+   No locking is done here, CParamStore adds it for the target.
+ */
+class CParamLog {
+ public:
+  //! Flash page and sector size
+  static const uint32_t _PAGE_SIZE = 64;
+  static const uint32_t _SECTOR_SIZE = 1024;
+
+  //! Number of keys and maximum data size per key
+  static const uint16_t _MAX_KEYS = 32;
+  static const uint16_t _MAX_PAGES = 4;
+  static const uint16_t _MAX_DATA = _PAGE_SIZE * _MAX_PAGES - 12;
+
+  //! Keys
+  enum {
+    keyRCCal = 1,     //!< calibration of CRCStick
+    keyPIDGain,       //!< PID gains
+    keyMotorDir,      //!< motor directions
+    keyMotorMaxDuty,  //!< motor maximum duty
+    keyUser = 16,     //!< first key for application
+  };
+
+  //! Flash access functions
+  //  Each function keeps interrupts disabled only while one page is processed.
+  typedef struct {
+    bool (*erase_page) (uint32_t addr);                       //!< erase one page
+    bool (*write_page) (uint32_t addr, const uint32_t *src);  //!< program one erased page
+    const uint8_t *(*map) (uint32_t addr);                    //!< pointer for reading addr
+  } TFlashIF;
+
+ private:
+  // Record header at the top of the first page
+  typedef struct {
+    uint16_t magic;
+    uint16_t key;
+    uint32_t seq;
+    uint16_t len;   // 0:removed
+    uint16_t crc;   // CRC-16/CCITT of header before crc and data
+  } TRecHeader;
+  static const uint16_t _MAGIC = 0x5053;
+  static const uint16_t _NONE = 0xffff;
+
+  // Newest record for each key
+  typedef struct {
+    uint16_t page;  // page number in region
+    uint16_t len;
+    uint32_t seq;
+  } TIndex;
+  TIndex index[_MAX_KEYS];
+
+  const TFlashIF *fif;
+  uint32_t base;      // top address of region
+  uint16_t sectors;   // number of sectors in region
+  uint16_t pages;     // number of pages in region
+  uint16_t head;      // page to be written next
+  uint32_t seq;       // sequence number of the newest record
+  uint32_t pagebuf[_PAGE_SIZE * _MAX_PAGES / 4];
+
+  // Number of pages used by a record of len bytes
+  uint16_t record_pages (uint16_t len) { return (sizeof (TRecHeader) + len + _PAGE_SIZE - 1) / _PAGE_SIZE; }
+  // Check that the page is erased
+  bool page_erased (uint16_t pg);
+  // Check the record at pg and returns the number of pages (0:invalid)
+  uint16_t check_record (uint16_t pg, TRecHeader *h);
+  // Append a record at head
+  bool append (uint16_t key, const void *dat, uint16_t len);
+  // Move head to the next sector and reclaim the one after it
+  bool advance (void);
+  // Move live records out of the sector and erase it
+  bool reclaim (uint16_t sec);
+  // Build index and find head
+  void mount (void);
+
+ public:
+  //! addr:top of region (sector aligned), sec:number of sectors (2 or more), f:flash access
+  CParamLog (uint32_t addr, uint8_t sec, const TFlashIF *f);
+
+  //! Read data of key up to size bytes (false:not stored)
+  bool read (uint16_t key, void *dat, uint16_t size);
+  //! Write data of key (the previous data stays valid until the new record is complete)
+  bool write (uint16_t key, const void *dat, uint16_t size);
+  //! Remove key
+  bool remove (uint16_t key);
+  //! Size of data of key (-1:not stored)
+  int32_t size_of (uint16_t key);
+  //! Erase all records
+  void format (void);
+};
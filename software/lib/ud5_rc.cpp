@@ -27,17 +27,25 @@
  @note
    Use CGPIO class pulse width measurement.
  */
-// Interpolation
-int32_t CRCStick::_INTERP (int32_t xi, int32_t xj, int32_t yi, int32_t yj, int32_t x) {
-  return yi + (((yj - yi) * (x - xi)) / (xj - xi));
+// Make normalization parameters
+void CRCStick::make_norm (uint8_t ch, uint32_t key, TNormParam *p) {
+  int32_t per_neu = key & 0xff, per_ul = key >> 8;
+  p->x0 = caldata[ch].neutral - ((caldata[ch].neutral - caldata[ch].min) * (100 - per_ul)) / 100;
+  p->x1 = caldata[ch].neutral - ((caldata[ch].neutral - caldata[ch].min) * per_neu) / 100;
+  p->x3 = caldata[ch].neutral + ((caldata[ch].max - caldata[ch].neutral) * per_neu) / 100;
+  p->x4 = caldata[ch].neutral + ((caldata[ch].max - caldata[ch].neutral) * (100 - per_ul)) / 100;
+  p->k_lo = (p->x1 > p->x0) ? (1000 << 16) / (p->x1 - p->x0) : 0;
+  p->k_hi = (p->x4 > p->x3) ? (1000 << 16) / (p->x4 - p->x3) : 0;
+  p->key = key;
 }
 
-int CRCStick::interp1dim (const int32_t x, const int32_t *ar, const int32_t w) {
-  int i;
-  if (x <= ar[0]) return ar[w];
-  else if (x >= ar[w - 1]) return ar[w * 2 - 1];
-  for (i = 1; i < w; i++) if (ar[i] >= x) break;
-  return _INTERP (ar[i - 1], ar[i], ar[i + w - 1], ar[i + w], x);
+// Discard all normalization parameters
+void CRCStick::clear_norm (void) {
+  for (int i = 0; i < 8; i++) {
+    norm_seq[i]++;
+    norm[i].key = UINT32_MAX;
+    norm_seq[i]++;
+  }
 }
 
 // moving mean
@@ -74,10 +82,15 @@ void CRCStick::_play (uint8_t t, uint32_t w) {
   }
 }
 
-CRCStick::CRCStick (CGPIO *g) {
+CRCStick::CRCStick (CGPIO *g, CParamStore *p) {
   cgpio = g;
+  // Reject glitches and detect loss of signal for every receiver channel
+  for (int i = 0; i < 8; i++) cgpio->set_pwd_filter (i, _PULSE_MIN, _PULSE_MAX, _PULSE_TIMEOUT);
   // Reads calibrated data from NVM
-  __aeabi_memcpy4 (&caldata, (void *)_EEPROM_ADDR, sizeof (Tcaldata));
+  nvm = (p != NULL) ? p : CParamStore::anchor;
+  if ((nvm == NULL) || !nvm->read (CParamStore::keyRCCal, &caldata, sizeof (Tcaldata)))
+    __aeabi_memcpy4 (&caldata, (void *)_EEPROM_ADDR, sizeof (Tcaldata));
+  clear_norm();
 };
 
 //! Calibration
@@ -163,14 +176,20 @@ void CRCStick::calibration (bool (*f_nextstep) (void), void (*f_mon) (const char
   }
   _led (0);
 
+  clear_norm();
+
   // step 4. Write measurement results to NVM
-  vTaskSuspendAll();
-  taskDISABLE_INTERRUPTS();
-  taskENTER_CRITICAL();
-  FLASH_Write (_EEPROM_ADDR, (uint8_t *)&caldata, sizeof (Tcaldata));
-  taskEXIT_CRITICAL();
-  taskENABLE_INTERRUPTS();
-  xTaskResumeAll();
+  if (nvm == NULL) nvm = CParamStore::anchor;
+  if (nvm != NULL) nvm->write (CParamStore::keyRCCal, &caldata, sizeof (Tcaldata));
+  else {
+    vTaskSuspendAll();
+    taskDISABLE_INTERRUPTS();
+    taskENTER_CRITICAL();
+    FLASH_Write (_EEPROM_ADDR, (uint8_t *)&caldata, sizeof (Tcaldata));
+    taskEXIT_CRITICAL();
+    taskENABLE_INTERRUPTS();
+    xTaskResumeAll();
+  }
   _play (55, 80);
   _play (52, 80);
   _play (48, 80);
@@ -182,14 +201,42 @@ void CRCStick::get_calibration (Tcaldata *pcal) {
 }
 
 //! Normalize pulses to -1000...1000 (per_new: neutral, per_ul: % of deadband to measured full scale at both ends)
-int32_t CRCStick::get_normal (uint8_t ch, int32_t per_neu, int32_t per_ul) {
-  static int32_t rc_1d[10] = {0, 0, 0, 0, 0, -1000, 0, 0, 0, 1000};
-  per_ul = MIN (MAX (per_ul, 0), 50);
-  per_neu = MIN (MAX (per_neu, 0), 50);
-  rc_1d[0] = caldata[ch].neutral - ((caldata[ch].neutral - caldata[ch].min) * (100 - per_ul)) / 100;
-  rc_1d[1] = caldata[ch].neutral - ((caldata[ch].neutral - caldata[ch].min) * per_neu) / 100;
-  rc_1d[2] = caldata[ch].neutral;
-  rc_1d[3] = caldata[ch].neutral + ((caldata[ch].max - caldata[ch].neutral) * per_neu) / 100;
-  rc_1d[4] = caldata[ch].neutral + ((caldata[ch].max - caldata[ch].neutral) * (100 - per_ul)) / 100;
-  return interp1dim (cgpio->get_pwd (ch), rc_1d, 5);
-};
+//  The parameters are made only when the deadband or calibration changes, and read without locking.
+int32_t CRCStick::get_normal (uint8_t ch, int32_t per_neu, int32_t per_ul, bool *failsafe) {
+  if (ch > 7) return 0;
+  bool lost = get_failsafe (ch);
+  if (failsafe != NULL) *failsafe = lost;
+  if (lost) return 0;
+
+  uint32_t key = MIN (MAX (per_neu, 0), 50) | (MIN (MAX (per_ul, 0), 50) << 8);
+  TNormParam p;
+  uint32_t seq;
+  do {
+    seq = norm_seq[ch];
+    __DMB();
+    p = norm[ch];
+    __DMB();
+  } while ((seq & 1) || (seq != norm_seq[ch]));
+
+  if (p.key != key) {
+    make_norm (ch, key, &p);
+    uint32_t primask = __get_PRIMASK();
+    __disable_irq();
+    norm_seq[ch]++;
+    norm[ch] = p;
+    norm_seq[ch]++;
+    __set_PRIMASK (primask);
+  }
+
+  int32_t x = cgpio->get_pwd (ch);
+  if (x <= p.x0) return -1000;
+  if (x < p.x1) return -1000 + (((x - p.x0) * p.k_lo) >> 16);
+  if (x <= p.x3) return 0;
+  if (x < p.x4) return ((x - p.x3) * p.k_hi) >> 16;
+  return 1000;
+}
+
+//! Check if the signal of ch is lost
+bool CRCStick::get_failsafe (uint8_t ch) {
+  return !cgpio->get_pwd_alive (ch);
+}
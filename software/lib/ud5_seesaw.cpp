@@ -0,0 +1,292 @@
+/*!
+  @file    ud5_seesaw.cpp
+  @version 0.9981
+  @brief   Collection of classes for UD5 control
+  @date    2024/9/29
+  @author  T.Uemitsu
+
+  @copyright
+    Copyright (c) BestTechnology CO.,LTD. 2024
+    All rights reserved.
+
+  @par
+   The software is designed to use the minimum number of
+   functions provided by UD5.
+   Although it should be provided in the form of a library,
+   it is provided in the form of a header file in order to
+   lay aside the complexity of its introduction.
+ */
+
+#include "ud5.h"
+
+// Module base addresses
+#define SEESAW_STATUS_BASE      (0x00)
+#define SEESAW_GPIO_BASE        (0x01)
+#define SEESAW_NEOPIXEL_BASE    (0x0e)
+#define SEESAW_ENCODER_BASE     (0x11)
+
+// Status registers
+#define SEESAW_STATUS_HW_ID     (0x01)
+#define SEESAW_STATUS_VERSION   (0x02)
+#define SEESAW_STATUS_SWRST     (0x7f)
+
+// GPIO registers
+#define SEESAW_GPIO_DIRSET_BULK (0x02)
+#define SEESAW_GPIO_DIRCLR_BULK (0x03)
+#define SEESAW_GPIO_BULK        (0x04)
+#define SEESAW_GPIO_BULK_SET    (0x05)
+#define SEESAW_GPIO_BULK_CLR    (0x06)
+#define SEESAW_GPIO_PULLENSET   (0x0b)
+
+// Encoder registers (plus encoder number)
+#define SEESAW_ENCODER_POSITION (0x30)
+#define SEESAW_ENCODER_DELTA    (0x40)
+
+// NeoPixel registers
+#define SEESAW_NEOPIXEL_PIN     (0x01)
+#define SEESAW_NEOPIXEL_SPEED   (0x02)
+#define SEESAW_NEOPIXEL_BUF_LENGTH (0x03)
+#define SEESAW_NEOPIXEL_BUF     (0x04)
+#define SEESAW_NEOPIXEL_SHOW    (0x05)
+
+// Seesaw registers are big endian
+static uint32_t get_be32 (const uint8_t *p) {
+  return ((uint32_t)p[0] << 24) | ((uint32_t)p[1] << 16) | ((uint32_t)p[2] << 8) | p[3];
+}
+static void set_be32 (uint8_t *p, uint32_t v) {
+  p[0] = v >> 24;
+  p[1] = v >> 16;
+  p[2] = v >> 8;
+  p[3] = v;
+}
+
+//=======================================================================
+// Seesaw
+//=======================================================================
+/*!
+ @brief Adafruit Seesaw device class (GPIO, encoder and NeoPixel).
+ @note
+   Reading a Seesaw register needs a delay between writing the register address and
+   reading the data. The bus is released during the delay, so other bus users are not blocked.
+   read_multi() writes the addresses of several devices back to back, waits once and reads
+   them back to back, so the delay is shared by the whole batch.
+ */
+//! i2c:bus, addr:7-bit address, delay:read delay [us]
+CSeesaw::CSeesaw (CI2C *i2c, uint8_t addr, uint16_t delay) {
+  pI2C = i2c;
+  _addr = addr;
+  _delay = delay;
+  _pixels = 0;
+}
+
+//! Reset the device and check the hardware ID.
+bool CSeesaw::begin (void) {
+  write (SEESAW_STATUS_BASE, SEESAW_STATUS_SWRST, (const uint8_t[1]) { 0xff }, 1);
+  // The device does not answer while it restarts
+  for (int i = 0; i < 10; i++) {
+    UD5_WAIT (10);
+    switch (get_hwid()) {
+      case 0x55:  // SAMD09
+      case 0x84:  // ATtiny806
+      case 0x85:  // ATtiny807
+      case 0x86:  // ATtiny816
+      case 0x87:  // ATtiny817
+      case 0x88:  // ATtiny1616
+      case 0x89:  // ATtiny1617
+        return true;
+    }
+  }
+  return false;
+}
+
+//! Hardware ID (0:no response)
+uint8_t CSeesaw::get_hwid (void) {
+  uint8_t id = 0;
+  if (read (SEESAW_STATUS_BASE, SEESAW_STATUS_HW_ID, &id, 1) != CI2C::IIC_OK) return 0;
+  return id;
+}
+
+//! Product code and date code
+uint32_t CSeesaw::get_version (void) {
+  uint8_t buf[4];
+  if (read (SEESAW_STATUS_BASE, SEESAW_STATUS_VERSION, buf, 4) != CI2C::IIC_OK) return 0;
+  return get_be32 (buf);
+}
+
+//! Write a register
+uint8_t CSeesaw::write (uint8_t base, uint8_t reg, const void *data, uint8_t len) {
+  CI2C::TI2CTrans t = { _addr, 0, { base, reg }, 2, (const uint8_t *)data, len };
+  pI2C->lock_sem();
+  uint8_t result = pI2C->run (&t);
+  pI2C->unlock_sem();
+  return result;
+}
+
+//! Read a register
+uint8_t CSeesaw::read (uint8_t base, uint8_t reg, void *buf, uint8_t len) {
+  TRead r = { this, base, reg, buf, len };
+  read_multi (&r, 1);
+  return r.result;
+}
+
+//! Read registers of several devices at once
+//  The register addresses of one entry per device are written, and after the longest
+//  delay of them the data are read. Entries for the same device are left to the next round.
+bool CSeesaw::read_multi (TRead *list, uint8_t n) {
+  if (n == 0) return true;
+  CI2C *i2c = list[0].dev->pI2C;
+  TaskHandle_t task = NULL;
+  if ((xTaskGetSchedulerState() == taskSCHEDULER_RUNNING) && !__get_PRIMASK()) task = xTaskGetCurrentTaskHandle();
+  bool ok = true;
+
+  for (int i = 0; i < n; i++) list[i].result = 0xff;
+
+  for (int done = 0; done < n;) {
+    // Pick one entry per device and write its register address
+    uint16_t delay = 0;
+    bool stuck = false;
+    i2c->lock_sem();
+    for (int i = 0; i < n; i++) {
+      TRead *r = &list[i];
+      if (r->result != 0xff) continue;
+      bool busy = false;
+      for (int j = 0; j < i; j++) {
+        if ((list[j].t.flags & CI2C::fREAD) && (list[j].result == 0xff) && (list[j].dev->_addr == r->dev->_addr)) busy = true;
+      }
+      r->t = (CI2C::TI2CTrans) { r->dev->_addr, 0, { r->base, r->reg }, 2 };
+      if (busy) continue;
+      // fREAD marks the entries of this round
+      r->t.flags = CI2C::fREAD;
+      r->t.task = task;
+      i2c->submit (&r->t);
+      delay = MAX (delay, r->dev->_delay);
+    }
+    for (int i = 0; i < n; i++) {
+      TRead *r = &list[i];
+      if ((r->result != 0xff) || !(r->t.flags & CI2C::fREAD)) continue;
+      i2c->wait (&r->t, i2c->timeout_us (&r->t));
+      if (r->t.result != CI2C::IIC_OK) {
+        r->result = r->t.result;
+        if ((r->result == CI2C::IIC_TIMEOUT) || (r->result == CI2C::IIC_BUSERR)) stuck = true;
+      }
+    }
+    if (stuck) i2c->recover();
+    i2c->unlock_sem();
+
+    // Other bus users may run while the devices prepare the data
+    _wait.us (delay);
+
+    // Read the data
+    stuck = false;
+    i2c->lock_sem();
+    for (int i = 0; i < n; i++) {
+      TRead *r = &list[i];
+      if ((r->result != 0xff) || !(r->t.flags & CI2C::fREAD)) continue;
+      r->t = (CI2C::TI2CTrans) { r->dev->_addr, CI2C::fREAD, { 0 }, 0, NULL, 0, (uint8_t *)r->buf, r->len };
+      r->t.task = task;
+      i2c->submit (&r->t);
+    }
+    for (int i = 0; i < n; i++) {
+      TRead *r = &list[i];
+      if ((r->result != 0xff) || !(r->t.flags & CI2C::fREAD)) continue;
+      i2c->wait (&r->t, i2c->timeout_us (&r->t));
+      r->result = r->t.result;
+      if ((r->result == CI2C::IIC_TIMEOUT) || (r->result == CI2C::IIC_BUSERR)) stuck = true;
+    }
+    if (stuck) i2c->recover();
+    i2c->unlock_sem();
+
+    // Count the entries finished in this round
+    done = 0;
+    for (int i = 0; i < n; i++) {
+      if (list[i].result == 0xff) continue;
+      if (list[i].result != CI2C::IIC_OK) ok = false;
+      done++;
+    }
+  }
+  return ok;
+}
+
+//! Set mode of the pins in the bit mask
+bool CSeesaw::pin_mode_bulk (uint32_t pins, TPinMode mode) {
+  uint8_t d[4];
+  set_be32 (d, pins);
+  switch (mode) {
+    case SS_OUTPUT:
+      return write (SEESAW_GPIO_BASE, SEESAW_GPIO_DIRSET_BULK, d, 4) == CI2C::IIC_OK;
+    case SS_INPUT:
+      return write (SEESAW_GPIO_BASE, SEESAW_GPIO_DIRCLR_BULK, d, 4) == CI2C::IIC_OK;
+    case SS_INPUT_PULLUP:
+    case SS_INPUT_PULLDOWN:
+      // The output latch selects the direction of pull
+      return (write (SEESAW_GPIO_BASE, SEESAW_GPIO_DIRCLR_BULK, d, 4) == CI2C::IIC_OK) &&
+             (write (SEESAW_GPIO_BASE, SEESAW_GPIO_PULLENSET, d, 4) == CI2C::IIC_OK) &&
+             (write (SEESAW_GPIO_BASE, (mode == SS_INPUT_PULLUP) ? SEESAW_GPIO_BULK_SET : SEESAW_GPIO_BULK_CLR, d, 4) == CI2C::IIC_OK);
+  }
+  return false;
+}
+
+//! Set level of the output pins in the bit mask
+bool CSeesaw::digital_write_bulk (uint32_t pins, bool level) {
+  uint8_t d[4];
+  set_be32 (d, pins);
+  return write (SEESAW_GPIO_BASE, level ? SEESAW_GPIO_BULK_SET : SEESAW_GPIO_BULK_CLR, d, 4) == CI2C::IIC_OK;
+}
+
+//! Level of all pins masked by pins
+uint32_t CSeesaw::digital_read_bulk (uint32_t pins) {
+  uint8_t d[4];
+  if (read (SEESAW_GPIO_BASE, SEESAW_GPIO_BULK, d, 4) != CI2C::IIC_OK) return 0;
+  return get_be32 (d) & pins;
+}
+
+//! Encoder position
+int32_t CSeesaw::get_position (uint8_t enc) {
+  uint8_t d[4];
+  if (read (SEESAW_ENCODER_BASE, SEESAW_ENCODER_POSITION + enc, d, 4) != CI2C::IIC_OK) return 0;
+  return (int32_t)get_be32 (d);
+}
+
+//! Encoder change since the last read
+int32_t CSeesaw::get_delta (uint8_t enc) {
+  uint8_t d[4];
+  if (read (SEESAW_ENCODER_BASE, SEESAW_ENCODER_DELTA + enc, d, 4) != CI2C::IIC_OK) return 0;
+  return (int32_t)get_be32 (d);
+}
+
+//! Set encoder position
+bool CSeesaw::set_position (int32_t pos, uint8_t enc) {
+  uint8_t d[4];
+  set_be32 (d, pos);
+  return write (SEESAW_ENCODER_BASE, SEESAW_ENCODER_POSITION + enc, d, 4) == CI2C::IIC_OK;
+}
+
+//! Set up NeoPixel (pin:Seesaw pin, num:number of pixels)
+bool CSeesaw::pixel_begin (uint8_t pin, uint16_t num) {
+  uint16_t len = num * 3;
+  const uint8_t d[2] = { (uint8_t) (len >> 8), (uint8_t)len };
+  _pixels = 0;
+  if ((write (SEESAW_NEOPIXEL_BASE, SEESAW_NEOPIXEL_SPEED, (const uint8_t[1]) { 1 }, 1) != CI2C::IIC_OK) ||  // 800kHz
+      (write (SEESAW_NEOPIXEL_BASE, SEESAW_NEOPIXEL_BUF_LENGTH, d, 2) != CI2C::IIC_OK) ||
+      (write (SEESAW_NEOPIXEL_BASE, SEESAW_NEOPIXEL_PIN, &pin, 1) != CI2C::IIC_OK)) return false;
+  _pixels = num;
+  return true;
+}
+
+//! Set color of pixel n in the buffer
+bool CSeesaw::set_pixel (uint16_t n, uint8_t r, uint8_t g, uint8_t b) {
+  if (n >= _pixels) return false;
+  // The buffer offset follows the register address, and the pixels take GRB order
+  uint16_t ofs = n * 3;
+  const uint8_t grb[3] = { g, r, b };
+  CI2C::TI2CTrans t = { _addr, 0, { SEESAW_NEOPIXEL_BASE, SEESAW_NEOPIXEL_BUF, (uint8_t) (ofs >> 8), (uint8_t)ofs }, 4, grb, 3 };
+  pI2C->lock_sem();
+  uint8_t result = pI2C->run (&t);
+  pI2C->unlock_sem();
+  return result == CI2C::IIC_OK;
+}
+
+//! Output the buffer to the pixels
+bool CSeesaw::show_pixel (void) {
+  return write (SEESAW_NEOPIXEL_BASE, SEESAW_NEOPIXEL_SHOW) == CI2C::IIC_OK;
+}
@@ -0,0 +1,307 @@
+/*!
+  @file    ud5_spi.cpp
+  @version 0.9981
+  @brief   Collection of classes for UD5 control
+  @date    2024/9/29
+  @author  T.Uemitsu
+
+  @copyright
+    Copyright (c) BestTechnology CO.,LTD. 2024
+    All rights reserved.
+
+  @par
+   The software is designed to use the minimum number of
+   functions provided by UD5.
+   Although it should be provided in the form of a library,
+   it is provided in the form of a header file in order to
+   lay aside the complexity of its introduction.
+ */
+
+#include "ud5.h"
+
+//=======================================================================
+// SPI
+//=======================================================================
+/*!
+ @brief SPI0 master class for devices on the GPIO terminals.
+ @note
+   Assign SCK, MOSI, MISO (and SSEL) to terminals with CGPIO::set_config beforehand.
+   Transfers are queued, moved by DMA in full duplex and finished by the receive completion interrupt.
+ */
+
+// SPI0 register bits
+static const uint32_t _CFG_ENABLE = 1UL << 0;
+static const uint32_t _CFG_MASTER = 1UL << 2;
+static const uint32_t _CFG_LSBF   = 1UL << 3;
+static const uint32_t _CFG_CPHA   = 1UL << 4;
+static const uint32_t _CFG_CPOL   = 1UL << 5;
+static const uint32_t _CFG_SPOL0  = 1UL << 8;
+static const uint32_t _TXSSEL_OFF = 0xfUL << 16;  // TXSSEL0...3 deasserted
+
+// Find or make the register values of the device, and set up software chip select (NULL:too many devices)
+const CSPI::TDevReg *CSPI::find_dev (const TDevice *dev) {
+  for (uint8_t i = 0; i < _num_dev; i++) if (_devreg[i].dev == dev) return &_devreg[i];
+
+  TDevReg r;
+  r.dev = dev;
+  r.cfg = _CFG_ENABLE | _CFG_MASTER |
+    ((dev->bitorder == SPIBitLSBF) ? _CFG_LSBF : 0) |
+    (((dev->mode == SPIMode1) || (dev->mode == SPIMode3)) ? _CFG_CPHA : 0) |
+    (((dev->mode == SPIMode2) || (dev->mode == SPIMode3)) ? _CFG_CPOL : 0) |
+    ((dev->cs == SPICSHigh) ? _CFG_SPOL0 : 0);
+  // Not faster than requested
+  uint32_t d = (SystemCoreClock + dev->clock - 1) / MAX (dev->clock, 1);
+  r.div = MIN (MAX (d, 1), 0x10000) - 1;
+  // SSEL0 is left deasserted for a device with software chip select
+  r.ssel = (dev->cs_pio >= 0) ? _TXSSEL_OFF : 0;
+
+  uint32_t primask = __get_PRIMASK();
+  __disable_irq();
+  TDevReg *p = NULL;
+  if (_num_dev < _MAX_DEV) {
+    p = &_devreg[_num_dev];
+    *p = r;
+    _num_dev++;
+  }
+  __set_PRIMASK (primask);
+
+  // Software chip select is made an output (deasserted) when the device is registered
+  if ((p != NULL) && (dev->cs_pio >= 0)) {
+    cs_write (dev, false);
+    Chip_GPIO_SetPinDIROutput (LPC_GPIO_PORT, 0, dev->cs_pio);
+  }
+  return p;
+}
+
+// Configure SPI0 for the device
+// Only CFG and DIV are written, so this is safe from the ISR starting the next transfer.
+void CSPI::apply (const TDevReg *r) {
+  if (r == _cur_dev) return;
+  LPC_SPI0->CFG = r->cfg & ~_CFG_ENABLE;
+  LPC_SPI0->DIV = r->div;
+  LPC_SPI0->DLY = 0;
+  LPC_SPI0->CFG = r->cfg;
+  _cur_dev = r;
+}
+
+// Drive chip select by software
+void CSPI::cs_write (const TDevice *dev, bool on) {
+  if (dev->cs_pio < 0) return;
+  Chip_GPIO_SetPinState (LPC_GPIO_PORT, 0, dev->cs_pio, (dev->cs == SPICSHigh) ? on : !on);
+}
+
+// Start DMA of the transfer
+// 8 bits wide regardless of TDevice
+//-----------------------------
+void CSPI::start (TXfer *t) {
+  uint8_t ntx = 0, nrx = 0;
+  uint32_t txd = (t->txd != NULL) ? DMA_ADDR (t->txd) : DMA_ADDR (&_tx_fill);
+  uint32_t rxd = (t->rxd != NULL) ? DMA_ADDR (t->rxd) : DMA_ADDR (&_rx_discard);
+  uint32_t txinc = (t->txd != NULL) ? DMA_XFERCFG_SRCINC_1 : DMA_XFERCFG_SRCINC_0;
+  uint32_t rxinc = (t->rxd != NULL) ? DMA_XFERCFG_DSTINC_1 : DMA_XFERCFG_DSTINC_0;
+
+  const TDevReg *r = find_dev (t->dev);
+  apply (r);
+  cs_write (t->dev, true);
+
+  // Receive chain
+  CDMA::chain_add (_rx_sg, _SG_CHUNKS, &nrx, DMA_XFERCFG_CFGVALID | DMA_XFERCFG_WIDTH_8 | DMA_XFERCFG_SRCINC_0 | rxinc, DMA_ADDR (&LPC_SPI0->RXDAT), rxd, t->len);
+  CDMA::chain_link (_rx_sg, nrx, DMA_XFERCFG_SETINTA);
+
+  // Transmit chain excluding the last byte
+  CDMA::chain_add (_tx_sg, _SG_CHUNKS + 1, &ntx, DMA_XFERCFG_CFGVALID | DMA_XFERCFG_SWTRIG | DMA_XFERCFG_WIDTH_8 | txinc | DMA_XFERCFG_DSTINC_0, txd, DMA_ADDR (&LPC_SPI0->TXDAT), t->len - 1);
+
+  // Last byte with end of transfer (SSEL stays asserted with keep_cs)
+  _txbuflast =
+    r->ssel |
+    SPI_TXDATCTL_EOF |
+    (t->keep_cs ? 0 : SPI_TXDATCTL_EOT) |
+    SPI_TXDATCTL_LEN (8 - 1) |
+    SPI_TXDATCTL_DATA ((t->txd != NULL) ? t->txd[t->len - 1] : _tx_fill);
+  _tx_sg[ntx].xfercfg =
+    DMA_XFERCFG_CFGVALID |
+    DMA_XFERCFG_SWTRIG |
+    DMA_XFERCFG_WIDTH_32 |
+    DMA_XFERCFG_SRCINC_0 |
+    DMA_XFERCFG_DSTINC_0 |
+    DMA_XFERCFG_XFERCOUNT (1);
+  _tx_sg[ntx].source = DMA_ADDR (&_txbuflast);
+  _tx_sg[ntx].dest = DMA_ADDR (&LPC_SPI0->TXDATCTL);
+  ntx++;
+  CDMA::chain_link (_tx_sg, ntx, 0);
+
+  // SPI initial condition setting
+  Chip_SPI_ClearStatus (LPC_SPI0, SPI_STAT_CLR_RXOV | SPI_STAT_CLR_TXUR | SPI_STAT_CLR_SSA | SPI_STAT_CLR_SSD);
+  LPC_SPI0->TXCTRL =
+    r->ssel |                 // Assert SSEL0 unless chip select is driven by software
+    SPI_TXCTL_FLEN (8 - 1);   // Bit width of transmitted data -1
+
+  // The first descriptors are copied into the channel table
+  Chip_DMA_SetupTranChannel (LPC_DMA, DMAREQ_SPI0_RX, &_rx_sg[0]);
+  Chip_DMA_SetupChannelTransfer (LPC_DMA, DMAREQ_SPI0_RX, _rx_sg[0].xfercfg);
+  Chip_DMA_SetValidChannel (LPC_DMA, DMAREQ_SPI0_RX);
+  Chip_DMA_SWTriggerChannel (LPC_DMA, DMAREQ_SPI0_RX);
+
+  Chip_DMA_SetupTranChannel (LPC_DMA, DMAREQ_SPI0_TX, &_tx_sg[0]);
+  Chip_DMA_SetValidChannel (LPC_DMA, DMAREQ_SPI0_TX);
+
+  // Excitation of transmission
+  Chip_DMA_SetupChannelTransfer (LPC_DMA, DMAREQ_SPI0_TX, _tx_sg[0].xfercfg);
+}
+
+// Receive DMA completion (CDMA handler)
+void CSPI::dma_done (uint8_t ch, uint8_t flags, void *arg) {
+  if (flags & CDMA::fINTA) ((CSPI *)arg)->xfer_done();
+}
+
+// Finish the transfer at the head of queue
+void CSPI::xfer_done (void) {
+  TXfer *t = _q_head;
+  if (t == NULL) return;
+  if (!t->keep_cs) cs_write (t->dev, false);
+
+  // Start the next one before notifying
+  _q_head = t->next;
+  if (_q_head != NULL) start (_q_head);
+  else _q_tail = NULL;
+
+  BaseType_t woken = pdFALSE;
+  if (t->cb != NULL) {
+    // cb may submit t again
+    t->done = true;
+    t->cb (t, t->arg);
+  } else {
+    if ((t->task != NULL) && !__get_PRIMASK()) vTaskNotifyGiveFromISR (t->task, &woken);
+    // t may be released by its owner after this
+    t->done = true;
+  }
+  portYIELD_FROM_ISR (woken);
+}
+
+CSPI::CSPI() {
+  Chip_Clock_EnablePeriphClock (SYSCON_CLOCK_SPI0);
+  LPC_SYSCON->SPI0CLKSEL = SYSCON_FLEXCOMMCLKSELSRC_MAINCLK;
+  // Reset and enable SPI0 once, devices then only switch CFG and DIV
+  const TSPIConf conf = { LPC_SPI0, SPIMode0, SPIBitMSBF, 1000000, 8, SPICSLow };
+  SPI_Init (&conf);
+  _num_dev = 0;
+  _cur_dev = NULL;
+  _q_head = _q_tail = NULL;
+  _mutex = xSemaphoreCreateMutex();
+  _lock_owner = NULL;
+  _lock_nest = 0;
+
+  CDMA::init();
+  _tx_sg = CDMA::alloc_desc (_SG_CHUNKS + 1, this);
+  _rx_sg = CDMA::alloc_desc (_SG_CHUNKS, this);
+  _dma_ready = CDMA::claim (DMAREQ_SPI0_TX, this) && CDMA::claim (DMAREQ_SPI0_RX, this) && (_tx_sg != NULL) && (_rx_sg != NULL);
+  if (_dma_ready) {
+    Chip_DMA_DisableChannel (LPC_DMA, DMAREQ_SPI0_TX);
+    Chip_DMA_EnableChannel (LPC_DMA, DMAREQ_SPI0_TX);
+    Chip_DMA_DisableIntChannel (LPC_DMA, DMAREQ_SPI0_TX);
+    Chip_DMA_SetupChannelConfig (LPC_DMA, DMAREQ_SPI0_TX, (DMA_CFG_PERIPHREQEN | DMA_CFG_TRIGBURST_SNGL | DMA_CFG_CHPRIORITY (3)));
+
+    Chip_DMA_DisableChannel (LPC_DMA, DMAREQ_SPI0_RX);
+    Chip_DMA_EnableChannel (LPC_DMA, DMAREQ_SPI0_RX);
+    Chip_DMA_DisableIntChannel (LPC_DMA, DMAREQ_SPI0_RX);
+    Chip_DMA_SetupChannelConfig (LPC_DMA, DMAREQ_SPI0_RX, (DMA_CFG_PERIPHREQEN | DMA_CFG_TRIGBURST_SNGL | DMA_CFG_CHPRIORITY (3)));
+
+    CDMA::set_handler (DMAREQ_SPI0_RX, this, dma_done, this);
+  }
+  anchor = this;
+}
+
+CSPI::~CSPI() {
+  CDMA::set_handler (DMAREQ_SPI0_RX, this, NULL);
+  Chip_DMA_DisableChannel (LPC_DMA, DMAREQ_SPI0_TX);
+  Chip_DMA_DisableChannel (LPC_DMA, DMAREQ_SPI0_RX);
+  CDMA::release (DMAREQ_SPI0_TX, this);
+  CDMA::release (DMAREQ_SPI0_RX, this);
+  CDMA::free_desc (this);
+  Chip_SPI_DeInit (LPC_SPI0);
+  Chip_Clock_DisablePeriphClock (SYSCON_CLOCK_SPI0);
+  vSemaphoreDelete (_mutex);
+  anchor = NULL;
+}
+
+//! Register the device and prepare its chip select (deasserted, false:too many devices)
+//  Devices not attached are registered by their first submit, which also prepares the chip select.
+//  Attach in advance to keep the chip select deasserted before the first transfer.
+bool CSPI::attach (const TDevice *dev) {
+  return find_dev (dev) != NULL;
+}
+
+//! Take the bus (nestable, to keep other tasks out of a sequence of transfers)
+void CSPI::lock_sem (void) {
+  if ((xTaskGetSchedulerState() != taskSCHEDULER_RUNNING)) return;
+  TaskHandle_t me = xTaskGetCurrentTaskHandle();
+  if (_lock_owner != me) {
+    xSemaphoreTake (_mutex, portMAX_DELAY);
+    _lock_owner = me;
+  }
+  _lock_nest++;
+}
+
+//! Give the bus.
+void CSPI::unlock_sem (void) {
+  if ((xTaskGetSchedulerState() != taskSCHEDULER_RUNNING)) return;
+  if ((_lock_owner != xTaskGetCurrentTaskHandle()) || (_lock_nest == 0)) return;
+  if (--_lock_nest == 0) {
+    _lock_owner = NULL;
+    xSemaphoreGive (_mutex);
+  }
+}
+
+//! Queue transfer (returns immediately)
+bool CSPI::submit (TXfer *t) {
+  if (!_dma_ready || (t->dev == NULL) || (t->len == 0) || (t->len > MAX_LEN) || (find_dev (t->dev) == NULL)) return false;
+  t->done = false;
+  t->next = NULL;
+
+  uint32_t primask = __get_PRIMASK();
+  __disable_irq();
+  if (_q_head == NULL) {
+    _q_head = _q_tail = t;
+    start (t);
+  } else {
+    _q_tail->next = t;
+    _q_tail = t;
+  }
+  __set_PRIMASK (primask);
+  return true;
+}
+
+//! Wait for completion of the transfer submitted with task set
+void CSPI::wait (TXfer *t) {
+  while (!t->done) {
+    // The interrupt cannot run while disabled
+    if (__get_PRIMASK()) CDMA::dispatch();
+    else if (t->task != NULL) ulTaskNotifyTake (pdTRUE, portMAX_DELAY);
+  }
+}
+
+//! Full duplex transfer (blocks the caller only)
+bool CSPI::transfer (const TDevice *dev, const uint8_t *txd, uint8_t *rxd, uint16_t len, bool keep_cs) {
+  TXfer t = { dev, txd, rxd, len, keep_cs, NULL, NULL, NULL, false, NULL };
+
+  lock_sem();
+  // Other tasks run during the transfer
+  if ((xTaskGetSchedulerState() == taskSCHEDULER_RUNNING) && !__get_PRIMASK()) t.task = xTaskGetCurrentTaskHandle();
+  bool result = submit (&t);
+  if (result) wait (&t);
+  unlock_sem();
+
+  return result;
+}
+
+//! Transmission only
+bool CSPI::write (const TDevice *dev, const uint8_t *txd, uint16_t len, bool keep_cs) {
+  return transfer (dev, txd, NULL, len, keep_cs);
+}
+
+//! Reception only (0xff is sent)
+bool CSPI::read (const TDevice *dev, uint8_t *rxd, uint16_t len, bool keep_cs) {
+  return transfer (dev, NULL, rxd, len, keep_cs);
+}
+
+CSPI *CSPI::anchor = NULL;
@@ -0,0 +1,320 @@
+/*!
+  @file    ud5_uart.cpp
+  @version 0.9981
+  @brief   Collection of classes for UD5 control
+  @date    2024/9/29
+  @author  T.Uemitsu
+
+  @copyright
+    Copyright (c) BestTechnology CO.,LTD. 2024
+    All rights reserved.
+
+  @par
+   The software is designed to use the minimum number of
+   functions provided by UD5.
+   Although it should be provided in the form of a library,
+   it is provided in the form of a header file in order to
+   lay aside the complexity of its introduction.
+ */
+
+#include "ud5.h"
+#include <stdio.h>
+
+//=======================================================================
+// UART
+//=======================================================================
+/*!
+ @brief Generic UART class for USART2/3/4 with DMA ring buffers.
+ @note
+   TX/RX are assigned to GPIO terminals by the switch matrix (do not use them in CGPIO).
+   Reception runs on a circular DMA descriptor, so there is no interrupt per byte.
+   The end of a frame is detected by the idle time of the receive line.
+ */
+
+// Total bytes written by DMA
+uint32_t CUART::rx_total (void) {
+  uint32_t laps, c;
+  do {
+    laps = _rx_laps;
+    c = ((LPC_DMA->DMACH[_dma_rx].XFERCFG >> 16) & 0x3ff) + 1; // remaining transfers
+  } while (laps != _rx_laps);
+  uint32_t total = laps * _rx_size + (_rx_size - MIN (c, _rx_size));
+
+  // Wrapped but the interrupt has not been handled yet
+  if ((int32_t) (total - _rx_seen) < 0) total += _rx_size;
+
+  // Keep the time of the last reception
+  if (total != _rx_seen) {
+    _rx_seen = total;
+    _rx_tick = 0x7fffffffUL - LPC_MRT_CH3->TIMER;
+  }
+
+  // Oldest data has been overwritten
+  if ((total - _rx_tail) > _rx_size) {
+    _rx_overrun += (total - _rx_tail) - _rx_size;
+    _rx_tail = total - _rx_size;
+  }
+  return total;
+}
+
+// Start DMA of the contiguous part of transmit ring
+// Call with interrupts disabled
+void CUART::tx_start (void) {
+  if ((_tx_busy != 0) || (_tx_head == _tx_tail)) return;
+  uint16_t idx = _tx_tail & (_tx_size - 1);
+  uint16_t len = MIN (_tx_head - _tx_tail, (uint32_t) (_tx_size - idx));
+  DMA_CHDESC_T d;
+
+  d.xfercfg =
+    DMA_XFERCFG_CFGVALID |
+    DMA_XFERCFG_SETINTA |
+    DMA_XFERCFG_SWTRIG |
+    DMA_XFERCFG_WIDTH_8 |
+    DMA_XFERCFG_SRCINC_1 |
+    DMA_XFERCFG_DSTINC_0 |
+    DMA_XFERCFG_XFERCOUNT (len);
+  d.source = DMA_ADDR (&ptxbuff[idx + len - 1]);
+  d.dest = DMA_ADDR (&_usart->TXDAT);
+  d.next = DMA_ADDR (0);
+  _tx_busy = len;
+
+  Chip_DMA_SetupTranChannel (LPC_DMA, _dma_tx, &d);
+  Chip_DMA_SetValidChannel (LPC_DMA, _dma_tx);
+  Chip_DMA_SetupChannelTransfer (LPC_DMA, _dma_tx, d.xfercfg);
+}
+
+// DMA completion (CDMA handler)
+void CUART::dma_done (uint8_t ch, uint8_t flags, void *arg) {
+  CUART *p = (CUART *)arg;
+  if ((flags & CDMA::fINTA) == 0) return;
+  if (ch == p->_dma_rx) p->_rx_laps++;
+  else {
+    p->_tx_tail += p->_tx_busy;
+    p->_tx_busy = 0;
+    p->tx_start();
+  }
+}
+
+//! n:USART 2...4, tx/rx:GPIO terminal (0...9, -1:not used), fmt:fmt8N1 etc.
+CUART::CUART (uint8_t n, int8_t tx, int8_t rx, uint32_t baud, uint32_t fmt, uint16_t txb, uint16_t rxb) {
+  uint8_t swm_tx, swm_rx;
+  switch (n) {
+    case 2:
+      _usart = LPC_USART2;
+      LPC_SYSCON->UART2CLKSEL = SYSCON_FLEXCOMMCLKSELSRC_FRG0;
+      _dma_tx = DMAREQ_USART2_TX;
+      _dma_rx = DMAREQ_USART2_RX;
+      swm_tx = SWM_U2_TXD_O;
+      swm_rx = SWM_U2_RXD_I;
+      break;
+    case 3:
+      _usart = LPC_USART3;
+      LPC_SYSCON->UART3CLKSEL = SYSCON_FLEXCOMMCLKSELSRC_FRG0;
+      _dma_tx = DMAREQ_USART3_TX;
+      _dma_rx = DMAREQ_USART3_RX;
+      swm_tx = SWM_U3_TXD_O;
+      swm_rx = SWM_U3_RXD_I;
+      break;
+    case 4:
+      _usart = LPC_USART4;
+      LPC_SYSCON->UART4CLKSEL = SYSCON_FLEXCOMMCLKSELSRC_FRG0;
+      _dma_tx = DMAREQ_USART4_TX;
+      _dma_rx = DMAREQ_USART4_RX;
+      swm_tx = SWM_U4_TXD_O;
+      swm_rx = SWM_U4_RXD_I;
+      break;
+    default:
+      _usart = NULL;
+      return;
+  }
+
+  // Power of 2, so that the ring index stays continuous when the running totals wrap
+  for (_tx_size = 1; _tx_size < MIN (txb, 1024); _tx_size <<= 1);
+  for (_rx_size = 1; _rx_size < MIN (rxb, 1024); _rx_size <<= 1);
+  ptxbuff = (uint8_t *)malloc (_tx_size);
+  prxbuff = (uint8_t *)malloc (_rx_size);
+  _tx_head = _tx_tail = 0;
+  _tx_busy = 0;
+  _rx_laps = _rx_tail = _rx_seen = _rx_overrun = 0;
+  _rx_tick = 0x7fffffffUL - LPC_MRT_CH3->TIMER;
+
+  CDMA::init();
+  _rx_desc = CDMA::alloc_desc (1, this);
+  if ((ptxbuff == NULL) || (prxbuff == NULL) || (_rx_desc == NULL)) return;
+  if (!CDMA::claim (_dma_tx, this) || !CDMA::claim (_dma_rx, this)) return;
+
+  if ((tx >= 0) && (tx <= 9)) {
+    const TPin pin = { _term_pio[tx], PIO_TYPE_MOVABLE, swm_tx, PIO_MODE_DEFAULT };
+    PIO_Configure (&pin, 1);
+  }
+  if ((rx >= 0) && (rx <= 9)) {
+    const TPin pin = { _term_pio[rx], PIO_TYPE_MOVABLE, swm_rx, PIO_MODE_PULLUP };
+    PIO_Configure (&pin, 1);
+  }
+
+  // 16x oversampling of FRG0 (32MHz)
+  Chip_UART_Init (_usart);
+  _usart->CFG = fmt;
+  _usart->OSR = 16 - 1;
+  _usart->BRG = (Chip_Clock_GetFRGClockRate (0) / (16 * baud)) - 1;
+  Chip_UART_Enable (_usart);
+  Chip_UART_TXEnable (_usart);
+
+  // Transmission by the contiguous part of ring
+  Chip_DMA_EnableChannel (LPC_DMA, _dma_tx);
+  Chip_DMA_SetupChannelConfig (LPC_DMA, _dma_tx, (DMA_CFG_PERIPHREQEN | DMA_CFG_TRIGBURST_SNGL | DMA_CFG_CHPRIORITY (1)));
+
+  // Reception by a descriptor linked to itself (interrupt once per lap)
+  Chip_DMA_EnableChannel (LPC_DMA, _dma_rx);
+  Chip_DMA_SetupChannelConfig (LPC_DMA, _dma_rx, (DMA_CFG_PERIPHREQEN | DMA_CFG_TRIGBURST_SNGL | DMA_CFG_CHPRIORITY (1)));
+  _rx_desc->xfercfg =
+    DMA_XFERCFG_CFGVALID |
+    DMA_XFERCFG_RELOAD |
+    DMA_XFERCFG_SETINTA |
+    DMA_XFERCFG_SWTRIG |
+    DMA_XFERCFG_WIDTH_8 |
+    DMA_XFERCFG_SRCINC_0 |
+    DMA_XFERCFG_DSTINC_1 |
+    DMA_XFERCFG_XFERCOUNT (_rx_size);
+  _rx_desc->source = DMA_ADDR (&_usart->RXDAT);
+  _rx_desc->dest = DMA_ADDR (&prxbuff[_rx_size - 1]);
+  _rx_desc->next = DMA_ADDR (_rx_desc);
+
+  CDMA::set_handler (_dma_tx, this, dma_done, this);
+  CDMA::set_handler (_dma_rx, this, dma_done, this);
+  Chip_DMA_SetupTranChannel (LPC_DMA, _dma_rx, _rx_desc);
+  Chip_DMA_SetValidChannel (LPC_DMA, _dma_rx);
+  Chip_DMA_SetupChannelTransfer (LPC_DMA, _dma_rx, _rx_desc->xfercfg);
+
+  init = true;
+}
+
+CUART::~CUART() {
+  if (_usart == NULL) return;
+  if (init) {
+    CDMA::set_handler (_dma_tx, this, NULL);
+    CDMA::set_handler (_dma_rx, this, NULL);
+    Chip_DMA_DisableChannel (LPC_DMA, _dma_tx);
+    Chip_DMA_DisableChannel (LPC_DMA, _dma_rx);
+    Chip_UART_DeInit (_usart);
+  }
+  CDMA::release (_dma_tx, this);
+  CDMA::release (_dma_rx, this);
+  CDMA::free_desc (this);
+  free (ptxbuff);
+  free (prxbuff);
+}
+
+//! Number of unsent data bytes
+uint16_t CUART::txbuff (void) {
+  if (init) return _tx_head - _tx_tail;
+  return 0;
+}
+
+//! Number of data bytes received
+uint16_t CUART::rxbuff (void) {
+  if (init) return rx_total() - _rx_tail;
+  return 0;
+}
+
+//! Clear transmit buffer.
+void CUART::clear_txbuff (void) {
+  if (!init) return;
+  // Bytes already in DMA transfer are sent
+  uint32_t primask = __get_PRIMASK();
+  __disable_irq();
+  _tx_head = _tx_tail + _tx_busy;
+  __set_PRIMASK (primask);
+}
+
+//! Clear Received data.
+void CUART::clear_rxbuff (void) {
+  if (init) _rx_tail = rx_total();
+}
+
+//! Send 1 byte of characters.
+void CUART::putc (char c) {
+  putsb ((const uint8_t *)&c, 1);
+}
+
+//! Send string.
+void CUART::puts (const char *s) {
+  putsb ((const uint8_t *)s, strlen (s));
+}
+
+//! Send specified number of bytes of data.
+int CUART::putsb (const uint8_t *s, int n) {
+  if (!init) return 0;
+  for (int i = 0; i < n; i++) {
+    // Wait for space
+    while ((_tx_head - _tx_tail) >= _tx_size) {
+      if (__get_PRIMASK()) CDMA::dispatch();
+      else _my_csw();
+    }
+    ptxbuff[_tx_head & (_tx_size - 1)] = s[i];
+    _tx_head++;
+    // Kick at the end of data or the end of ring
+    if ((i == n - 1) || ((_tx_head & (_tx_size - 1)) == 0) || ((_tx_head - _tx_tail) >= _tx_size)) {
+      uint32_t primask = __get_PRIMASK();
+      __disable_irq();
+      tx_start();
+      __set_PRIMASK (primask);
+    }
+  }
+  return n;
+}
+
+//! Retrieve one character from the receive data buffer (-1:none).
+int CUART::getc (void) {
+  if (rxbuff() == 0) return -1;
+  uint8_t c = prxbuff[_rx_tail & (_rx_size - 1)];
+  _rx_tail++;
+  return c;
+}
+
+//! Receive up to n bytes of data.
+uint16_t CUART::getsb (uint8_t *s, uint16_t n) {
+  uint16_t l = MIN (rxbuff(), n);
+  for (uint16_t i = 0; i < l; i++) {
+    s[i] = prxbuff[_rx_tail & (_rx_size - 1)];
+    _rx_tail++;
+  }
+  return l;
+}
+
+//! Send format conversion strings
+int CUART::printf (const char *format, ...) {
+  char s[128];
+  va_list ap;
+  va_start (ap, format);
+  int n = vsnprintf (s, sizeof (s), format, ap);
+  va_end (ap);
+  return putsb ((const uint8_t *)s, MIN (n, (int)sizeof (s) - 1));
+}
+
+//! Time since the last byte was received [us]
+//  Measured at the time of polling, so the resolution is the interval of calls.
+uint32_t CUART::idle_time (void) {
+  if (!init) return 0;
+  rx_total();
+  return (((0x7fffffffUL - LPC_MRT_CH3->TIMER) - _rx_tick) & 0x7fffffffUL) / _USTICK;
+}
+
+//! Wait until data has been received and the line has been idle for gap_us (0:timeout)
+uint16_t CUART::wait_idle (uint32_t gap_us, uint32_t timeout_ms) {
+  uint32_t t = UD5_GET_ELAPSEDTIME();
+  if (!init) return 0;
+  while (1) {
+    uint32_t idle = idle_time();
+    if ((rxbuff() > 0) && (idle >= gap_us)) return rxbuff();
+    if ((UD5_GET_ELAPSEDTIME() - t) >= timeout_ms) return 0;
+    // Other tasks run while waiting
+    if ((xTaskGetSchedulerState() == taskSCHEDULER_RUNNING) && !__get_PRIMASK()) vTaskDelay (1);
+  }
+}
+
+//! Number of bytes lost because the receive buffer was full
+uint32_t CUART::get_overrun (void) {
+  if (init) rx_total();
+  return _rx_overrun;
+}
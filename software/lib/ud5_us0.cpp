@@ -35,6 +35,9 @@ CRPiIF::CRPiIF (uint32_t baud, uint8_t mode, uint16_t txb, uint16_t rxb) {
 
   LPC_SYSCON->UART0CLKSEL = SYSCON_FLEXCOMMCLKSELSRC_FRG0;
   PIO_Configure (pins, PIO_LISTSIZE (pins));
+  CDMA::init();
+  CDMA::claim (DMAREQ_USART0_TX, this);
+  CDMA::claim (DMAREQ_USART0_RX, this);
   usart0_dma_init (Chip_Clock_GetFRGClockRate (0), baud, mode, ptxbuff, txb, prxbuff, rxb);
   usart0_dma_csw = _my_csw;
   init = (ptxbuff != NULL) && (prxbuff != NULL);
@@ -43,6 +46,8 @@ CRPiIF::~CRPiIF() {
   Chip_UART_DeInit (LPC_USART0);
   Chip_DMA_DisableChannel (LPC_DMA, DMAREQ_USART0_TX);
   Chip_DMA_DisableChannel (LPC_DMA, DMAREQ_USART0_RX);
+  CDMA::release (DMAREQ_USART0_TX, this);
+  CDMA::release (DMAREQ_USART0_RX, this);
   usart0_dma_csw = _my_csw;
   free (ptxbuff);
   free (prxbuff);
@@ -34,6 +34,9 @@ CDXIF::CDXIF() {
 
   LPC_SYSCON->UART1CLKSEL = SYSCON_FLEXCOMMCLKSELSRC_FRG0;
   PIO_Configure (pins, PIO_LISTSIZE (pins));
+  CDMA::init();
+  CDMA::claim (DMAREQ_USART1_TX, this);
+  CDMA::claim (DMAREQ_USART1_RX, this);
   usart1_dma_init (Chip_Clock_GetFRGClockRate (0), 115200, USIP_8N1, ptxbuff, 10, prxbuff, 10);
   usart1_dma_csw = _my_csw;
   init = (ptxbuff != NULL) && (prxbuff != NULL);
@@ -47,6 +50,9 @@ CDXIF::CDXIF (uint32_t baud, uint8_t mode, int txb, int rxb) {
 
   LPC_SYSCON->UART1CLKSEL = SYSCON_FLEXCOMMCLKSELSRC_FRG0;
   PIO_Configure (pins, PIO_LISTSIZE (pins));
+  CDMA::init();
+  CDMA::claim (DMAREQ_USART1_TX, this);
+  CDMA::claim (DMAREQ_USART1_RX, this);
   usart1_dma_init (Chip_Clock_GetFRGClockRate (0), baud, mode, ptxbuff, txb, prxbuff, rxb);
   usart1_dma_csw = _my_csw;
   init = (ptxbuff != NULL) && (prxbuff != NULL);
@@ -56,6 +62,8 @@ CDXIF::~CDXIF() {
   Chip_UART_DeInit (LPC_USART1);
   Chip_DMA_DisableChannel (LPC_DMA, DMAREQ_USART1_TX);
   Chip_DMA_DisableChannel (LPC_DMA, DMAREQ_USART1_RX);
+  CDMA::release (DMAREQ_USART1_TX, this);
+  CDMA::release (DMAREQ_USART1_RX, this);
   usart1_dma_csw = NULL;
   free (ptxbuff);
   free (prxbuff);
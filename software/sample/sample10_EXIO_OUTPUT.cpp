@@ -12,22 +12,15 @@ CEXIO exio;
 
 //! main関数
 int main (void) {
-  exio.set_config (0, CEXIO::tPinDOUT);
-  exio.set_config (1, CEXIO::tPinDOUT);
-  exio.set_config (2, CEXIO::tPinDOUT);
-  exio.set_config (3, CEXIO::tPinDOUT);
-  exio.set_config (4, CEXIO::tPinDOUT);
-  exio.set_config (5, CEXIO::tPinDOUT);
-  exio.set_config (6, CEXIO::tPinDOUT);
-  exio.set_config (7, CEXIO::tPinDOUT);
-  exio.set_config (8, CEXIO::tPinDOUT);
-  exio.set_config (9, CEXIO::tPinDOUT);
-  exio.set_config (10, CEXIO::tPinDOUT);
-  exio.set_config (11, CEXIO::tPinDOUT);
-  exio.set_config (12, CEXIO::tPinDOUT);
-  exio.set_config (13, CEXIO::tPinDOUT);
-  exio.set_config (14, CEXIO::tPinDOUT);
-  exio.set_config (15, CEXIO::tPinDOUT);
+  // 全端子を一括で出力に設定
+  exio.set_config (
+    (const CEXIO::TPinMode[16]) {
+      CEXIO::tPinDOUT, CEXIO::tPinDOUT, CEXIO::tPinDOUT, CEXIO::tPinDOUT,
+      CEXIO::tPinDOUT, CEXIO::tPinDOUT, CEXIO::tPinDOUT, CEXIO::tPinDOUT,
+      CEXIO::tPinDOUT, CEXIO::tPinDOUT, CEXIO::tPinDOUT, CEXIO::tPinDOUT,
+      CEXIO::tPinDOUT, CEXIO::tPinDOUT, CEXIO::tPinDOUT, CEXIO::tPinDOUT
+    }
+  );
 
   int i = 0;
   while (1) {
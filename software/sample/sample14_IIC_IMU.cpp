@@ -27,24 +27,11 @@ typedef struct {
 } TIMU;
 
 //! 主要データ取り込み
+//! @note レジスタアドレスの書き込みから読み出しまでを1回のトランザクションで行う
 void get_imu_data (TIMU *t){
-  Wire.begin(ADDR_LSM6);
-  Wire.write(0x28);
-  Wire.begin(ADDR_LSM6, true);
-  Wire.read((uint8_t *)&t->acc[0],6);
-  Wire.end();
-
-  Wire.begin(ADDR_LSM6);
-  Wire.write(0x22);
-  Wire.begin(ADDR_LSM6, true);
-  Wire.read((uint8_t *)&t->gyro[0],6);
-  Wire.end();
-
-  Wire.begin(ADDR_LIS3);
-  Wire.write(0x28);
-  Wire.begin(ADDR_LIS3, true);
-  Wire.read((uint8_t *)&t->mag[0],6);
-  Wire.end();
+  Wire.read_reg(ADDR_LSM6, 0x28, &t->acc[0], 6);
+  Wire.read_reg(ADDR_LSM6, 0x22, &t->gyro[0], 6);
+  Wire.read_reg(ADDR_LIS3, 0x28, &t->mag[0], 6);
 }
 
 //! main関数
@@ -62,20 +49,12 @@ int main (void){
 
   if (Wire.ping(ADDR_LSM6) && Wire.ping(ADDR_LIS3)){
     // init LSM6DS3
-    Wire.begin(ADDR_LSM6);
-    Wire.write((const uint8_t[2]){0x10, 0x76},2); // 833Hz +/-16G
-    Wire.end();
-    Wire.begin(ADDR_LSM6);
-    Wire.write((const uint8_t[2]){0x11, 0x7c},2); // 833Hz +/-2000dps
-    Wire.end();
+    Wire.write_reg(ADDR_LSM6, 0x10, (const uint8_t[1]){0x76}, 1); // 833Hz +/-16G
+    Wire.write_reg(ADDR_LSM6, 0x11, (const uint8_t[1]){0x7c}, 1); // 833Hz +/-2000dps
 
     // init LIS3MDL
-    Wire.begin(ADDR_LIS3);
-    Wire.write((const uint8_t[2]){0x21, 0b00},2); // +/-4gauss
-    Wire.end();
-    Wire.begin(ADDR_LIS3);
-    Wire.write((const uint8_t[2]){0x22, 0b00},2); // Continuous converion
-    Wire.end();
+    Wire.write_reg(ADDR_LIS3, 0x21, (const uint8_t[1]){0b00}, 1); // +/-4gauss
+    Wire.write_reg(ADDR_LIS3, 0x22, (const uint8_t[1]){0b00}, 1); // Continuous converion
 
     while (1) {
       TIMU imu;
@@ -4,6 +4,8 @@
  @note
   STEMMA QT/Qwiicコネクタを使用してロータリーエンコーダボードと通信
   adafruit社のRotary Encoder Breakout with NeoPixelを想定
+  アドレス0x36～0x39のボードを最大4個まで検出し、10ms周期で位置とスイッチをまとめて読み出す
+  位置に応じてRGB LEDの色を変え、スイッチを押している間は消灯する
  */
 #include <ud5.h>
 #include <stdio.h>
@@ -15,43 +17,59 @@ CI2C Wire(CI2C::IIC_Fmp);
 
 //! エンコーダボードのデフォルトアドレス
 #define ADDR_ENC (0x36)
+//! エンコーダボードの最大数
+#define MAX_ENC (4)
+//! スイッチの端子
+#define SS_SWITCH (24)
+//! RGB LEDの端子
+#define SS_NEOPIX (6)
 
-//! 初期化
-void init (void) {
-/*
-  encoder = rotaryio.IncrementalEncoder(seesaw)
-//  seesaw.pin_mode(24, seesaw.INPUT_PULLUP)
-  self._pin_mode_bulk_x(8, 4, 1<<24, INPUT_PULLUP)
-
-#define _GPIO_BASE 0x01
-#define _GPIO_DIRCLR_BULK 0x03
-#define _GPIO_BULK_SET 0x05
-#define _GPIO_PULLENSET 0x0B
-      self.write(_GPIO_BASE, _GPIO_DIRCLR_BULK, cmd)
-      self.write(_GPIO_BASE, _GPIO_PULLENSET, cmd)
-      self.write(_GPIO_BASE, _GPIO_BULK_SET, cmd)
-
-  switch = digitalio.DigitalIO(seesaw, 24)
+//! エンコーダボードのレジスタ
+#define ENCODER_BASE (0x11)
+#define ENCODER_POSITION (0x30)
+#define GPIO_BASE (0x01)
+#define GPIO_BULK (0x04)
 
-  pixel = neopixel.NeoPixel(seesaw, 6, 1)
+CSeesaw enc[MAX_ENC] = {
+  CSeesaw (&Wire, ADDR_ENC + 0), CSeesaw (&Wire, ADDR_ENC + 1),
+  CSeesaw (&Wire, ADDR_ENC + 2), CSeesaw (&Wire, ADDR_ENC + 3)
+};
 
-  pixel.brightness = 0.5
+//! 検出したボード
+CSeesaw *knob[MAX_ENC];
+int num = 0;
 
-  last_position = -1
-  color = 0  # start at red
-*/
+//! 初期化
+void init (void) {
+  for (int i = 0; i < MAX_ENC; i++) {
+    if (!Wire.ping (ADDR_ENC + i) || !enc[i].begin()) continue;
+    dx.printf ("0x%02X:seesaw ver.%08X\n\r", ADDR_ENC + i, (int)enc[i].get_version());
+    // スイッチはプルアップ入力
+    enc[i].pin_mode_bulk (1UL << SS_SWITCH, CSeesaw::SS_INPUT_PULLUP);
+    // RGB LED 1個
+    enc[i].pixel_begin (SS_NEOPIX, 1);
+    enc[i].set_position (0);
+    knob[num++] = &enc[i];
+  }
 }
 
-//! エンコーダ取り込み
-uint8_t get_enc_data (void){
-/*
-  encoder.position
-*/
-  return 0;
+//! 色相(0～255)からRGBへ変換
+void colorwheel (uint8_t pos, uint8_t *r, uint8_t *g, uint8_t *b) {
+  if (pos < 85) {
+    *r = 255 - pos * 3; *g = pos * 3; *b = 0;
+  } else if (pos < 170) {
+    pos -= 85;
+    *r = 0; *g = 255 - pos * 3; *b = pos * 3;
+  } else {
+    pos -= 170;
+    *r = pos * 3; *g = 0; *b = 255 - pos * 3;
+  }
 }
 
-//! RGB LED点灯
-void set_led (uint8_t r, uint8_t g, uint8_t b) {
+//! RGB LED点灯 (明るさ1/2)
+void set_led (int i, uint8_t r, uint8_t g, uint8_t b) {
+  knob[i]->set_pixel (0, r / 2, g / 2, b / 2);
+  knob[i]->show_pixel();
 }
 
 //! main関数
@@ -68,12 +86,52 @@ int main (void){
   }
 
   init ();
-  if (Wire.ping(ADDR_ENC)){
-    while (1) {
-      dx.printf("enc :%5d", get_enc_data());
+  if (num == 0) {
+    dx.puts ("\n\rencoder not found\n\r");
+    return 0;
+  }
+
+  // 全ボードの位置とGPIOを1回の待ち時間でまとめて読み出す
+  uint8_t pos[MAX_ENC][4], gpio[MAX_ENC][4];
+  CSeesaw::TRead list[MAX_ENC * 2];
+  int32_t last[MAX_ENC];
+  bool last_sw[MAX_ENC];
+  for (int i = 0; i < num; i++) {
+    list[i * 2 + 0] = (CSeesaw::TRead) { knob[i], ENCODER_BASE, ENCODER_POSITION, pos[i], 4 };
+    list[i * 2 + 1] = (CSeesaw::TRead) { knob[i], GPIO_BASE, GPIO_BULK, gpio[i], 4 };
+    last[i] = -1;
+    last_sw[i] = false;
+  }
+
+  uint32_t t = UD5_GET_ELAPSEDTIME();
+  while (1) {
+    uint32_t tm = 0x7fffffffUL - LPC_MRT_CH3->TIMER;
+    CSeesaw::read_multi (list, num * 2);
+    tm = (((0x7fffffffUL - LPC_MRT_CH3->TIMER) - tm) & 0x7fffffffUL) / 32;
 
-      if (dx.rxbuff()) { if(dx.getc() == '!') UD5_SOFTRESET(); }
-      UD5_WAIT(20);
+    dx.puts ("\r");
+    for (int i = 0; i < num; i++) {
+      if ((list[i * 2].result != CI2C::IIC_OK) || (list[i * 2 + 1].result != CI2C::IIC_OK)) {
+        dx.printf ("enc%d:error ", i);
+        continue;
+      }
+      int32_t p = (int32_t) (((uint32_t)pos[i][0] << 24) | ((uint32_t)pos[i][1] << 16) | ((uint32_t)pos[i][2] << 8) | pos[i][3]);
+      bool sw = (gpio[i][0] & (1 << (SS_SWITCH - 24))) == 0;
+      dx.printf ("enc%d:%5d %s ", i, (int)p, sw ? "ON " : "OFF");
+      // 変化した時だけLEDを更新
+      if ((p != last[i]) || (sw != last_sw[i])) {
+        uint8_t r, g, b;
+        colorwheel (p * 4, &r, &g, &b);
+        if (sw) set_led (i, 0, 0, 0);
+        else set_led (i, r, g, b);
+        last[i] = p;
+        last_sw[i] = sw;
+      }
     }
+    dx.printf ("(%dus) \33[K", (int)tm);
+
+    if (dx.rxbuff()) { if(dx.getc() == '!') UD5_SOFTRESET(); }
+    t += 10;
+    while ((int32_t) (UD5_GET_ELAPSEDTIME() - t) < 0);
   }
 }
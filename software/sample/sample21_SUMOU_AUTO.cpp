@@ -7,12 +7,17 @@
 
 #include <ud5.h>
 
+//! センサ入力の変化をEXIOのINTで検出する場合は1
+//  Pmod I/Fの11番ピン(INT)とGPIO1の配線が必要
+//  0の場合は従来通りSPIで毎回入力を読み出す
+#define USE_EXIO_INT 0
+
 CDXIF dx;
 
 CGPIO gpio (
   (const CGPIO::TPinMode[10]) {
     CGPIO::tPinDIN_PU,  // 非常停止
-    CGPIO::tPinDIN_PU,
+    CGPIO::tPinDIN_PU,  // EXIOのINT (USE_EXIO_INT=1の場合にPmod I/Fの11番ピンと接続)
     CGPIO::tPinDIN_PU,
     CGPIO::tPinDIN_PU,
     CGPIO::tPinDIN_PU,  // DIP0
@@ -218,7 +223,7 @@ void TASK2 (void *pvParameters) {
 
   for (;;) {
     mmi.u16 = ~gpio.get_gpio();
-    sen.u16 = ~exio.get_gpio();
+    sen.u16 = ~exio.get_gpio(); // 変化検出中はSPI通信なしで最後の入力値を取得
 
     if (m1 < drive.get_m1()) {
       m1 += _MOTOR_RAMP;
@@ -284,6 +289,11 @@ void TASK3 (void *pvParameters) {
 int main (void) {
   exio.set_LED_off (0xf);
 
+#if USE_EXIO_INT
+  // センサ入力の変化をEXIOのINTで検出 (GPIO1・PININT0を使用)
+  exio.set_change_detect (0x001f, &gpio, 1, 0);
+#endif
+
   // 各タスクを作成
   xTaskCreate (TASK1, NULL, 100, NULL, 1, NULL);
   xTaskCreate (TASK2, NULL, 100, NULL, 1, NULL);
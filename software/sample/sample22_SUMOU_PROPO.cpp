@@ -213,8 +213,7 @@ void TASK1 (void *pvParameters) {
 void TASK2 (void *pvParameters) {
   int32_t m1 = 0, m2 = 0;
   portTickType t = xTaskGetTickCount();
-  uint32_t pulse[4], prev_pulse[4];
-  uint32_t nochange_cnt[4] = {0,0,0,0};
+  bool lost0, lost1;
 
   for (;;) {
     mmi.u16 = gpio.get_gpio();
@@ -224,14 +223,13 @@ void TASK2 (void *pvParameters) {
     sen.u16 = ~exio.get_gpio();
     // プロポの取り込みとモータへのランプ指令
       // パルス幅測定値から不感帯を加味した‰値へ変換
-    m1_pulse = rcstick.get_normal (0, _NEUTRAL_POS_DEAD, _MAX_POS_DEAD);
-    m2_pulse = rcstick.get_normal (1, _NEUTRAL_POS_DEAD, _MAX_POS_DEAD);
-
-    for (int i = 0; i < 4; i++) {
-      pulse[i] = gpio.get_pwd(i);
-      if (pulse[i] == prev_pulse[i]) nochange_cnt[i]++;
-      else nochange_cnt[i] = 0;
-      prev_pulse[i] = pulse[i];
+    m1_pulse = rcstick.get_normal (0, _NEUTRAL_POS_DEAD, _MAX_POS_DEAD, &lost0);
+    m2_pulse = rcstick.get_normal (1, _NEUTRAL_POS_DEAD, _MAX_POS_DEAD, &lost1);
+
+    // 受信機の信号が途絶えたらランプ処理を介さず即停止
+    if (lost0 || lost1) {
+      m1 = m2 = 0;
+      motor.set_biaxial_dual (0, 0);
     }
 
     gpio.get_pwd(2);
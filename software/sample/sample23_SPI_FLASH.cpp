@@ -0,0 +1,57 @@
+/*!
+ @file  sample23_SPI_FLASH.cpp
+ @brief SPI通信 シリアルフラッシュ
+ @note
+  GPIO端子にSPI0を割り当ててシリアルフラッシュ(W25Qシリーズ等)と通信
+  GPIO0:SSEL, GPIO1:SCK, GPIO2:MISO, GPIO3:MOSI
+  JEDEC IDの読み出しと先頭256バイトのダンプ、及び読み出し速度の計測を行う
+ */
+#include <ud5.h>
+
+CDXIF dx;
+
+//! GPIO0～3をSPI0に割り当て
+CGPIO gpio (
+  (const CGPIO::TPinMode[10]) {
+    CGPIO::tPinSPISEL, CGPIO::tPinSPISCK, CGPIO::tPinSPIMISO, CGPIO::tPinSPIMOSI,
+    CGPIO::tPinDIN, CGPIO::tPinDIN, CGPIO::tPinDIN, CGPIO::tPinDIN, CGPIO::tPinDIN, CGPIO::tPinDIN
+  }
+);
+
+//! SPI0
+CSPI spi;
+
+//! シリアルフラッシュ (モード0, 15MHz, SSELはハードウェアで制御)
+const CSPI::TDevice flash = { SPIMode0, SPIBitMSBF, 15000000, SPICSLow, -1 };
+
+uint8_t buf[1024];
+
+//! main関数
+int main (void) {
+  // JEDEC ID (コマンドに続けて3バイトを受信)
+  uint8_t id[4];
+  spi.transfer (&flash, (const uint8_t[4]) { 0x9f, 0, 0, 0 }, id, 4);
+  dx.printf ("\n\rJEDEC ID:%02X %02X %02X\n\r", id[1], id[2], id[3]);
+
+  // 先頭256バイトを読み出し (コマンド送信中はCSを保持)
+  spi.lock_sem();
+  spi.write (&flash, (const uint8_t[4]) { 0x03, 0, 0, 0 }, 4, true);
+  spi.read (&flash, buf, 256);
+  spi.unlock_sem();
+  for (int i = 0; i < 256; i++) dx.printf ("%02X%s", buf[i], ((i & 15) == 15) ? "\n\r" : " ");
+
+  // 1KBの読み出しを繰り返して転送速度を計測
+  while (1) {
+    uint32_t t = UD5_GET_ELAPSEDTIME();
+    for (int i = 0; i < 100; i++) {
+      spi.lock_sem();
+      spi.write (&flash, (const uint8_t[4]) { 0x03, 0, 0, 0 }, 4, true);
+      spi.read (&flash, buf, sizeof (buf));
+      spi.unlock_sem();
+    }
+    t = UD5_GET_ELAPSEDTIME() - t;
+    dx.printf ("\r100KB in %dms (%dkbit/s) \33[K", (int)t, (t > 0) ? (int) ((100 * 1024 * 8) / t) : 0);
+    if (dx.rxbuff()) break;
+    UD5_WAIT (500);
+  }
+}
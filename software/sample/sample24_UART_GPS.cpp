@@ -0,0 +1,30 @@
+/*!
+ @file  sample24_UART_GPS.cpp
+ @brief USART2によるGPS受信
+ @note
+  GPIO端子にUSART2を割り当ててGPSモジュールのNMEAを受信
+  GPIO4:TX, GPIO5:RX (9600bps 8N1)
+  受信はDMAのリングバッファで行われ、無信号期間で1秒毎のバーストの区切りを検出する
+ */
+#include <ud5.h>
+
+CDXIF dx;
+
+//! USART2 (GPIO4:TX, GPIO5:RX)
+CUART gps (2, 4, 5, 9600, CUART::fmt8N1, 64, 1024);
+
+uint8_t buf[1024];
+
+//! main関数
+int main (void) {
+  while (1) {
+    // 5ms(約5文字分)の無信号でバーストの終わりとみなす
+    uint16_t n = gps.wait_idle (5000, 2000);
+    if (n > 0) {
+      n = gps.getsb (buf, sizeof (buf));
+      dx.printf ("\n\r--- %d bytes (overrun:%d) ---\n\r", n, (int)gps.get_overrun());
+      dx.putsb (buf, n);
+    } else dx.puts ("\n\rno data\n\r");
+    if (dx.rxbuff()) break;
+  }
+}
@@ -0,0 +1,103 @@
+/*!
+ @file  sample25_IIC_BENCH.cpp
+ @brief I2C通信 レジスタ読み出しの所要時間比較
+ @note
+  STEMMA QT/Qwiicコネクタを使用してLSM6DS3TR-Cの加速度(6バイト)を繰り返し読み出す
+  以下の3通りの読み出しの所要時間を計測し、理論上のバス占有時間に対する比率(バス使用率)を表示する
+   polled : 割り込み化以前のCI2Cと同じ手順でレジスタをポーリングする読み出し (比較の基準)
+   split  : 現在のCI2Cでbegin/write/begin/read/endを個別に呼ぶ読み出し
+   read_reg: read_regによる1トランザクションの読み出し
+ */
+#include <ud5.h>
+
+CDXIF dx;
+
+//! I2Cポートを初期化 (1MHz)
+CI2C Wire(CI2C::IIC_Fmp);
+
+#define ADDR_LSM6 (0x6a)  //!< LSM6DS3TRのデバイスアドレス
+#define LOOPS     (1000)  //!< 計測回数
+#define BUS_FREQ  (1000)  //!< バスクロック[kHz]
+
+//! 1回の読み出しに必要なビット数
+//! START + (アドレス + レジスタ + アドレス + データ6バイト)x9 + Sr + STOP
+#define BUS_BITS  (1 + (3 + 6) * 9 + 1 + 1)
+
+//! ポーリングでSIを待つ (割り込み化以前のCI2C::i2c_wait_SIと同じ)
+static bool polled_wait (void) {
+  uint32_t elap = UD5_GET_ELAPSEDTIME() + 10;
+  while (!(LPC_I2C0->STAT & I2C_STAT_MSTPENDING)) {
+    if (UD5_GET_ELAPSEDTIME() > elap) return false;
+    _my_csw();
+  }
+  return true;
+}
+
+//! 割り込み化以前のCI2Cと同じ手順による読み出し
+//  転送中以外はI2C割り込みが許可されていないので、セマフォを取ればレジスタを直接操作できる
+void read_polled (uint8_t *buf) {
+  Wire.lock_sem();
+  LPC_I2C0->MSTDAT = ADDR_LSM6 << 1;
+  LPC_I2C0->MSTCTL = I2C_MSTCTL_MSTSTART;
+  if (polled_wait() && (((LPC_I2C0->STAT >> 1) & 7) == 2)) {
+    LPC_I2C0->MSTDAT = 0x28;
+    LPC_I2C0->MSTCTL = I2C_MSTCTL_MSTCONTINUE;
+    polled_wait();
+    LPC_I2C0->MSTDAT = (ADDR_LSM6 << 1) | 1;
+    LPC_I2C0->MSTCTL = I2C_MSTCTL_MSTSTART;
+    for (int i = 0; i < 6; i++) {
+      if (!polled_wait() || (((LPC_I2C0->STAT >> 1) & 7) != 1)) break;
+      buf[i] = LPC_I2C0->MSTDAT;
+      if (i < 5) LPC_I2C0->MSTCTL = I2C_MSTCTL_MSTCONTINUE;
+    }
+  }
+  LPC_I2C0->MSTCTL = I2C_MSTCTL_MSTSTOP;
+  polled_wait();
+  Wire.unlock_sem();
+}
+
+//! 現在のCI2Cでbegin/write/begin/read/endを個別に呼ぶ読み出し
+void read_split (uint8_t *buf) {
+  Wire.lock_sem();
+  Wire.begin (ADDR_LSM6);
+  Wire.write (0x28);
+  Wire.begin (ADDR_LSM6, true);
+  Wire.read (buf, 6);
+  Wire.end();
+  Wire.unlock_sem();
+}
+
+//! 1トランザクションによる読み出し
+void read_combined (uint8_t *buf) {
+  Wire.read_reg (ADDR_LSM6, 0x28, buf, 6);
+}
+
+//! 計測と表示
+void bench (const char *name, void (*func) (uint8_t *)) {
+  uint8_t buf[6];
+  uint32_t t = UD5_GET_ELAPSEDTIME();
+  for (int i = 0; i < LOOPS; i++) func (buf);
+  t = UD5_GET_ELAPSEDTIME() - t;
+  // 理論上のバス占有時間[ms]
+  uint32_t busy = (LOOPS * BUS_BITS) / BUS_FREQ;
+  dx.printf ("%-9s: %dms (%dus/read) bus utilisation %d%%\n\r", name, (int)t, (int) ((t * 1000) / LOOPS), (t > 0) ? (int) ((busy * 100) / t) : 0);
+}
+
+//! main関数
+int main (void) {
+  if (!Wire.ping (ADDR_LSM6)) {
+    dx.puts ("\n\rLSM6DS3TR-C not found\n\r");
+    return 0;
+  }
+  // 833Hz +/-16G
+  Wire.write_reg (ADDR_LSM6, 0x10, (const uint8_t[1]) { 0x76 }, 1);
+
+  while (1) {
+    dx.puts ("\n\r");
+    bench ("polled", read_polled);
+    bench ("split", read_split);
+    bench ("read_reg", read_combined);
+    if (dx.rxbuff()) break;
+    UD5_WAIT (1000);
+  }
+}
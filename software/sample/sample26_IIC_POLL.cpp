@@ -0,0 +1,63 @@
+/*!
+ @file  sample26_IIC_POLL.cpp
+ @brief I2C通信 周期ポーリング
+ @note
+  STEMMA QT/Qwiicコネクタに接続したLSM6DS3TR-C + LIS3MDLを周期的に読み出す
+  加速度/角速度は1ms周期、地磁気は10ms周期でCI2CPollが読み出し、表示タスクは
+  最新の値とタイムスタンプ、周期抜けの回数、バス使用率を表示する
+ */
+#include <ud5.h>
+
+CDXIF dx;
+
+//! I2Cポートを初期化
+CI2C Wire(CI2C::IIC_Fmp);
+
+// 各センサのデフォルトアドレス
+#define ADDR_LSM6 (0x6a)  //!< LSM6DS3TRのデバイスアドレス
+#define ADDR_LIS3 (0x1c)  //!< LIS3MDLのデバイスアドレス
+
+int16_t imu[6];   //!< 角速度, 加速度
+int16_t mag[3];   //!< 地磁気
+
+//! ポーリングテーブル
+const CI2CPoll::TPollEntry poll_table[2] = {
+  { ADDR_LSM6, 0x22, sizeof (imu), 1, (uint8_t *)imu },
+  { ADDR_LIS3, 0x28, sizeof (mag), 10, (uint8_t *)mag },
+};
+
+CI2CPoll poll (&Wire, poll_table, 2);
+
+//! 表示タスク
+void DISP_TASK (void *pvParameters) {
+  poll.begin();
+  while (1) {
+    int16_t d[6];
+    CI2CPoll::TPollStatus st;
+
+    poll.get (0, d, &st);
+    dx.printf ("IMU:%6d %6d %6d %6d %6d %6d (%5dms n:%d miss:%d err:%d) ",
+      d[0], d[1], d[2], d[3], d[4], d[5], (int)st.tick, (int)st.count, (int)st.misses, (int)st.errors);
+    poll.get (1, d, &st);
+    dx.printf ("MAG:%6d %6d %6d (n:%d miss:%d) ", d[0], d[1], d[2], (int)st.count, (int)st.misses);
+    uint16_t u = poll.get_utilisation();
+    dx.printf ("BUS:%d.%d%%\r", u / 10, u % 10);
+
+    if (dx.rxbuff()) { if(dx.getc() == '!') UD5_SOFTRESET(); }
+    UD5_WAIT (100);
+  }
+}
+
+//! main関数
+int main (void) {
+  if (Wire.ping(ADDR_LSM6) && Wire.ping(ADDR_LIS3)){
+    Wire.write_reg(ADDR_LSM6, 0x10, (const uint8_t[1]){0x76}, 1); // 833Hz +/-16G
+    Wire.write_reg(ADDR_LSM6, 0x11, (const uint8_t[1]){0x7c}, 1); // 833Hz +/-2000dps
+    Wire.write_reg(ADDR_LIS3, 0x21, (const uint8_t[1]){0b00}, 1); // +/-4gauss
+    Wire.write_reg(ADDR_LIS3, 0x22, (const uint8_t[1]){0b00}, 1); // Continuous converion
+
+    xTaskCreate (DISP_TASK, NULL, 200, NULL, 1, NULL);
+    // カーネル起動
+    vTaskStartScheduler();
+  }
+}
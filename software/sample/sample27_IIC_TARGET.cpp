@@ -0,0 +1,105 @@
+/*!
+ @file  sample27_IIC_TARGET.cpp
+ @brief I2Cターゲット(スレーブ) レジスタマップ
+ @note
+  GPIO端子にI2C1を割り当て、UD5をアドレス0x40のI2Cターゲットとして動作させる
+  GPIO8:SCL, GPIO9:SDA (プルアップはマスタ側)
+
+  レジスタマップ
+   0x00-0x07 エンコーダカウント int32 x2 (読み出しのみ)
+   0x08-0x0b 経過時間[ms] uint32 (読み出しのみ)
+   0x10-0x13 速度指令 int16 x2 (読み書き)
+
+  Raspberry Piからは以下の様にアクセスできる
+   i2ctransfer -y 1 w1@0x40 0x00 r12      (エンコーダと経過時間の読み出し)
+   i2ctransfer -y 1 w5@0x40 0x10 0x64 0x00 0x9c 0xff   (速度指令 100, -100)
+
+  GPIO0をGNDに短絡しておくと、STEMMA QT/QwiicコネクタのSCL/SDAをGPIO8/9に配線した状態で
+  UD5自身のI2C0をマスタとした折り返し試験を行う
+ */
+#include <ud5.h>
+
+CDXIF dx;
+
+//! GPIO8,9以外は入力
+CGPIO gpio (
+  (const CGPIO::TPinMode[10]) {
+    CGPIO::tPinDIN_PU, CGPIO::tPinDIN, CGPIO::tPinDIN, CGPIO::tPinDIN, CGPIO::tPinDIN,
+    CGPIO::tPinDIN, CGPIO::tPinDIN, CGPIO::tPinDIN, CGPIO::tPinSPFUNC, CGPIO::tPinSPFUNC
+  }
+);
+
+#define ADDR_TARGET (0x40)  //!< ターゲットのアドレス
+
+//! レジスタマップ
+struct {
+  int32_t enc[2];       //!< 0x00
+  uint32_t tick;        //!< 0x08
+  uint8_t reserve[4];
+  int16_t speed[2];     //!< 0x10
+} regs;
+
+//! I2C1 (GPIO8:SCL, GPIO9:SDA), 0x10から4バイトが書き込み可
+CI2CTarget target (1, 8, 9, ADDR_TARGET, (uint8_t *)&regs, sizeof (regs), 0x10, 4);
+
+volatile uint32_t written;
+
+//! マスタからの書き込み (割り込みから呼ばれる)
+void on_write (uint8_t reg, uint8_t len, void *arg) {
+  written++;
+}
+
+//! 折り返し試験
+void loopback_test (void) {
+  CI2C Wire (CI2C::IIC_Fm);
+  int ng = 0;
+
+  // 読み出しのみのレジスタを更新してマスタから読み出す
+  int32_t enc[2] = { 123456, -654321 };
+  target.set (0x00, enc, sizeof (enc));
+  int32_t rd[2] = { 0, 0 };
+  if ((Wire.read_reg (ADDR_TARGET, 0x00, rd, sizeof (rd)) != CI2C::IIC_OK) || (rd[0] != enc[0]) || (rd[1] != enc[1])) ng++;
+  dx.printf ("read  enc     :%d %d\n\r", (int)rd[0], (int)rd[1]);
+
+  // 書き込み可能なレジスタへの書き込みと読み戻し
+  int16_t sp[2] = { 100, -100 }, sr[2] = { 0, 0 };
+  uint32_t w = written;
+  if (Wire.write_reg (ADDR_TARGET, 0x10, sp, sizeof (sp)) != CI2C::IIC_OK) ng++;
+  target.get (0x10, sr, sizeof (sr));
+  if ((sr[0] != sp[0]) || (sr[1] != sp[1]) || (written != w + 1)) ng++;
+  dx.printf ("write speed   :%d %d (handler:%d)\n\r", sr[0], sr[1], (int) (written - w));
+
+  // 読み出しのみのレジスタへの書き込みはNACKとなる
+  uint8_t r = Wire.write_reg (ADDR_TARGET, 0x00, sp, sizeof (sp));
+  if (r != CI2C::IIC_NACK_DATA) ng++;
+  dx.printf ("write enc     :result %d\n\r", r);
+
+  // マップ外の読み出しは0xff
+  uint8_t ff[2] = { 0, 0 };
+  Wire.read_reg (ADDR_TARGET, sizeof (regs) - 1, ff, 2);
+  if (ff[1] != 0xff) ng++;
+  dx.printf ("read past end :%02X %02X\n\r", ff[0], ff[1]);
+
+  dx.printf ("%s (%d errors)\n\r", (ng == 0) ? "PASS" : "FAIL", ng);
+}
+
+//! main関数
+int main (void) {
+  target.set_handler (on_write);
+
+  if ((gpio.get_gpio() & 1) == 0) loopback_test();
+
+  while (1) {
+    // 公開するデータを更新
+    int32_t enc[2] = { gpio.get_encoder_count (0), gpio.get_encoder_count (1) };
+    uint32_t tick = UD5_GET_ELAPSEDTIME();
+    target.set (0x00, enc, sizeof (enc));
+    target.set (0x08, &tick, sizeof (tick));
+
+    int16_t sp[2];
+    target.get (0x10, sp, sizeof (sp));
+    dx.printf ("speed:%5d %5d  read:%d write:%d\r", sp[0], sp[1], (int)target.get_reads(), (int)target.get_writes());
+    if (dx.rxbuff()) break;
+    UD5_WAIT (10);
+  }
+}
@@ -0,0 +1,58 @@
+/*!
+ @file  sample28_IMU_FIFO.cpp
+ @brief I2C通信 IMU (FIFOとデータレディ割り込み)
+ @note
+  STEMMA QT/Qwiicコネクタを使用してLSM6DS3TR-C + LIS3MDLから1.66kHzでサンプリング
+  LSM6DS3TR-CのINT1をGPIO0に接続するとFIFOのしきい値割り込みで読み出しとタイム
+  スタンプの付与を行う (未接続の場合は1ms周期のポーリング)
+  表示タスクはリングバッファから全サンプルを取り出し、1秒毎の受信数と欠落数を表示する
+ */
+#include <ud5.h>
+
+CDXIF dx;
+
+//! GPIO0をPININT0に割り当て
+CGPIO gpio;
+
+//! I2Cポートを初期化
+CI2C Wire(CI2C::IIC_Fmp);
+
+//! IMU (INT1:GPIO0, PININT0, 256サンプルのリングバッファ)
+CIMU imu (&Wire, &gpio, 0, 0, 256);
+
+//! 表示タスク
+void DISP_TASK (void *pvParameters) {
+  uint32_t count = 0, t = UD5_GET_ELAPSEDTIME();
+  uint32_t first = 0, last = 0;
+  CIMU::TIMUSample s = { 0 };
+
+  while (1) {
+    // 溜まったサンプルを全て取り出す
+    while (imu.get (&s)) {
+      if (count == 0) first = s.stamp;
+      last = s.stamp;
+      count++;
+    }
+    if ((UD5_GET_ELAPSEDTIME() - t) >= 1000) {
+      t += 1000;
+      // タイムスタンプから求めたサンプリング周期
+      uint32_t period = (count > 1) ? (((last - first) & 0x7fffffffUL) / 32) * 10 / (count - 1) : 0;
+      dx.printf ("%4d samples/s (period %d.%dus) lost:%d ", (int)count, (int) (period / 10), (int) (period % 10), (int)imu.get_lost());
+      dx.printf ("Acc:%6d %6d %6d Gyro:%6d %6d %6d Mag:%6d %6d %6d\r",
+        s.acc[0], s.acc[1], s.acc[2], s.gyro[0], s.gyro[1], s.gyro[2], s.mag[0], s.mag[1], s.mag[2]);
+      count = 0;
+    }
+    if (dx.rxbuff()) { if(dx.getc() == '!') UD5_SOFTRESET(); }
+    UD5_WAIT (10);
+  }
+}
+
+//! main関数
+int main (void) {
+  // 1.66kHz, +/-16G, +/-2000dps, 16サンプル毎に割り込み
+  if (imu.begin (CIMU::ODR_1660, CIMU::XL_16G, CIMU::G_2000DPS, 16)) {
+    xTaskCreate (DISP_TASK, NULL, 200, NULL, 1, NULL);
+    // カーネル起動
+    vTaskStartScheduler();
+  } else dx.puts ("\n\rIMU not found\n\r");
+}
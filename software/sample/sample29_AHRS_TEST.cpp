@@ -0,0 +1,50 @@
+/*!
+ @file  sample29_AHRS_TEST.cpp
+ @brief 固定小数点AHRS
+ @note
+  STEMMA QT/Qwiicコネクタに接続したLSM6DS3TR-C + LIS3MDLのサンプルから
+  833Hzで姿勢を推定し、姿勢角と1回の更新に要した時間を表示する
+  倍精度のMahonyフィルタとの比較はsoftware/testのtest_ahrsでホスト上で行う
+ */
+#include <ud5.h>
+
+CDXIF dx;
+
+//! I2Cポートを初期化
+CI2C Wire(CI2C::IIC_Fmp);
+
+//! IMU (INT1未接続, 64サンプルのリングバッファ)
+CIMU imu (&Wire);
+
+//! AHRS (+/-2000dps, 833Hz)
+CAHRS ahrs (CIMU::G_2000DPS, 833);
+
+//! 表示タスク
+void DISP_TASK (void *pvParameters) {
+  CIMU::TIMUSample s;
+  uint32_t t = UD5_GET_ELAPSEDTIME();
+
+  ahrs.reset();
+  while (1) {
+    // 全サンプルでフィルタを更新
+    while (imu.get (&s)) ahrs.update (&s);
+    if ((UD5_GET_ELAPSEDTIME() - t) >= 100) {
+      t += 100;
+      int32_t r, p, h;
+      ahrs.get_euler (&r, &p, &h);
+      dx.printf ("roll:%6d pitch:%6d heading:%6d (x0.01deg) %3dus lost:%d  \r", (int)r, (int)p, (int)h, (int) (ahrs.get_exec_time() / 32), (int)imu.get_lost());
+    }
+    if (dx.rxbuff()) { if(dx.getc() == '!') UD5_SOFTRESET(); }
+    UD5_WAIT (5);
+  }
+}
+
+//! main関数
+int main (void) {
+  // 833Hz, +/-16G, +/-2000dps
+  if (imu.begin (CIMU::ODR_833, CIMU::XL_16G, CIMU::G_2000DPS)) {
+    xTaskCreate (DISP_TASK, NULL, 200, NULL, 1, NULL);
+    // カーネル起動
+    vTaskStartScheduler();
+  } else dx.puts ("\n\rIMU not found\n\r");
+}
@@ -0,0 +1,78 @@
+/*!
+ @file  sample30_OLED_FPS.cpp
+ @brief I2C通信 OLED 描画速度の計測
+ @note
+  STEMMA QT/Qwiicコネクタを使用してOLED表示
+  SSD1306 128x64 を想定
+  全画面の再描画と変更部分のみの転送を各々2秒間繰り返してフレームレートを計測し、
+  1MHzのバスで転送できる上限と比較する
+ @note
+  コンパイルオプション->etcタブのGCC追加オプ
+  ション指定に「ss_oled.cpp」を追記の事
+ */
+#include <ud5.h>
+#include <stdio.h>
+
+CDXIF dx;
+
+//! I2Cポートを初期化
+CI2C Wire(CI2C::IIC_Fmp);
+
+// OLED関連
+#include  <ss_oled.h>
+
+#define OLED_ADDR -1  //!< アドレスを自動検出
+#define FLIP180   0
+#define INVERT    0
+
+COLED::SSOLED ssoled;
+//! グラフィック描画用バッファ
+uint8_t ucBackBuffer[1024];
+COLED oled(&ssoled, &Wire, COLED::OLED_128x64, OLED_ADDR, FLIP180, INVERT, ucBackBuffer);
+
+//! 結果の表示 (bytes:1フレームのバイト数(アドレスを含む))
+void report (const char *name, uint32_t frames, uint32_t ms, uint32_t bytes) {
+  // 1バイト9クロック
+  uint32_t limit = 1000000UL / (bytes * 9);
+  uint32_t fps10 = (ms > 0) ? (frames * 10000UL) / ms : 0;
+  dx.printf ("%s: %d.%dfps (bus limit %dfps, %d%%)\n\r", name, (int) (fps10 / 10), (int) (fps10 % 10), (int)limit, (int) (fps10 * 10 / limit));
+}
+
+//! main関数
+int main (void){
+  char szTemp[32];
+
+  if (ssoled.rc == COLED::OLED_NOT_FOUND) {
+    dx.puts ("\n\rOLED not found\n\r");
+    return 0;
+  }
+
+  while (1) {
+    uint32_t t, n;
+
+    // 全画面の再描画 (1ページ毎にアドレス,位置指定の7バイト,データ128バイト)
+    oled.Fill (&ssoled, 0, 1);
+    n = 0;
+    t = UD5_GET_ELAPSEDTIME();
+    while ((UD5_GET_ELAPSEDTIME() - t) < 2000) {
+      oled.Rectangle (&ssoled, n & 127, 0, 127 - (n & 127), 63, n & 1, 1);
+      oled.DumpBuffer (&ssoled, NULL);
+      n++;
+    }
+    report ("full  ", n, UD5_GET_ELAPSEDTIME() - t, 8 * (1 + 7 + 128));
+
+    // 変更部分のみ (1行分の文字列)
+    oled.Fill (&ssoled, 0, 1);
+    n = 0;
+    t = UD5_GET_ELAPSEDTIME();
+    while ((UD5_GET_ELAPSEDTIME() - t) < 2000) {
+      sprintf (szTemp, "%8d", (int)n);
+      oled.WriteString (&ssoled, 0, 0, 3, szTemp, COLED::FONT_8x8, 0, 0);
+      oled.Flush (&ssoled);
+      n++;
+    }
+    report ("1 line", n, UD5_GET_ELAPSEDTIME() - t, 1 + 7 + 64);
+
+    if (dx.rxbuff()) { if(dx.getc() == '!') UD5_SOFTRESET(); }
+  }
+}
@@ -0,0 +1,93 @@
+/*!
+ @file  sample31_OLED_ASYNC.cpp
+ @brief I2C通信 OLED 非同期表示
+ @note
+  STEMMA QT/Qwiicコネクタを使用してOLED表示
+  SSD1306 128x64 を想定
+  1ms周期の制御タスクがバックバッファに描画してpresent()で渡し、転送は低優先度の
+  表示タスクが30fpsで行う
+  制御タスクの周期の揺らぎ(最大値)と描画に要した時間を1秒毎に表示する
+ @note
+  コンパイルオプション->etcタブのGCC追加オプ
+  ション指定に「ss_oled.cpp」を追記の事
+ */
+#include <ud5.h>
+#include <stdio.h>
+
+CDXIF dx;
+
+//! I2Cポートを初期化
+CI2C Wire(CI2C::IIC_Fmp);
+
+// OLED関連
+#include  <ss_oled.h>
+
+#define OLED_ADDR -1  //!< アドレスを自動検出
+#define FLIP180   0
+#define INVERT    0
+
+COLED::SSOLED ssoled;
+//! グラフィック描画用バッファ
+uint8_t ucBackBuffer[1024];
+COLED oled(&ssoled, &Wire, COLED::OLED_128x64, OLED_ADDR, FLIP180, INVERT, ucBackBuffer);
+
+//! 表示の転送
+COLEDRefresh refresh (&oled, &ssoled);
+
+volatile uint32_t jitter_max = 0;  //!< 周期の揺らぎの最大値 [us]
+volatile uint32_t draw_max = 0;    //!< 描画時間の最大値 [us]
+
+//! 制御タスク (1ms周期)
+void CTRL_TASK (void *pvParameters) {
+  portTickType t = xTaskGetTickCount();
+  uint32_t last = 0x7fffffffUL - LPC_MRT_CH3->TIMER;
+  uint32_t count = 0;
+  char szTemp[32];
+
+  while (1) {
+    vTaskDelayUntil (&t, 1);
+    uint32_t now = 0x7fffffffUL - LPC_MRT_CH3->TIMER;
+    uint32_t el = ((now - last) & 0x7fffffffUL) / 32;
+    uint32_t j = (el > 1000) ? el - 1000 : 1000 - el;
+    if (j > jitter_max) jitter_max = j;
+    last = now;
+
+    // 50ms毎に状態を描画
+    if ((++count % 50) == 0) {
+      sprintf (szTemp, "count:%8d", (int)count);
+      oled.WriteString (&ssoled, 0, 0, 0, szTemp, COLED::FONT_8x8, 0, 0);
+      oled.Rectangle (&ssoled, 0, 16, 127, 23, 0, 1);
+      oled.Rectangle (&ssoled, 0, 16, (count / 50) & 127, 23, 1, 1);
+      // 転送中で受け付けられなかった変更は次回に送られる
+      refresh.present();
+      el = (((0x7fffffffUL - LPC_MRT_CH3->TIMER) - now) & 0x7fffffffUL) / 32;
+      if (el > draw_max) draw_max = el;
+    }
+  }
+}
+
+//! 状態表示タスク
+void DISP_TASK (void *pvParameters) {
+  while (1) {
+    UD5_WAIT (1000);
+    dx.printf ("jitter:%4dus draw:%4dus frames:%d skipped:%d\n\r", (int)jitter_max, (int)draw_max, (int)refresh.get_frames(), (int)refresh.get_skipped());
+    jitter_max = draw_max = 0;
+    if (dx.rxbuff()) { if(dx.getc() == '!') UD5_SOFTRESET(); }
+  }
+}
+
+//! main関数
+int main (void){
+  if (ssoled.rc == COLED::OLED_NOT_FOUND) {
+    dx.puts ("\n\rOLED not found\n\r");
+    return 0;
+  }
+  oled.Fill (&ssoled, 0, 1);
+
+  xTaskCreate (CTRL_TASK, NULL, 200, NULL, 3, NULL);
+  xTaskCreate (DISP_TASK, NULL, 200, NULL, 2, NULL);
+  // 表示の転送は最も低い優先度で30fps
+  refresh.begin (30, 1);
+  // カーネル起動
+  vTaskStartScheduler();
+}
@@ -0,0 +1,134 @@
+/*!
+ @file  sample32_OLED_RASTER.cpp
+ @brief OLED 描画処理の速度計測
+ @note
+  sample15_IIC_OLEDのデモと同じ図形をバックバッファにのみ描画し(転送しない)、
+  図形毎に1個あたりの平均クロック数を表示する
+  OLEDが無くてもバッファへの描画は行えるので、検出できなかった場合は128x64として計測する
+  (ホスト上での計測と以前の実装との比較はtest/test_oled.cpp)
+ @note
+  コンパイルオプション->etcタブのGCC追加オプ
+  ション指定に「ss_oled.cpp」を追記の事
+ */
+#include <ud5.h>
+#include <stdio.h>
+
+CDXIF dx;
+
+//! I2Cポートを初期化
+CI2C Wire(CI2C::IIC_Fmp);
+
+// OLED関連
+#include  <ss_oled.h>
+
+#define OLED_ADDR -1  //!< アドレスを自動検出
+#define FLIP180   0
+#define INVERT    0
+
+COLED::SSOLED ssoled;
+//! グラフィック描画用バッファ
+uint8_t ucBackBuffer[1024];
+COLED oled(&ssoled, &Wire, COLED::OLED_128x64, OLED_ADDR, FLIP180, INVERT, ucBackBuffer);
+
+//! 乱数発生
+uint8_t randi (uint8_t max) {
+  return (max == 0u) ? 0u : rand()%(max+1);
+}
+
+//! 計測の開始
+static inline uint32_t tstart (void) {
+  return 0x7fffffffUL - LPC_MRT_CH3->TIMER;
+}
+
+//! 経過時間 [MRTカウント]
+static inline uint32_t tstop (uint32_t t) {
+  return ((0x7fffffffUL - LPC_MRT_CH3->TIMER) - t) & 0x7fffffffUL;
+}
+
+//! 結果の表示 (MRTは1usあたり32カウント,コアクロックは30MHz)
+void report (const char *name, uint32_t ticks, uint32_t n) {
+  dx.printf ("%-22s %7d cycles\n\r", name, (int) ((uint64_t)ticks * 30 / 32 / n));
+}
+
+//! main関数
+int main (void){
+  const int n = 100;
+  uint32_t t, sum;
+
+  if (ssoled.rc == COLED::OLED_NOT_FOUND) {
+    // 見つからなければ大きさが設定されず何も描かれないので、128x64とする
+    ssoled.oled_x = 128;
+    ssoled.oled_y = 64;
+    dx.puts ("\n\rOLED not found (buffer only)\n\r");
+  }
+  // OLEDの有無で結果が変わらない様に転送は行わない
+  oled.Fill (&ssoled, 0, 0);
+
+  while (1) {
+    dx.puts ("\n\r");
+    srand (1);
+
+    // 回転した文字列 (12文字)
+    for (int iRot = COLED::ROT_0; iRot <= COLED::ROT_270; iRot++) {
+      sum = 0;
+      for (int i = 0; i < n; i++) {
+        int x = randi (128), y = randi (64);
+        t = tstart();
+        oled.ScaledString (&ssoled, x, y, (char *)"Rotated Text", COLED::FONT_8x8, 0, 256, 256, iRot);
+        sum += tstop (t);
+      }
+      char szTemp[32];
+      sprintf (szTemp, "ScaledString rot%d", iRot * 90);
+      report (szTemp, sum, n);
+    }
+
+    // 2倍に拡大した文字列
+    sum = 0;
+    for (int i = 0; i < n; i++) {
+      int x = randi (128), y = randi (64);
+      t = tstart();
+      oled.ScaledString (&ssoled, x, y, (char *)"Scaled", COLED::FONT_8x8, 0, 512, 512, COLED::ROT_0);
+      sum += tstop (t);
+    }
+    report ("ScaledString x2", sum, n);
+
+    // 楕円 (輪郭,塗りつぶし)
+    for (int bFilled = 0; bFilled < 2; bFilled++) {
+      sum = 0;
+      for (int i = 0; i < n; i++) {
+        int x = randi (128), y = randi (64), rx = randi (64), ry = randi (32);
+        t = tstart();
+        oled.Ellipse (&ssoled, x, y, rx, ry, i & 1, bFilled);
+        sum += tstop (t);
+      }
+      report (bFilled ? "Ellipse filled" : "Ellipse outline", sum, n);
+    }
+
+    // 矩形 (輪郭,塗りつぶし)
+    for (int bFilled = 0; bFilled < 2; bFilled++) {
+      sum = 0;
+      for (int i = 0; i < n; i++) {
+        int x1 = randi (127), y1 = randi (63), x2 = randi (127), y2 = randi (63);
+        t = tstart();
+        oled.Rectangle (&ssoled, x1, y1, x2, y2, i & 1, bFilled);
+        sum += tstop (t);
+      }
+      report (bFilled ? "Rectangle filled" : "Rectangle outline", sum, n);
+    }
+
+    // 直線
+    sum = 0;
+    for (int i = 0; i < n; i++) {
+      int x1 = randi (127), y1 = randi (63), x2 = randi (127), y2 = randi (63);
+      t = tstart();
+      oled.DrawLine (&ssoled, x1, y1, x2, y2, 0);
+      sum += tstop (t);
+    }
+    report ("DrawLine", sum, n);
+
+    for (int i = 0; i < 30; i++) {
+      UD5_WAIT (100);
+      if (dx.rxbuff()) { if(dx.getc() == '!') UD5_SOFTRESET(); }
+    }
+  }
+}
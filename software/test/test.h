@@ -0,0 +1,21 @@
+/*!
+ @file  test.h
+ @brief ホスト上で行う試験の簡易な枠組み
+ */
+#pragma once
+
+#include <stdio.h>
+
+static int test_failed = 0, test_checked = 0;
+
+//! 条件が成り立たなければ場所を表示して失敗を数える
+#define CHECK(c) do { \
+    test_checked++; \
+    if (!(c)) { test_failed++; printf ("  %s:%d: CHECK (%s) failed\n", __FILE__, __LINE__, #c); } \
+  } while (0)
+
+//! 試験関数を実行
+#define RUN(f) do { printf ("%s\n", #f); f(); } while (0)
+
+//! 結果の表示 (mainの戻り値)
+#define REPORT() (printf ("%d checks, %d failed\n", test_checked, test_failed), (test_failed != 0))
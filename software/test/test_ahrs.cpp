@@ -0,0 +1,218 @@
+/*!
+ @file  test_ahrs.cpp
+ @brief CMahony(CAHRSの固定小数点演算)のホスト上での試験
+ @note
+  既知の回転から生成したセンサ値をCMahonyと倍精度のMahonyフィルタ(MahonyAHRS.cと同等)に与え、
+  ロール,ピッチ,方位の差が範囲内にある事を確認する
+  平方根,正規化,CORDICによるatan2も個別に確認する
+ */
+#include <stdio.h>
+#include <math.h>
+#include "ud5_mahony.h"
+#include "test.h"
+
+//! 倍精度の参照フィルタ (MahonyAHRS.cと同等, 地磁気が無ければ6軸)
+struct TRefAHRS {
+  double q[4] = { 1, 0, 0, 0 };
+  double twoKp = 1.0, dt = 1.0 / 833;
+
+  void update (double gx, double gy, double gz, double ax, double ay, double az, double mx, double my, double mz) {
+    double n = sqrt (ax * ax + ay * ay + az * az);
+    ax /= n; ay /= n; az /= n;
+    double q0 = q[0], q1 = q[1], q2 = q[2], q3 = q[3];
+    double vx = q1 * q3 - q0 * q2, vy = q0 * q1 + q2 * q3, vz = q0 * q0 - 0.5 + q3 * q3;
+    double ex = ay * vz - az * vy, ey = az * vx - ax * vz, ez = ax * vy - ay * vx;
+    n = sqrt (mx * mx + my * my + mz * mz);
+    if (n > 0) {
+      mx /= n; my /= n; mz /= n;
+      double hx = 2 * (mx * (0.5 - q2 * q2 - q3 * q3) + my * (q1 * q2 - q0 * q3) + mz * (q1 * q3 + q0 * q2));
+      double hy = 2 * (mx * (q1 * q2 + q0 * q3) + my * (0.5 - q1 * q1 - q3 * q3) + mz * (q2 * q3 - q0 * q1));
+      double bx = sqrt (hx * hx + hy * hy);
+      double bz = 2 * (mx * (q1 * q3 - q0 * q2) + my * (q2 * q3 + q0 * q1) + mz * (0.5 - q1 * q1 - q2 * q2));
+      double wx = bx * (0.5 - q2 * q2 - q3 * q3) + bz * (q1 * q3 - q0 * q2);
+      double wy = bx * (q1 * q2 - q0 * q3) + bz * (q0 * q1 + q2 * q3);
+      double wz = bx * (q0 * q2 + q1 * q3) + bz * (0.5 - q1 * q1 - q2 * q2);
+      ex += my * wz - mz * wy;
+      ey += mz * wx - mx * wz;
+      ez += mx * wy - my * wx;
+    }
+    gx += twoKp * ex;
+    gy += twoKp * ey;
+    gz += twoKp * ez;
+    gx *= 0.5 * dt; gy *= 0.5 * dt; gz *= 0.5 * dt;
+    q[0] += -q1 * gx - q2 * gy - q3 * gz;
+    q[1] += q0 * gx + q2 * gz - q3 * gy;
+    q[2] += q0 * gy - q1 * gz + q3 * gx;
+    q[3] += q0 * gz + q1 * gy - q2 * gx;
+    n = sqrt (q[0] * q[0] + q[1] * q[1] + q[2] * q[2] + q[3] * q[3]);
+    for (int i = 0; i < 4; i++) q[i] /= n;
+  }
+  // ロール,ピッチ,方位 [0.01deg]
+  void euler (int32_t e[3]) {
+    const double k = 18000.0 / M_PI;
+    e[0] = lround (k * atan2 (q[0] * q[1] + q[2] * q[3], 0.5 - q[1] * q[1] - q[2] * q[2]));
+    e[1] = lround (k * asin (2 * (q[0] * q[2] - q[1] * q[3])));
+    e[2] = lround (k * atan2 (q[0] * q[3] + q[1] * q[2], 0.5 - q[2] * q[2] - q[3] * q[3]));
+    if (e[2] < 0) e[2] += 36000;
+  }
+};
+
+//! 内部の関数を試験する為の派生クラス
+class CTestMahony : public CMahony {
+ public:
+  // +/-2000dps (70mdps/LSB) の感度 [rad/s/LSB] Q24
+  CTestMahony () : CMahony (20497, 833) {}
+  using CMahony::isqrt;
+  using CMahony::normalize;
+  using CMahony::atan2_cd;
+};
+
+//! ベクトルvをクォータニオンqの逆回転で機体座標に変換
+static void to_body (const double q[4], const double v[3], double r[3]) {
+  double q0 = q[0], q1 = q[1], q2 = q[2], q3 = q[3];
+  r[0] = (1 - 2 * (q2 * q2 + q3 * q3)) * v[0] + 2 * (q1 * q2 + q0 * q3) * v[1] + 2 * (q1 * q3 - q0 * q2) * v[2];
+  r[1] = 2 * (q1 * q2 - q0 * q3) * v[0] + (1 - 2 * (q1 * q1 + q3 * q3)) * v[1] + 2 * (q2 * q3 + q0 * q1) * v[2];
+  r[2] = 2 * (q1 * q3 + q0 * q2) * v[0] + 2 * (q2 * q3 - q0 * q1) * v[1] + (1 - 2 * (q1 * q1 + q2 * q2)) * v[2];
+}
+
+//! 角度の差 [0.01deg]
+static int32_t angle_diff (int32_t a, int32_t b) {
+  int32_t d = a - b;
+  while (d > 18000) d -= 36000;
+  while (d < -18000) d += 36000;
+  return (d < 0) ? -d : d;
+}
+
+//! 合成した動きで両方のフィルタを更新し、姿勢角の最大誤差を求める
+//  use_mag:地磁気を与える, acc_lsb:加速度の感度[LSB/G]
+static void run (bool use_mag, double acc_lsb, int32_t maxerr[3]) {
+  const double dt = 1.0 / 833, d2r = M_PI / 180;
+  // 真値の姿勢と地磁気 (北向き,伏角約50度)
+  double q[4] = { 1, 0, 0, 0 };
+  const double grav[3] = { 0, 0, 1 }, field[3] = { 0.3, 0, -0.36 };
+  CTestMahony ahrs;
+  TRefAHRS ref;
+  int32_t e[3], r[3];
+  const int n = 833 * 10;
+
+  for (int j = 0; j < 3; j++) maxerr[j] = 0;
+  for (int i = 0; i < n; i++) {
+    // 各軸を異なる周期で揺動 (最大約90dps)
+    double t = i * dt;
+    double w[3] = { 90 * sin (t * 1.3), 60 * sin (t * 0.7 + 1), 45 * cos (t * 0.5) };
+    double gb[3], mb[3];
+    to_body (q, grav, gb);
+    to_body (q, field, mb);
+
+    // 生データ (+/-2000dps:70mdps/LSB, 6842LSB/gauss)
+    int16_t gyro[3], acc[3], mag[3];
+    for (int j = 0; j < 3; j++) {
+      gyro[j] = lround (w[j] / 0.07);
+      acc[j] = lround (gb[j] * acc_lsb);
+      mag[j] = use_mag ? lround (mb[j] * 6842) : 0;
+    }
+
+    // 同じ生データを両方のフィルタに与える
+    ahrs.update (gyro, acc, use_mag ? mag : NULL);
+    ref.update (gyro[0] * 0.07 * d2r, gyro[1] * 0.07 * d2r, gyro[2] * 0.07 * d2r, acc[0], acc[1], acc[2], mag[0], mag[1], mag[2]);
+
+    ahrs.get_euler (&e[0], &e[1], &e[2]);
+    ref.euler (r);
+    for (int j = 0; j < 3; j++) {
+      int32_t d = angle_diff (e[j], r[j]);
+      if (d > maxerr[j]) maxerr[j] = d;
+    }
+
+    // 真値を積分
+    double h[3] = { w[0] * d2r * dt * 0.5, w[1] * d2r * dt * 0.5, w[2] * d2r * dt * 0.5 };
+    double q0 = q[0], q1 = q[1], q2 = q[2], q3 = q[3];
+    q[0] += -q1 * h[0] - q2 * h[1] - q3 * h[2];
+    q[1] += q0 * h[0] + q2 * h[2] - q3 * h[1];
+    q[2] += q0 * h[1] - q1 * h[2] + q3 * h[0];
+    q[3] += q0 * h[2] + q1 * h[1] - q2 * h[0];
+    double m = sqrt (q[0] * q[0] + q[1] * q[1] + q[2] * q[2] + q[3] * q[3]);
+    for (int j = 0; j < 4; j++) q[j] /= m;
+  }
+  printf ("  max error (x0.01deg) roll:%d pitch:%d heading:%d\n", (int)maxerr[0], (int)maxerr[1], (int)maxerr[2]);
+}
+
+//! 整数の平方根
+static void test_isqrt (void) {
+  for (uint32_t v = 0; v < 70000; v++) {
+    uint32_t r = CTestMahony::isqrt (v);
+    CHECK ((r * r <= v) && ((r + 1) * (r + 1) > v));
+  }
+  // 正規化で扱う最大値 (3 x 32768^2)
+  uint32_t r = CTestMahony::isqrt (3UL << 30);
+  CHECK (r == 56755);
+  CHECK (CTestMahony::isqrt (0xffffffffUL) == 65535);
+}
+
+//! 正規化 (飽和したベクトルでも単位長のQ30)
+static void test_normalize (void) {
+  const int16_t v[][3] = {
+    { -32768, -32768, -32768 }, { 32767, -32768, 32767 }, { 0, 0, -32768 }, { 2048, 0, 0 }, { 1, 1, 1 }, { 3, -4, 12 },
+  };
+  int32_t n[3];
+  for (unsigned k = 0; k < sizeof (v) / sizeof (v[0]); k++) {
+    CHECK (CTestMahony::normalize (v[k], n));
+    // 長さは整数の平方根 (切り捨て) で、各成分は30bitの精度
+    double len = floor (sqrt ((double)v[k][0] * v[k][0] + (double)v[k][1] * v[k][1] + (double)v[k][2] * v[k][2]));
+    for (int i = 0; i < 3; i++) CHECK (fabs (n[i] - v[k][i] / len * (1L << 30)) <= 1);
+  }
+  const int16_t zero[3] = { 0, 0, 0 };
+  CHECK (!CTestMahony::normalize (zero, n));
+}
+
+//! CORDICによるatan2
+static void test_atan2 (void) {
+  int32_t maxerr = 0;
+  for (int deg = -17999; deg <= 18000; deg += 7) {
+    double a = deg * M_PI / 18000;
+    int32_t mag;
+    int32_t r = CTestMahony::atan2_cd (lround (sin (a) * (1L << 30)), lround (cos (a) * (1L << 30)), &mag);
+    int32_t d = angle_diff (r, deg);
+    if (d > maxerr) maxerr = d;
+    // 長さはQ30の1
+    CHECK (labs (mag - (1L << 30)) < (1L << 30) / 1000);
+  }
+  printf ("  max error (x0.01deg) %d\n", (int)maxerr);
+  CHECK (maxerr <= 2);
+}
+
+//! 9軸 (地磁気あり)
+static void test_9axis (void) {
+  int32_t e[3];
+  run (true, 2048, e);
+  CHECK (e[0] <= 5);
+  CHECK (e[1] <= 5);
+  CHECK (e[2] <= 5);
+}
+
+//! 6軸 (地磁気なし)
+static void test_6axis (void) {
+  int32_t e[3];
+  run (false, 2048, e);
+  CHECK (e[0] <= 5);
+  CHECK (e[1] <= 5);
+  CHECK (e[2] <= 5);
+}
+
+//! 加速度の感度が高く、成分が飽和近くまで大きい場合 (+/-2G)
+static void test_large_acc (void) {
+  int32_t e[3];
+  run (true, 16384 * 1.99, e);
+  CHECK (e[0] <= 5);
+  CHECK (e[1] <= 5);
+  CHECK (e[2] <= 5);
+}
+
+int main (void) {
+  RUN (test_isqrt);
+  RUN (test_normalize);
+  RUN (test_atan2);
+  RUN (test_9axis);
+  RUN (test_6axis);
+  RUN (test_large_acc);
+  return REPORT();
+}
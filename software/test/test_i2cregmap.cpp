@@ -0,0 +1,306 @@
+/*!
+ @file  test_i2cregmap.cpp
+ @brief CI2CRegMap(CI2CTargetのレジスタマップ)のホスト上での試験
+ @note
+  I2Cブロックのスレーブ関連レジスタ(STAT,SLVCTL,SLVDAT)を構造体で模擬し、
+  バスマスタの操作毎にハードウェアと同じ状態を設定してisrを呼び出す
+  アドレス一致,リピーテッドスタート,読み出し専用レジスタへのNACK,BURSTの上限,
+  STOPでの反映を確認する
+ */
+#include <stdio.h>
+#include <string.h>
+#include "ud5_i2cregmap.h"
+#include "test.h"
+
+//! 模擬レジスタ
+typedef struct {
+  volatile uint32_t STAT;
+  volatile uint32_t SLVCTL;
+  volatile uint32_t SLVDAT;
+} TFakeI2C;
+
+static const uint8_t ADDR = 0x40;       // ターゲットのアドレス
+static const uint16_t SIZE = 0x78;      // レジスタマップの大きさ
+static const uint16_t WR_FIRST = 0x20;  // 書き込み可能なレジスタ 0x20-0x6f
+static const uint16_t WR_LEN = 0x50;
+
+//! 模擬バス (ターゲットのスレーブ機能とマスタの操作)
+class CFakeBus {
+  TFakeI2C regs;
+  CI2CRegMap *target;
+  bool selected;
+
+  // STATを設定してisrを呼び、SLVCTLでACKかを返す
+  bool step (uint32_t stat) {
+    regs.STAT = stat;
+    regs.SLVCTL = 0;
+    target->isr (&regs);
+    return regs.SLVCTL == CI2CRegMap::_SLVCTL_CONTINUE;
+  }
+
+ public:
+  int isr_calls;
+
+  CFakeBus (CI2CRegMap *t) : target (t), selected (false), isr_calls (0) {
+    memset ((void *)&regs, 0, sizeof (regs));
+  }
+
+  //! スタート(リピーテッドスタート)とアドレス (false:NACK)
+  bool start (uint8_t addr, bool read) {
+    // アドレスが一致しなければ選択が解除されるだけ
+    if (addr != ADDR) {
+      stop();
+      return false;
+    }
+    isr_calls++;
+    regs.SLVDAT = (addr << 1) | (read ? 1 : 0);
+    selected = true;
+    return step (CI2CRegMap::_STAT_SLVPENDING | (CI2CRegMap::_SLV_ADDR << 9));
+  }
+
+  //! 1バイト書き込み (false:NACK)
+  bool write (uint8_t d) {
+    if (!selected) return false;
+    isr_calls++;
+    regs.SLVDAT = d;
+    return step (CI2CRegMap::_STAT_SLVPENDING | (CI2CRegMap::_SLV_RX << 9));
+  }
+
+  //! 1バイト読み出し
+  uint8_t read (void) {
+    if (!selected) return 0xff;
+    isr_calls++;
+    regs.SLVDAT = 0;
+    CHECK (step (CI2CRegMap::_STAT_SLVPENDING | (CI2CRegMap::_SLV_TX << 9)));
+    return regs.SLVDAT;
+  }
+
+  //! ストップ
+  void stop (void) {
+    if (!selected) return;
+    isr_calls++;
+    selected = false;
+    step (CI2CRegMap::_STAT_SLVDESEL);
+    // SLVDESELは1を書いて解除される
+    CHECK (regs.STAT == CI2CRegMap::_STAT_SLVDESEL);
+  }
+
+  //! レジスタアドレスとデータを書く (ACKされたデータのバイト数)
+  int write_regs (uint8_t reg, const uint8_t *d, int n) {
+    int i = 0;
+    if (start (ADDR, false) && write (reg)) {
+      for (; i < n; i++) if (!write (d[i])) break;
+    }
+    stop();
+    return i;
+  }
+
+  //! レジスタアドレスを書いてリピーテッドスタートで読む
+  bool read_regs (uint8_t reg, uint8_t *d, int n) {
+    bool ok = start (ADDR, false) && write (reg) && start (ADDR, true);
+    if (ok) for (int i = 0; i < n; i++) d[i] = read();
+    stop();
+    return ok;
+  }
+};
+
+static uint8_t map[SIZE];
+
+//! マップを既知の値で埋める
+static void fill (void) {
+  for (int i = 0; i < SIZE; i++) map[i] = i;
+}
+
+//! 書き込みハンドラの記録
+static int handler_calls;
+static uint8_t handler_reg, handler_len;
+static void handler (uint8_t reg, uint8_t len, void *arg) {
+  handler_calls++;
+  handler_reg = reg;
+  handler_len = len;
+  CHECK (arg == (void *)map);
+  // 呼ばれた時点でマップに反映されている
+  CHECK (map[reg] == 0xa0);
+}
+
+//! CI2CTargetと同様にハンドラを取り付けたレジスタマップ
+class CTestMap : public CI2CRegMap {
+ public:
+  CTestMap () : CI2CRegMap (map, SIZE, WR_FIRST, WR_LEN) {
+    handler_calls = 0;
+    _handler = handler;
+    _handler_arg = map;
+  }
+};
+
+//! アドレス一致
+static void test_address (void) {
+  fill();
+  CTestMap t;
+  CFakeBus bus (&t);
+
+  // 他のアドレスへの転送ではisrは呼ばれず、マップも変わらない
+  CHECK (!bus.start (ADDR + 1, false));
+  CHECK (!bus.write (WR_FIRST));
+  CHECK (!bus.write (0xa0));
+  bus.stop();
+  CHECK (bus.isr_calls == 0);
+  CHECK (map[WR_FIRST] == WR_FIRST);
+
+  // 自分のアドレスでは書き込みと読み出しの両方にACK
+  CHECK (bus.start (ADDR, false));
+  bus.stop();
+  CHECK (bus.start (ADDR, true));
+  CHECK (bus.read() == 0x00);
+  bus.stop();
+  CHECK (t.get_reads() == 1);
+  CHECK (t.get_writes() == 0);
+
+  // マップの範囲外のレジスタアドレスはNACK
+  CHECK (bus.start (ADDR, false));
+  CHECK (!bus.write (SIZE));
+  bus.stop();
+
+  // 転送の途中で他のデバイスが選択されると、それまでの書き込みが反映される
+  CHECK (bus.start (ADDR, false));
+  CHECK (bus.write (WR_FIRST));
+  CHECK (bus.write (0xa0));
+  CHECK (!bus.start (ADDR + 1, false));
+  CHECK (map[WR_FIRST] == 0xa0);
+  CHECK (t.get_writes() == 1);
+}
+
+//! リピーテッドスタート
+static void test_repeated_start (void) {
+  fill();
+  CTestMap t;
+  CFakeBus bus (&t);
+  uint8_t d[8];
+
+  // レジスタアドレスを書いてから読む
+  CHECK (bus.read_regs (0x10, d, 8));
+  for (int i = 0; i < 8; i++) CHECK (d[i] == 0x10 + i);
+  CHECK (t.get_reads() == 1);
+
+  // STOPを挟まなければアドレスは続きから
+  CHECK (bus.start (ADDR, true));
+  for (int i = 0; i < 4; i++) CHECK (bus.read() == 0x18 + i);
+  bus.stop();
+
+  // 書き込みの後のリピーテッドスタートで書き込みが反映され、続きから読める
+  CHECK (bus.start (ADDR, false));
+  CHECK (bus.write (WR_FIRST));
+  CHECK (bus.write (0xa0));
+  CHECK (bus.write (0xa1));
+  CHECK (bus.start (ADDR, true));
+  CHECK (map[WR_FIRST] == 0xa0);
+  CHECK (map[WR_FIRST + 1] == 0xa1);
+  CHECK (handler_calls == 1);
+  CHECK (bus.read() == WR_FIRST + 2);
+  bus.stop();
+  // 読み出しだけのSTOPでは何も反映されない
+  CHECK (handler_calls == 1);
+  CHECK (t.get_writes() == 1);
+}
+
+//! 読み出し専用レジスタへの書き込みはNACK
+static void test_read_only (void) {
+  fill();
+  CTestMap t;
+  CFakeBus bus (&t);
+  const uint8_t d[4] = { 0xa0, 0xa1, 0xa2, 0xa3 };
+
+  // 読み出し専用の領域
+  CHECK (bus.write_regs (0x00, d, 4) == 0);
+  CHECK (map[0] == 0);
+  CHECK (t.get_writes() == 0);
+  CHECK (handler_calls == 0);
+
+  // 書き込み可能な領域の手前から
+  CHECK (bus.write_regs (WR_FIRST - 1, d, 4) == 0);
+  CHECK (map[WR_FIRST] == WR_FIRST);
+  CHECK (t.get_writes() == 0);
+
+  // 書き込み可能な領域の終わりを越えた所からNACKされ、それまでのデータは反映される
+  CHECK (bus.write_regs (WR_FIRST + WR_LEN - 2, d, 4) == 2);
+  CHECK (map[WR_FIRST + WR_LEN - 2] == 0xa0);
+  CHECK (map[WR_FIRST + WR_LEN - 1] == 0xa1);
+  CHECK (map[WR_FIRST + WR_LEN] == WR_FIRST + WR_LEN);
+  CHECK (handler_calls == 1);
+  CHECK (handler_reg == WR_FIRST + WR_LEN - 2);
+  CHECK (handler_len == 2);
+}
+
+//! BURSTの上限
+static void test_burst (void) {
+  fill();
+  CTestMap t;
+  CFakeBus bus (&t);
+  const int n = CI2CRegMap::BURST + 8;
+  uint8_t d[n];
+
+  // 書き込みはBURSTバイトまで
+  for (int i = 0; i < n; i++) d[i] = 0xa0 + i;
+  CHECK (bus.write_regs (WR_FIRST, d, n) == CI2CRegMap::BURST);
+  for (int i = 0; i < CI2CRegMap::BURST; i++) CHECK (map[WR_FIRST + i] == 0xa0 + i);
+  CHECK (map[WR_FIRST + CI2CRegMap::BURST] == WR_FIRST + CI2CRegMap::BURST);
+  CHECK (handler_len == CI2CRegMap::BURST);
+
+  // 読み出しはBURSTバイトまでがアドレス一致時の値で、以降は現在の値
+  fill();
+  CHECK (bus.start (ADDR, false));
+  CHECK (bus.write (0x00));
+  CHECK (bus.start (ADDR, true));
+  for (int i = 0; i < n; i++) {
+    d[i] = bus.read();
+    // 読み出しの途中でファームウェアがマップを更新する
+    if (i == 0) for (int j = 0; j < n; j++) map[j] = 0xc0 + j;
+  }
+  bus.stop();
+  for (int i = 0; i < CI2CRegMap::BURST; i++) CHECK (d[i] == i);
+  for (int i = CI2CRegMap::BURST; i < n; i++) CHECK (d[i] == 0xc0 + i);
+
+  // マップの終わりを越えた読み出しは0xff
+  fill();
+  CHECK (bus.read_regs (SIZE - 2, d, 4));
+  CHECK (d[0] == SIZE - 2);
+  CHECK (d[1] == SIZE - 1);
+  CHECK (d[2] == 0xff);
+  CHECK (d[3] == 0xff);
+}
+
+//! 書き込みはSTOPで反映される
+static void test_commit_at_stop (void) {
+  fill();
+  CTestMap t;
+  CFakeBus bus (&t);
+
+  CHECK (bus.start (ADDR, false));
+  CHECK (bus.write (WR_FIRST + 4));
+  for (int i = 0; i < 4; i++) {
+    CHECK (bus.write (0xa0 + i));
+    // STOPまではマップは変わらない
+    CHECK (map[WR_FIRST + 4 + i] == WR_FIRST + 4 + i);
+  }
+  CHECK (handler_calls == 0);
+  bus.stop();
+  for (int i = 0; i < 4; i++) CHECK (map[WR_FIRST + 4 + i] == 0xa0 + i);
+  CHECK (handler_calls == 1);
+  CHECK (handler_reg == WR_FIRST + 4);
+  CHECK (handler_len == 4);
+  CHECK (t.get_writes() == 1);
+
+  // レジスタアドレスだけの書き込みは反映するものが無い
+  CHECK (bus.write_regs (WR_FIRST, NULL, 0) == 0);
+  CHECK (handler_calls == 1);
+  CHECK (t.get_writes() == 1);
+}
+
+int main (void) {
+  RUN (test_address);
+  RUN (test_repeated_start);
+  RUN (test_read_only);
+  RUN (test_burst);
+  RUN (test_commit_at_stop);
+  return REPORT();
+}
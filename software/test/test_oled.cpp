@@ -0,0 +1,438 @@
+/*!
+ @file  test_oled.cpp
+ @brief COLEDのバッファへの描画のホスト上での試験と速度計測
+ @note
+  ss_oled.cppをI2Cを模擬したud5.h(host/ud5.h)でビルドし、バックバッファにのみ描画する
+  ScaledStringは削除した1ピクセル毎の実装と結果が一致する事を、
+  Ellipseは1ピクセル毎の実装との違いが輪郭の1ピクセル以内である事を確認する
+  続いてsample15_IIC_OLEDのデモと同じ図形を描画し、図形毎に1個あたりの時間を表示する
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <chrono>
+#include <ss_oled.h>
+#include "test.h"
+
+//! 以前の1ピクセル毎の実装 (比較用, 変更箇所の記録を除いてそのまま)
+class COLEDRef : public COLED {
+  // For drawing ellipses, a circle is drawn and the x and y pixels are scaled by a 16-bit integer fraction
+  // This function draws a single pixel and scales its position based on the x/y fraction of the ellipse
+  void DrawScaledPixel (SSOLED *pOLED, int iCX, int iCY, int x, int y, int32_t iXFrac, int32_t iYFrac, uint8_t ucColor) {
+    uint8_t *d, ucMask;
+
+    if (iXFrac != 0x10000) x = ((x * iXFrac) >> 16);
+    if (iYFrac != 0x10000) y = ((y * iYFrac) >> 16);
+    x += iCX;
+    y += iCY;
+    if (x < 0 || x >= pOLED->oled_x || y < 0 || y >= pOLED->oled_y)
+      return; // off the screen
+    d = &pOLED->ucScreen[ ((y >> 3) * 128) + x];
+    ucMask = 1 << (y & 7);
+    if (ucColor)
+      *d |= ucMask;
+    else
+      *d &= ~ucMask;
+  }
+
+  // For drawing filled ellipses
+  void DrawScaledLine (SSOLED *pOLED, int iCX, int iCY, int x, int y, int32_t iXFrac, int32_t iYFrac, uint8_t ucColor) {
+    int iLen, x2;
+    uint8_t *d, ucMask;
+    if (iXFrac != 0x10000) x = ((x * iXFrac) >> 16);
+    if (iYFrac != 0x10000) y = ((y * iYFrac) >> 16);
+    iLen = x * 2;
+    x = iCX - x;
+    y += iCY;
+    x2 = x + iLen;
+    if (y < 0 || y >= pOLED->oled_y)
+      return; // completely off the screen
+    if (x < 0) x = 0;
+    if (x2 >= pOLED->oled_x) x2 = pOLED->oled_x - 1;
+    iLen = x2 - x + 1; // new length
+    d = &pOLED->ucScreen[ ((y >> 3) * 128) + x];
+    ucMask = 1 << (y & 7);
+    if (ucColor) { // white
+      for (; iLen > 0; iLen--)
+        *d++ |= ucMask;
+    } else { // black
+      for (; iLen > 0; iLen--)
+        *d++ &= ~ucMask;
+    }
+  }
+
+  // Draw the 8 pixels around the Bresenham circle
+  // (scaled to make an ellipse)
+  void BresenhamCircle (SSOLED *pOLED, int iCX, int iCY, int x, int y, int32_t iXFrac, int32_t iYFrac, uint8_t ucColor, uint8_t bFill) {
+    if (bFill) { // draw a filled ellipse
+      // for a filled ellipse, draw 4 lines instead of 8 pixels
+      DrawScaledLine (pOLED, iCX, iCY, x, y, iXFrac, iYFrac, ucColor);
+      DrawScaledLine (pOLED, iCX, iCY, x, -y, iXFrac, iYFrac, ucColor);
+      DrawScaledLine (pOLED, iCX, iCY, y, x, iXFrac, iYFrac, ucColor);
+      DrawScaledLine (pOLED, iCX, iCY, y, -x, iXFrac, iYFrac, ucColor);
+    } else { // draw 8 pixels around the edges
+      DrawScaledPixel (pOLED, iCX, iCY, x, y, iXFrac, iYFrac, ucColor);
+      DrawScaledPixel (pOLED, iCX, iCY, -x, y, iXFrac, iYFrac, ucColor);
+      DrawScaledPixel (pOLED, iCX, iCY, x, -y, iXFrac, iYFrac, ucColor);
+      DrawScaledPixel (pOLED, iCX, iCY, -x, -y, iXFrac, iYFrac, ucColor);
+      DrawScaledPixel (pOLED, iCX, iCY, y, x, iXFrac, iYFrac, ucColor);
+      DrawScaledPixel (pOLED, iCX, iCY, -y, x, iXFrac, iYFrac, ucColor);
+      DrawScaledPixel (pOLED, iCX, iCY, y, -x, iXFrac, iYFrac, ucColor);
+      DrawScaledPixel (pOLED, iCX, iCY, -y, -x, iXFrac, iYFrac, ucColor);
+    }
+  }
+
+ public:
+  // Draw a string with a fractional scale in both dimensions
+  int ScaledString (SSOLED *pOLED, int x, int y, char *szMsg, int iSize, int bInvert, int iXScale, int iYScale, int iRotation) {
+    uint32_t row, col, dx, dy;
+    uint32_t sx, sy;
+    uint8_t c, uc, color, *d;
+    const uint8_t *s;
+    uint8_t ucTemp[16];
+    int tx, ty, bit, iFontOff;
+    int iPitch;
+    int iFontWidth;
+
+    if (iXScale == 0 || iYScale == 0 || szMsg == NULL || pOLED == NULL || pOLED->ucScreen == NULL || x < 0 || y < 0 || x >= pOLED->oled_x - 1 || y >= pOLED->oled_y - 1)
+      return -1; // invalid display structure
+    if (iSize != FONT_8x8 && iSize != FONT_6x8)
+      return -1; // only on the small fonts (for now)
+    iFontWidth = (iSize == FONT_6x8) ? 6 : 8;
+    s = (iSize == FONT_6x8) ? ucSmallFont : ucFont;
+    iPitch = pOLED->oled_x;
+    dx = (iFontWidth * iXScale) >> 8; // width of each character
+    dy = (8 * iYScale) >> 8; // height of each character
+    sx = 65536 / iXScale; // turn the scale into an accumulator value
+    sy = 65536 / iYScale;
+    while (*szMsg) {
+      c = *szMsg++; // debug - start with normal font
+      iFontOff = (int) (c - 32) * (iFontWidth - 1);
+      // we can't directly use the pointer to FLASH memory, so copy to a local buffer
+      ucTemp[0] = 0; // first column is blank
+      memcpy (&ucTemp[1], &s[iFontOff], iFontWidth - 1);
+      if (bInvert) InvertBytes (ucTemp, iFontWidth);
+      col = 0;
+      for (tx = 0; tx < (int)dx; tx++) {
+        row = 0;
+        uc = ucTemp[col >> 8];
+        for (ty = 0; ty < (int)dy; ty++) {
+          int nx = 0, ny = 0;
+          bit = row >> 8;
+          color = (uc & (1 << bit)); // set or clear the pixel
+          switch (iRotation) {
+            case ROT_0:
+              nx = x + tx;
+              ny = y + ty;
+              break;
+            case ROT_90:
+              nx = x - ty;
+              ny = y + tx;
+              break;
+            case ROT_180:
+              nx = x - tx;
+              ny = y - ty;
+              break;
+            case ROT_270:
+              nx = x + ty;
+              ny = y - tx;
+              break;
+          }
+          // plot the pixel if it's within the image boundaries
+          if (nx >= 0 && ny >= 0 && nx < pOLED->oled_x && ny < pOLED->oled_y) {
+            d = &pOLED->ucScreen[ (ny >> 3) * iPitch + nx];
+            if (color)
+              d[0] |= (1 << (ny & 7));
+            else
+              d[0] &= ~ (1 << (ny & 7));
+          }
+          row += sy; // add fractional increment to source row of character
+        }
+        col += sx; // add fractional increment to source column
+      }
+      // update the 'cursor' position
+      switch (iRotation) {
+        case ROT_0:
+          x += dx;
+          break;
+        case ROT_90:
+          y += dx;
+          break;
+        case ROT_180:
+          x -= dx;
+          break;
+        case ROT_270:
+          y -= dx;
+          break;
+      }
+    }
+    return 0;
+  }
+
+  // Draw an outline or filled ellipse
+  void Ellipse (SSOLED *pOLED, int iCenterX, int iCenterY, int32_t iRadiusX, int32_t iRadiusY, uint8_t ucColor, uint8_t bFilled) {
+    int32_t iXFrac, iYFrac;
+    int iRadius, iDelta, x, y;
+
+    if (pOLED == NULL || pOLED->ucScreen == NULL)
+      return; // must have back buffer defined
+    if (iRadiusX <= 0 || iRadiusY <= 0) return; // invalid radii
+
+    if (iRadiusX > iRadiusY) { // use X as the primary radius
+      iRadius = iRadiusX;
+      iXFrac = 65536;
+      iYFrac = (iRadiusY * 65536) / iRadiusX;
+    } else {
+      iRadius = iRadiusY;
+      iXFrac = (iRadiusX * 65536) / iRadiusY;
+      iYFrac = 65536;
+    }
+    iDelta = 3 - (2 * iRadius);
+    x = 0;
+    y = iRadius;
+    while (x <= y) {
+      BresenhamCircle (pOLED, iCenterX, iCenterY, x, y, iXFrac, iYFrac, ucColor, bFilled);
+      x++;
+      if (iDelta < 0) {
+        iDelta += (4 * x) + 6;
+      } else {
+        iDelta += 4 * (x - y) + 10;
+        y--;
+      }
+    }
+  }
+};
+
+static CI2C bus;
+static COLED::SSOLED ssoled, refoled;
+static uint8_t ucBuffer[1024], ucRefBuffer[1024];
+static COLED oled (&ssoled, &bus, COLED::OLED_128x64, 0x3c, 0, 0, ucBuffer);
+static COLEDRef ref;
+
+//! 両方のバッファを同じ乱数で埋める
+static void scramble (void) {
+  for (int i = 0; i < 1024; i++) ucBuffer[i] = rand();
+  memcpy (ucRefBuffer, ucBuffer, sizeof (ucBuffer));
+}
+
+//! ピクセル
+static bool pixel (const uint8_t *buf, int x, int y) {
+  return (buf[(y >> 3) * 128 + x] >> (y & 7)) & 1;
+}
+
+//! 乱数発生 (sample15と同じ)
+static uint8_t randi (uint8_t max) {
+  return (max == 0u) ? 0u : rand() % (max + 1);
+}
+
+//! 初期化 (I2Cは常にACKを返すので見つかる)
+static void test_begin (void) {
+  CHECK (ssoled.rc != COLED::OLED_NOT_FOUND);
+  CHECK (ssoled.oled_x == 128);
+  CHECK (ssoled.oled_y == 64);
+  refoled = ssoled;
+  refoled.ucScreen = ucRefBuffer;
+}
+
+//! ScaledStringは以前の実装と同じ結果
+static void test_scaled_string (void) {
+  const int scale[] = { 256, 512, 384, 320, 200, 700 };
+  const int ns = sizeof (scale) / sizeof (scale[0]);
+  char szAll[96];
+  for (int i = 0; i < 95; i++) szAll[i] = 32 + i;
+  szAll[95] = 0;
+  char *msg[2] = { (char *)"Rotated Text", szAll };
+  int mismatch = 0;
+
+  srand (1);
+  for (int font = COLED::FONT_6x8; font <= COLED::FONT_8x8; font++)
+    for (int inv = 0; inv < 2; inv++)
+      for (int rot = COLED::ROT_0; rot <= COLED::ROT_270; rot++)
+        for (int sx = 0; sx < ns; sx++)
+          for (int sy = 0; sy < ns; sy++)
+            for (int m = 0; m < 2; m++)
+              for (int y = 0; y < 64; y += 7)
+                for (int x = 0; x < 128; x += 9) {
+                  scramble();
+                  int r1 = oled.ScaledString (&ssoled, x, y, msg[m], font, inv, scale[sx], scale[sy], rot);
+                  int r2 = ref.ScaledString (&refoled, x, y, msg[m], font, inv, scale[sx], scale[sy], rot);
+                  if ((r1 != r2) || (memcmp (ucBuffer, ucRefBuffer, sizeof (ucBuffer)) != 0)) {
+                    if (mismatch++ == 0) printf ("  font:%d inv:%d rot:%d scale:%d/%d x:%d y:%d\n", font, inv, rot, scale[sx], scale[sy], x, y);
+                  }
+                }
+  CHECK (mismatch == 0);
+}
+
+//! 点(x,y)から楕円(半径rx+1/2,ry+1/2)の境界までの距離 [ピクセル]
+//  境界上の点を細かく取って最も近い点を探す
+static double edge_distance (int x, int y, int cx, int cy, int rx, int ry) {
+  const int n = 2048;
+  double a = rx + 0.5, b = ry + 0.5, d = 1e9;
+  for (int i = 0; i < n; i++) {
+    double t = 2 * M_PI * i / n;
+    double ex = cx + a * cos (t) - x, ey = cy + b * sin (t) - y;
+    double l = ex * ex + ey * ey;
+    if (l < d) d = l;
+  }
+  return sqrt (d);
+}
+
+//! Ellipseと以前の実装との違いは境界の付近だけ
+//  新しい実装は半径rx+1/2,ry+1/2の楕円で、以前の実装は円を縮めて描く為、短い方の半径が切り捨てで縮む
+//  塗りつぶしは境界から√2ピクセル以内だけが異なり、輪郭は新しい実装の各点が境界から1ピクセル以内にある
+//  画面に収まる楕円では、以前の実装の輪郭の各点の隣(8近傍)に新しい実装の点がある
+static void test_ellipse (void) {
+  int fill_out = 0, edge_out = 0, cover_out = 0, samples = 0;
+  double worst_fill = 0, worst_edge = 0, worst_ref = 0;
+
+  for (int rx = 1; rx <= 40; rx += 3)
+    for (int ry = 1; ry <= 40; ry += 3)
+      for (int c = 0; c < 3; c++) {
+        // 画面の中央と、両端で切れる位置
+        const int cxs[3] = { 64, 5, 120 }, cys[3] = { 32, 60, 3 };
+        int cx = cxs[c], cy = cys[c];
+        // 画面に収まっているか (切れると以前の実装の縮んだ極だけが画面に残る)
+        bool inside = (cx - rx > 0) && (cx + rx < 127) && (cy - ry > 0) && (cy + ry < 63);
+        samples++;
+
+        // 塗りつぶし
+        memset (ucBuffer, 0, sizeof (ucBuffer));
+        memset (ucRefBuffer, 0, sizeof (ucRefBuffer));
+        oled.Ellipse (&ssoled, cx, cy, rx, ry, 1, 1);
+        ref.Ellipse (&refoled, cx, cy, rx, ry, 1, 1);
+        for (int y = 0; y < 64; y++)
+          for (int x = 0; x < 128; x++) {
+            if (pixel (ucBuffer, x, y) == pixel (ucRefBuffer, x, y)) continue;
+            double d = edge_distance (x, y, cx, cy, rx, ry);
+            if (d > worst_fill) worst_fill = d;
+            if (d > M_SQRT2) fill_out++;
+          }
+
+        // 輪郭
+        memset (ucBuffer, 0, sizeof (ucBuffer));
+        memset (ucRefBuffer, 0, sizeof (ucRefBuffer));
+        oled.Ellipse (&ssoled, cx, cy, rx, ry, 1, 0);
+        ref.Ellipse (&refoled, cx, cy, rx, ry, 1, 0);
+        for (int y = 0; y < 64; y++)
+          for (int x = 0; x < 128; x++) {
+            if (pixel (ucBuffer, x, y)) {
+              double d = edge_distance (x, y, cx, cy, rx, ry);
+              if (d > worst_edge) worst_edge = d;
+              if (d > 1.01) edge_out++;  // 境界の点の間隔による誤差を含む
+            }
+            if (pixel (ucRefBuffer, x, y)) {
+              bool near = false;
+              for (int j = -1; j <= 1 && !near; j++)
+                for (int i = -1; i <= 1 && !near; i++)
+                  if ((x + i >= 0) && (x + i < 128) && (y + j >= 0) && (y + j < 64)) near = pixel (ucBuffer, x + i, y + j);
+              if (!near && inside) cover_out++;
+              double d = edge_distance (x, y, cx, cy, rx, ry);
+              if (d > worst_ref) worst_ref = d;
+            }
+          }
+      }
+  printf ("  %d ellipses, max distance from the edge: filled diff %.2f, outline %.2f (per-pixel %.2f)\n", samples, worst_fill, worst_edge, worst_ref);
+  CHECK (fill_out == 0);
+  CHECK (edge_out == 0);
+  CHECK (cover_out == 0);
+}
+
+//! 黒での描画は白で描いた所だけを消す
+static void test_ellipse_clear (void) {
+  memset (ucBuffer, 0, sizeof (ucBuffer));
+  oled.Ellipse (&ssoled, 64, 32, 30, 20, 1, 1);
+  oled.Ellipse (&ssoled, 64, 32, 30, 20, 0, 1);
+  int n = 0;
+  for (int i = 0; i < 1024; i++) n += (ucBuffer[i] != 0);
+  CHECK (n == 0);
+}
+
+//! 経過時間 [ns]
+typedef std::chrono::steady_clock TClock;
+static double elapsed (TClock::time_point t) {
+  return std::chrono::duration<double, std::nano> (TClock::now() - t).count();
+}
+
+//! sample15_IIC_OLEDのデモと同じ図形の描画時間
+static void bench_scene (void) {
+  const int n = 20000;
+  char szTemp[32];
+  TClock::time_point t;
+  double tn, tr;
+
+  printf ("  %-22s %10s %10s\n", "", "ns", "per-pixel");
+  for (int iRot = COLED::ROT_0; iRot <= COLED::ROT_270; iRot++) {
+    srand (1);
+    t = TClock::now();
+    for (int i = 0; i < n; i++) oled.ScaledString (&ssoled, randi (128), randi (64), (char *)"Rotated Text", COLED::FONT_8x8, 0, 256, 256, iRot);
+    tn = elapsed (t) / n;
+    srand (1);
+    t = TClock::now();
+    for (int i = 0; i < n; i++) ref.ScaledString (&refoled, randi (128), randi (64), (char *)"Rotated Text", COLED::FONT_8x8, 0, 256, 256, iRot);
+    tr = elapsed (t) / n;
+    snprintf (szTemp, sizeof (szTemp), "ScaledString rot%d", iRot * 90);
+    printf ("  %-22s %10.0f %10.0f\n", szTemp, tn, tr);
+  }
+
+  srand (1);
+  t = TClock::now();
+  for (int i = 0; i < n; i++) oled.ScaledString (&ssoled, randi (128), randi (64), (char *)"Scaled", COLED::FONT_8x8, 0, 512, 512, COLED::ROT_0);
+  tn = elapsed (t) / n;
+  srand (1);
+  t = TClock::now();
+  for (int i = 0; i < n; i++) ref.ScaledString (&refoled, randi (128), randi (64), (char *)"Scaled", COLED::FONT_8x8, 0, 512, 512, COLED::ROT_0);
+  tr = elapsed (t) / n;
+  printf ("  %-22s %10.0f %10.0f\n", "ScaledString x2", tn, tr);
+
+  for (int bFilled = 0; bFilled < 2; bFilled++) {
+    srand (1);
+    t = TClock::now();
+    for (int i = 0; i < n; i++) {
+      int x = randi (128), y = randi (64), rx = randi (64), ry = randi (32);
+      oled.Ellipse (&ssoled, x, y, rx, ry, i & 1, bFilled);
+    }
+    tn = elapsed (t) / n;
+    srand (1);
+    t = TClock::now();
+    for (int i = 0; i < n; i++) {
+      int x = randi (128), y = randi (64), rx = randi (64), ry = randi (32);
+      ref.Ellipse (&refoled, x, y, rx, ry, i & 1, bFilled);
+    }
+    tr = elapsed (t) / n;
+    printf ("  %-22s %10.0f %10.0f\n", bFilled ? "Ellipse filled" : "Ellipse outline", tn, tr);
+  }
+
+  for (int bFilled = 0; bFilled < 2; bFilled++) {
+    srand (1);
+    t = TClock::now();
+    for (int i = 0; i < n; i++) {
+      int x1 = randi (127), y1 = randi (63), x2 = randi (127), y2 = randi (63);
+      oled.Rectangle (&ssoled, x1, y1, x2, y2, i & 1, bFilled);
+    }
+    printf ("  %-22s %10.0f\n", bFilled ? "Rectangle filled" : "Rectangle outline", elapsed (t) / n);
+  }
+
+  srand (1);
+  t = TClock::now();
+  for (int i = 0; i < n; i++) {
+    int x1 = randi (127), y1 = randi (63), x2 = randi (127), y2 = randi (63);
+    oled.DrawLine (&ssoled, x1, y1, x2, y2, 0);
+  }
+  printf ("  %-22s %10.0f\n", "DrawLine", elapsed (t) / n);
+
+  // 描画だけでI2Cへは何も送られない
+  CHECK (bus.sent == 0);
+}
+
+int main (void) {
+  RUN (test_begin);
+  uint32_t init = bus.sent;
+  bus.sent = 0;
+  RUN (test_scaled_string);
+  RUN (test_ellipse);
+  RUN (test_ellipse_clear);
+  RUN (bench_scene);
+  printf ("  %u bytes sent by begin\n", (unsigned)init);
+  return REPORT();
+}
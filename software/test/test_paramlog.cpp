@@ -0,0 +1,231 @@
+/*!
+ @file  test_paramlog.cpp
+ @brief CParamLogのホスト上での試験
+ @note
+  フラッシュを配列で模擬し、追記中の電源断,セクタの回収,CRC不一致の破棄,
+  再マウントを確認する
+  電源断は指定した回数のページ操作の後に起こし、書き込み中のページは半分だけ書かれる
+ */
+#include <stdio.h>
+#include <string.h>
+#include "ud5_paramlog.h"
+#include "test.h"
+
+//! 模擬フラッシュ (2セクタ)
+static const uint32_t SECTORS = 2;
+static const uint32_t SIZE = CParamLog::_SECTOR_SIZE * SECTORS;
+static const uint32_t PAGES = SIZE / CParamLog::_PAGE_SIZE;
+static uint8_t flash[SIZE];
+static uint32_t erase_count[PAGES];
+
+//! 電源断までのページ操作数 (-1:断なし)
+static int32_t budget = -1;
+static bool powered = true;
+//! 消去されていないページへの書き込み
+static int overwrite = 0;
+
+// 1:通電, 0:この操作で断, -1:断の後
+static int power_step (void) {
+  if (!powered) return -1;
+  if (budget == 0) {
+    powered = false;
+    return 0;
+  }
+  if (budget > 0) budget--;
+  return 1;
+}
+
+static bool sim_erase (uint32_t addr) {
+  int p = power_step();
+  // 消去の途中で断 (前半だけ消える)
+  if (p == 0) memset (&flash[addr], 0xff, CParamLog::_PAGE_SIZE / 2);
+  if (p <= 0) return false;
+  memset (&flash[addr], 0xff, CParamLog::_PAGE_SIZE);
+  erase_count[addr / CParamLog::_PAGE_SIZE]++;
+  return true;
+}
+
+static bool sim_write (uint32_t addr, const uint32_t *src) {
+  const uint8_t *s = (const uint8_t *)src;
+  for (uint32_t i = 0; i < CParamLog::_PAGE_SIZE; i++) if (flash[addr + i] != 0xff) overwrite++;
+  int p = power_step();
+  // 書き込みの途中で断 (前半だけ書かれる)
+  if (p == 0) for (uint32_t i = 0; i < CParamLog::_PAGE_SIZE / 2; i++) flash[addr + i] &= s[i];
+  if (p <= 0) return false;
+  for (uint32_t i = 0; i < CParamLog::_PAGE_SIZE; i++) flash[addr + i] &= s[i];
+  return true;
+}
+
+static const uint8_t *sim_map (uint32_t addr) {
+  return &flash[addr];
+}
+
+static const CParamLog::TFlashIF sim = { sim_erase, sim_write, sim_map };
+
+//! 何も書かれていない状態に戻す
+static void blank (void) {
+  memset (flash, 0xff, sizeof (flash));
+  memset (erase_count, 0, sizeof (erase_count));
+  budget = -1;
+  powered = true;
+  overwrite = 0;
+}
+
+//! 電源を戻す
+static void power_on (void) {
+  budget = -1;
+  powered = true;
+}
+
+//! keyの値がvか
+static bool has (CParamLog &log, uint16_t key, uint32_t v) {
+  uint32_t d[8];
+  if (log.size_of (key) != (int32_t)sizeof (d)) return false;
+  if (!log.read (key, d, sizeof (d))) return false;
+  for (int i = 0; i < 8; i++) if (d[i] != v + i) return false;
+  return true;
+}
+
+//! keyに値vを書く
+static bool put (CParamLog &log, uint16_t key, uint32_t v) {
+  uint32_t d[8];
+  for (int i = 0; i < 8; i++) d[i] = v + i;
+  return log.write (key, d, sizeof (d));
+}
+
+//! 空の領域
+static void test_empty (void) {
+  blank();
+  CParamLog log (0, SECTORS, &sim);
+  uint32_t d;
+  CHECK (!log.read (CParamLog::keyUser, &d, sizeof (d)));
+  CHECK (log.size_of (CParamLog::keyUser) == -1);
+  CHECK (!log.write (CParamLog::_MAX_KEYS, &d, sizeof (d)));
+  CHECK (!log.write (CParamLog::keyUser, &d, CParamLog::_MAX_DATA + 1));
+}
+
+//! 読み書きと再マウント
+static void test_remount (void) {
+  blank();
+  {
+    CParamLog log (0, SECTORS, &sim);
+    CHECK (put (log, CParamLog::keyUser, 100));
+    CHECK (put (log, CParamLog::keyUser + 1, 200));
+    CHECK (put (log, CParamLog::keyUser, 300));
+    CHECK (has (log, CParamLog::keyUser, 300));
+    CHECK (log.remove (CParamLog::keyUser + 1));
+    CHECK (log.size_of (CParamLog::keyUser + 1) == -1);
+  }
+  {
+    CParamLog log (0, SECTORS, &sim);
+    CHECK (has (log, CParamLog::keyUser, 300));
+    CHECK (log.size_of (CParamLog::keyUser + 1) == -1);
+    // 再マウント後も続きに書かれる
+    CHECK (put (log, CParamLog::keyUser + 2, 400));
+    CHECK (has (log, CParamLog::keyUser + 2, 400));
+  }
+  {
+    CParamLog log (0, SECTORS, &sim);
+    CHECK (has (log, CParamLog::keyUser, 300));
+    CHECK (has (log, CParamLog::keyUser + 2, 400));
+  }
+  CHECK (overwrite == 0);
+}
+
+//! セクタの回収と消去回数の平準化
+static void test_reclaim (void) {
+  blank();
+  CParamLog log (0, SECTORS, &sim);
+  const int n = 999;
+  for (int i = 0; i < n; i++) CHECK (put (log, CParamLog::keyUser + (i % 3), i));
+  for (int k = 0; k < 3; k++) CHECK (has (log, CParamLog::keyUser + k, n - 3 + k));
+  CHECK (overwrite == 0);
+
+  // 全ページがほぼ同じ回数だけ消去される
+  uint32_t lo = 0xffffffffUL, hi = 0;
+  for (uint32_t pg = 0; pg < PAGES; pg++) {
+    if (erase_count[pg] < lo) lo = erase_count[pg];
+    if (erase_count[pg] > hi) hi = erase_count[pg];
+  }
+  CHECK (lo > 0);
+  CHECK (hi - lo <= 1);
+
+  CParamLog log2 (0, SECTORS, &sim);
+  for (int k = 0; k < 3; k++) CHECK (has (log2, CParamLog::keyUser + k, n - 3 + k));
+}
+
+//! 全ての時点での電源断 (追記と回収を含む)
+//  再マウント後は各キーが直前の値か新しい値のどちらかで、その後も書き込める
+static void test_power_loss (void) {
+  const int keys = 3, warm = 39, n = 60;
+  for (int cut = 0;; cut++) {
+    uint32_t expect[keys];
+    blank();
+    {
+      CParamLog log (0, SECTORS, &sim);
+      for (int i = 0; i < warm; i++) put (log, CParamLog::keyUser + (i % keys), i);
+      for (int k = 0; k < keys; k++) expect[k] = warm - keys + k;
+    }
+
+    // cut回のページ操作の後に断
+    int i, target = -1;
+    budget = cut;
+    {
+      CParamLog log (0, SECTORS, &sim);
+      for (i = warm; i < warm + n; i++) {
+        target = i % keys;
+        if (!put (log, CParamLog::keyUser + target, i)) break;
+        expect[target] = i;
+        target = -1;
+      }
+    }
+    bool done = powered;
+    power_on();
+
+    CParamLog log (0, SECTORS, &sim);
+    for (int k = 0; k < keys; k++) {
+      bool ok = has (log, CParamLog::keyUser + k, expect[k]) || ((k == target) && has (log, CParamLog::keyUser + k, i));
+      CHECK (ok);
+      if (!ok) {
+        printf ("  cut:%d key:%d\n", cut, k);
+        return;
+      }
+    }
+    for (int j = 0; j < 2 * (int)PAGES - 1; j++) CHECK (put (log, CParamLog::keyUser + (j % keys), 1000 + j));
+    CParamLog log2 (0, SECTORS, &sim);
+    for (int k = 0; k < keys; k++) CHECK (has (log2, CParamLog::keyUser + k, 1000 + 2 * PAGES - 1 - keys + k));
+    if (done) break;
+  }
+}
+
+//! CRCが合わない記録は破棄され、直前の値が使われる
+static void test_crc (void) {
+  blank();
+  uint32_t addr;
+  {
+    CParamLog log (0, SECTORS, &sim);
+    CHECK (put (log, CParamLog::keyUser, 100));
+    for (addr = 0; addr < SIZE && flash[addr] != 0xff; addr += CParamLog::_PAGE_SIZE);
+    CHECK (put (log, CParamLog::keyUser, 200));
+  }
+  // 新しい記録のデータの1ビットを0にする
+  flash[addr + 20] &= flash[addr + 20] - 1;
+  {
+    CParamLog log (0, SECTORS, &sim);
+    CHECK (has (log, CParamLog::keyUser, 100));
+    // 壊れた記録の後に書かれる
+    CHECK (put (log, CParamLog::keyUser, 300));
+  }
+  CParamLog log (0, SECTORS, &sim);
+  CHECK (has (log, CParamLog::keyUser, 300));
+  CHECK (overwrite == 0);
+}
+
+int main (void) {
+  RUN (test_empty);
+  RUN (test_remount);
+  RUN (test_reclaim);
+  RUN (test_power_loss);
+  RUN (test_crc);
+  return REPORT();
+}